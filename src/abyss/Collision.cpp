@@ -0,0 +1,980 @@
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+
+#include "Collision.h"
+#include "RigidBody.h"
+
+namespace Abyss {
+	// the share of the penetration pushed out per second, and how much
+	// penetration is left for the contacts to stay in touch
+	static const Real PenetrationRecovery = 0.2;
+	static const Real PenetrationSlop = 0.01;
+	// the closing velocity below which contacts don't bounce
+	static const Real RestitutionVelocity = 1.0;
+	// how much more the face of b must overlap before it is used
+	// instead of the face of a, so that the reference face doesn't
+	// flip from frame to frame
+	static const Real ReferenceFaceTolerance = 0.001;
+	// how close conservative advancement brings shapes, within the
+	// margin so that they have a contact where they stop
+	static const float TimeOfImpactTarget = 0.005f;
+	static const unsigned int MaxAdvancementSteps = 32;
+
+	static float halfSizeOn(const OrientedBox& box, int axis)
+	{
+		return axis ? box.HalfSize.y : box.HalfSize.x;
+	}
+
+	// How far a point of the box may move in the step.
+	static float sweepMotion(const SweptBox& sweep)
+	{
+		return sweep.Displacement.length() + fabs(sweep.Rotation) * sweep.Box.HalfSize.length();
+	}
+
+	static float smallerHalfSize(const OrientedBox& box)
+	{
+		return std::min(box.HalfSize.x, box.HalfSize.y);
+	}
+
+	OrientedBox getBodyBox(const RigidBody* body, const Common::Vector2& halfSize)
+	{
+		OrientedBox box;
+		Common::Vector2 o = body->getOrientation();
+		box.Center = body->getPosition();
+		box.Axes[0] = Common::Vector2(o.y, -o.x);
+		box.Axes[1] = o;
+		box.HalfSize = halfSize;
+		return box;
+	}
+
+	SweptBox getBodySweep(const RigidBody* body, const Common::Vector2& halfSize,
+			const Common::Vector2& startPosition, const Common::Vector2& startOrientation)
+	{
+		SweptBox sweep;
+		sweep.Box.Center = startPosition;
+		sweep.Box.Axes[0] = Common::Vector2(startOrientation.y, -startOrientation.x);
+		sweep.Box.Axes[1] = startOrientation;
+		sweep.Box.HalfSize = halfSize;
+		sweep.Displacement = body->getPosition() - startPosition;
+		sweep.Rotation = startOrientation.angleTo(body->getOrientation());
+		return sweep;
+	}
+
+	OrientedBox getSweptBox(const SweptBox& sweep, Real t)
+	{
+		OrientedBox box = sweep.Box;
+		box.Center += sweep.Displacement * t;
+		float c = cos(sweep.Rotation * t);
+		float s = sin(sweep.Rotation * t);
+		for(int k = 0; k < 2; k++) {
+			const Common::Vector2& a = sweep.Box.Axes[k];
+			box.Axes[k] = Common::Vector2(a.x * c - a.y * s, a.x * s + a.y * c);
+		}
+		return box;
+	}
+
+	void moveBodyAlongSweep(RigidBody* body, const SweptBox& sweep, Real t)
+	{
+		OrientedBox box = getSweptBox(sweep, t);
+		body->setPosition(box.Center);
+		body->setOrientation(box.Axes[1]);
+	}
+
+	// The largest separation of b from a face of a, and the normal of
+	// that face, pointing towards b.
+	static float findMaxSeparation(const OrientedBox& a, const OrientedBox& b,
+			int& axis, Common::Vector2& normal)
+	{
+		Common::Vector2 d = b.Center - a.Center;
+		float maxSeparation = -HUGE_VALF;
+		for(int k = 0; k < 2; k++) {
+			const Common::Vector2& n = a.Axes[k];
+			float dist = d.dot(n);
+			float extent = b.HalfSize.x * fabs(b.Axes[0].dot(n)) +
+				b.HalfSize.y * fabs(b.Axes[1].dot(n));
+			float separation = fabs(dist) - halfSizeOn(a, k) - extent;
+			if(separation > maxSeparation) {
+				maxSeparation = separation;
+				axis = k;
+				normal = dist < 0.0f ? n * -1.0f : n;
+			}
+		}
+		return maxSeparation;
+	}
+
+	// Keeps the part of the segment in behind the plane n.p = offset.
+	// Returns the number of points left.
+	static int clipSegment(Common::Vector2* points, unsigned int* ids,
+			const Common::Vector2& n, float offset, unsigned int clipId)
+	{
+		float d0 = n.dot(points[0]) - offset;
+		float d1 = n.dot(points[1]) - offset;
+		Common::Vector2 out[2];
+		unsigned int outIds[2];
+		int num = 0;
+		if(d0 <= 0.0f) {
+			out[num] = points[0];
+			outIds[num++] = ids[0];
+		}
+		if(d1 <= 0.0f) {
+			out[num] = points[1];
+			outIds[num++] = ids[1];
+		}
+		if(d0 * d1 < 0.0f) {
+			out[num] = points[0] + (points[1] - points[0]) * (d0 / (d0 - d1));
+			outIds[num++] = clipId;
+		}
+		for(int i = 0; i < num; i++) {
+			points[i] = out[i];
+			ids[i] = outIds[i];
+		}
+		return num;
+	}
+
+	bool collideBoxes(const OrientedBox& a, const OrientedBox& b, ContactManifold& manifold)
+	{
+		int axisA, axisB;
+		Common::Vector2 normalA, normalB;
+		float separationA = findMaxSeparation(a, b, axisA, normalA);
+		if(separationA > ContactMargin)
+			return false;
+		float separationB = findMaxSeparation(b, a, axisB, normalB);
+		if(separationB > ContactMargin)
+			return false;
+
+		// the reference face is the one overlapped the least, the
+		// incident edge is the edge of the other box facing it most
+		bool flip = separationB > separationA + ReferenceFaceTolerance;
+		const OrientedBox& ref = flip ? b : a;
+		const OrientedBox& inc = flip ? a : b;
+		int refAxis = flip ? axisB : axisA;
+		Common::Vector2 n = flip ? normalB : normalA;
+
+		int incAxis = fabs(inc.Axes[0].dot(n)) > fabs(inc.Axes[1].dot(n)) ? 0 : 1;
+		float incSign = inc.Axes[incAxis].dot(n) > 0.0f ? -1.0f : 1.0f;
+		Common::Vector2 incCenter = inc.Center + inc.Axes[incAxis] * (incSign * halfSizeOn(inc, incAxis));
+		Common::Vector2 incSide = inc.Axes[1 - incAxis] * halfSizeOn(inc, 1 - incAxis);
+		Common::Vector2 points[2] = {incCenter + incSide, incCenter - incSide};
+
+		// which faces and corners the points come from: the
+		// reference face, the incident edge, then the corner or the
+		// side of the reference face that clipped the edge
+		unsigned int refFace = refAxis * 2 + (n.dot(ref.Axes[refAxis]) < 0.0f);
+		unsigned int incFace = incAxis * 2 + (incSign < 0.0f);
+		unsigned int feature = (flip << 6) | (refFace << 4) | (incFace << 2);
+		unsigned int ids[2] = {feature, feature | 1};
+
+		const Common::Vector2& side = ref.Axes[1 - refAxis];
+		float sideOffset = side.dot(ref.Center);
+		float sideHalfSize = halfSizeOn(ref, 1 - refAxis);
+		if(clipSegment(points, ids, side, sideOffset + sideHalfSize, feature | 2) < 2)
+			return false;
+		if(clipSegment(points, ids, side * -1.0f, sideHalfSize - sideOffset, feature | 3) < 2)
+			return false;
+
+		float front = n.dot(ref.Center) + halfSizeOn(ref, refAxis);
+		manifold.Normal = flip ? n : n * -1.0f;
+		manifold.NumPoints = 0;
+		for(int i = 0; i < 2; i++) {
+			float separation = n.dot(points[i]) - front;
+			if(separation > ContactMargin)
+				continue;
+			ContactPoint& p = manifold.Points[manifold.NumPoints++];
+			// half way between the boxes
+			p.Position = points[i] - n * (separation * 0.5f);
+			p.Penetration = -separation;
+			p.Feature = ids[i];
+			p.NormalImpulse = 0.0;
+			p.TangentImpulse = 0.0;
+		}
+		return manifold.NumPoints > 0;
+	}
+
+	ContactResolver::ContactResolver(unsigned int iterations)
+		: mIterations(iterations),
+		mIterationsUsed(0),
+		mTolerance(1.0e-3),
+		mWarmStarting(true)
+	{
+	}
+
+	void ContactResolver::setIterations(unsigned int iterations)
+	{
+		mIterations = iterations;
+	}
+
+	void ContactResolver::setTolerance(Real velocity)
+	{
+		mTolerance = velocity;
+	}
+
+	void ContactResolver::setWarmStarting(bool warmStarting)
+	{
+		mWarmStarting = warmStarting;
+	}
+
+	unsigned int ContactResolver::getIterationsUsed() const
+	{
+		return mIterationsUsed;
+	}
+
+	bool ContactResolver::PointKey::operator==(const PointKey& k) const
+	{
+		return Bodies[0] == k.Bodies[0] && Bodies[1] == k.Bodies[1] && Feature == k.Feature;
+	}
+
+	size_t ContactResolver::PointKeyHash::operator()(const PointKey& k) const
+	{
+		std::hash<RigidBody*> h;
+		return (h(k.Bodies[0]) * 31 + h(k.Bodies[1])) * 31 + k.Feature;
+	}
+
+	unsigned int ContactResolver::getSolverBody(RigidBody* body)
+	{
+		if(!body)
+			return 0;
+		auto ret = mBodyIndex.insert(std::make_pair(body, (unsigned int)mBodies.size()));
+		if(ret.second) {
+			mBodies.push_back(SolverBody{body, body->getVelocity(), body->getRotation(),
+					body->getInverseMass(), body->getInverseInertiaTensor()});
+		}
+		return ret.first->second;
+	}
+
+	void ContactResolver::resolveContacts(ContactManifold* manifolds,
+			unsigned int numManifolds, Real duration)
+	{
+		mBodies.clear();
+		mBodyIndex.clear();
+		mManifolds.clear();
+		mNextCache.clear();
+		mBodies.push_back(SolverBody{nullptr, Common::Vector2(), 0.0, 0.0, 0.0});
+
+		for(unsigned int i = 0; i < numManifolds; i++) {
+			ContactManifold& m = manifolds[i];
+			bool awake0 = m.Bodies[0]->isAwake();
+			bool awake1 = m.Bodies[1] && m.Bodies[1]->isAwake();
+			if(!awake0 && !awake1)
+				continue;
+			SolverManifold sm;
+			sm.Manifold = &m;
+			sm.Bodies[0] = getSolverBody(m.Bodies[0]);
+			sm.Bodies[1] = getSolverBody(m.Bodies[1]);
+			prepare(sm, duration);
+			mManifolds.push_back(sm);
+		}
+
+		for(const auto& sm : mManifolds) {
+			const ContactManifold& m = *sm.Manifold;
+			Common::Vector2 tangent(-m.Normal.y, m.Normal.x);
+			for(unsigned int j = 0; j < m.NumPoints; j++) {
+				const ContactPoint& p = m.Points[j];
+				applyImpulse(sm, sm.Points[j], m.Normal * p.NormalImpulse +
+						tangent * p.TangentImpulse);
+			}
+		}
+
+		mIterationsUsed = 0;
+		while(mIterationsUsed < mIterations) {
+			Real maxChange = 0.0;
+			for(auto& sm : mManifolds)
+				maxChange = std::max(maxChange, solve(sm));
+			mIterationsUsed++;
+			if(maxChange < mTolerance)
+				break;
+		}
+
+		for(const auto& sm : mManifolds) {
+			const ContactManifold& m = *sm.Manifold;
+			for(unsigned int j = 0; j < m.NumPoints; j++) {
+				const ContactPoint& p = m.Points[j];
+				PointKey key{{m.Bodies[0], m.Bodies[1]}, p.Feature};
+				mNextCache[key] = CachedImpulse{p.NormalImpulse, p.TangentImpulse};
+			}
+		}
+		std::swap(mCache, mNextCache);
+
+		for(unsigned int i = 1; i < mBodies.size(); i++) {
+			const SolverBody& b = mBodies[i];
+			b.Body->setVelocity(b.Velocity);
+			b.Body->setRotation(b.Rotation);
+		}
+	}
+
+	void ContactResolver::prepare(SolverManifold& sm, Real duration)
+	{
+		ContactManifold& m = *sm.Manifold;
+		const SolverBody& b0 = mBodies[sm.Bodies[0]];
+		const SolverBody& b1 = mBodies[sm.Bodies[1]];
+		Common::Vector2 tangent(-m.Normal.y, m.Normal.x);
+		Common::Vector2 pos0 = m.Bodies[0]->getPosition();
+		Common::Vector2 pos1 = m.Bodies[1] ? m.Bodies[1]->getPosition() : Common::Vector2();
+
+
+		for(unsigned int j = 0; j < m.NumPoints; j++) {
+			ContactPoint& p = m.Points[j];
+			SolverPoint& sp = sm.Points[j];
+			sp.RelativePositions[0] = p.Position - pos0;
+			sp.RelativePositions[1] = p.Position - pos1;
+			const Common::Vector2& r0 = sp.RelativePositions[0];
+			const Common::Vector2& r1 = sp.RelativePositions[1];
+
+			Real rn0 = r0.cross2d(m.Normal);
+			Real rn1 = r1.cross2d(m.Normal);
+			sp.NormalMass = b0.InverseMass + b1.InverseMass +
+				b0.InverseInertiaTensor * rn0 * rn0 + b1.InverseInertiaTensor * rn1 * rn1;
+			Real rt0 = r0.cross2d(tangent);
+			Real rt1 = r1.cross2d(tangent);
+			sp.TangentMass = b0.InverseMass + b1.InverseMass +
+				b0.InverseInertiaTensor * rt0 * rt0 + b1.InverseInertiaTensor * rt1 * rt1;
+
+			// close the gap if there is one, bounce off the closing
+			// velocity, push out the penetration
+			Common::Vector2 dv = b0.Velocity + Common::Vector2(-r0.y, r0.x) * b0.Rotation -
+				b1.Velocity - Common::Vector2(-r1.y, r1.x) * b1.Rotation;
+			Real vn = dv.dot(m.Normal);
+			sp.Bias = 0.0;
+			if(p.Penetration < 0.0)
+				sp.Bias = p.Penetration / duration;
+			if(vn < -RestitutionVelocity)
+				sp.Bias = -m.Restitution * vn;
+			if(p.Penetration > PenetrationSlop)
+				sp.Bias = std::max(sp.Bias,
+						PenetrationRecovery * (p.Penetration - PenetrationSlop) / duration);
+
+			p.NormalImpulse = 0.0;
+			p.TangentImpulse = 0.0;
+			if(mWarmStarting && !mCache.empty()) {
+				auto it = mCache.find(PointKey{{m.Bodies[0], m.Bodies[1]}, p.Feature});
+				if(it != mCache.end()) {
+					p.NormalImpulse = it->second.Normal;
+					p.TangentImpulse = it->second.Tangent;
+				}
+			}
+		}
+	}
+
+	void ContactResolver::applyImpulse(const SolverManifold& sm, const SolverPoint& sp,
+			const Common::Vector2& impulse)
+	{
+		SolverBody& b0 = mBodies[sm.Bodies[0]];
+		b0.Velocity += impulse * b0.InverseMass;
+		b0.Rotation += sp.RelativePositions[0].cross2d(impulse) * b0.InverseInertiaTensor;
+		if(sm.Bodies[1]) {
+			SolverBody& b1 = mBodies[sm.Bodies[1]];
+			b1.Velocity -= impulse * b1.InverseMass;
+			b1.Rotation -= sp.RelativePositions[1].cross2d(impulse) * b1.InverseInertiaTensor;
+		}
+	}
+
+	// One pass over the points of a manifold, friction first. Returns
+	// the largest change in velocity at a point.
+	Real ContactResolver::solve(SolverManifold& sm)
+	{
+		ContactManifold& m = *sm.Manifold;
+		Common::Vector2 tangent(-m.Normal.y, m.Normal.x);
+		Real maxChange = 0.0;
+		for(unsigned int j = 0; j < m.NumPoints; j++) {
+			ContactPoint& p = m.Points[j];
+			const SolverPoint& sp = sm.Points[j];
+			const SolverBody& b0 = mBodies[sm.Bodies[0]];
+			const SolverBody& b1 = mBodies[sm.Bodies[1]];
+			const Common::Vector2& r0 = sp.RelativePositions[0];
+			const Common::Vector2& r1 = sp.RelativePositions[1];
+
+			// friction, limited by the normal impulse
+			Common::Vector2 dv = b0.Velocity + Common::Vector2(-r0.y, r0.x) * b0.Rotation -
+				b1.Velocity - Common::Vector2(-r1.y, r1.x) * b1.Rotation;
+			Real maxFriction = m.Friction * p.NormalImpulse;
+			Real tangentImpulse = p.TangentImpulse - dv.dot(tangent) / sp.TangentMass;
+			tangentImpulse = std::max(-maxFriction, std::min(tangentImpulse, maxFriction));
+			Real change = tangentImpulse - p.TangentImpulse;
+			p.TangentImpulse = tangentImpulse;
+			applyImpulse(sm, sp, tangent * change);
+			maxChange = std::max(maxChange, fabs(change) * sp.TangentMass);
+
+			// the bodies may only be pushed apart
+			dv = b0.Velocity + Common::Vector2(-r0.y, r0.x) * b0.Rotation -
+				b1.Velocity - Common::Vector2(-r1.y, r1.x) * b1.Rotation;
+			Real normalImpulse = p.NormalImpulse + (sp.Bias - dv.dot(m.Normal)) / sp.NormalMass;
+			normalImpulse = std::max<Real>(normalImpulse, 0.0);
+			change = normalImpulse - p.NormalImpulse;
+			p.NormalImpulse = normalImpulse;
+			applyImpulse(sm, sp, m.Normal * change);
+			maxChange = std::max(maxChange, fabs(change) * sp.NormalMass);
+		}
+		return maxChange;
+	}
+
+	unsigned int Broadphase::addProxy(RigidBody* body, const Common::Vector2& halfSize)
+	{
+		assert(halfSize.x > 0.0f && halfSize.y > 0.0f);
+		unsigned int proxy;
+		if(mFreeProxies.empty()) {
+			proxy = mProxies.size();
+			mProxies.push_back(Proxy());
+		} else {
+			proxy = mFreeProxies.back();
+			mFreeProxies.pop_back();
+		}
+		Proxy& p = mProxies[proxy];
+		p.Body = body;
+		p.HalfSize = halfSize;
+		p.Live = true;
+		p.StartPosition = body->getPosition();
+		p.StartOrientation = body->getOrientation();
+
+		// as if the box came in from the far end of both axes
+		for(int axis = 0; axis < 2; axis++) {
+			mEndpoints[axis].push_back(Endpoint{0.0f, proxy << 1});
+			mEndpoints[axis].push_back(Endpoint{0.0f, (proxy << 1) | 1});
+		}
+		return proxy;
+	}
+
+	void Broadphase::removeProxy(unsigned int proxy)
+	{
+		assert(proxy < mProxies.size() && mProxies[proxy].Live);
+		for(int axis = 0; axis < 2; axis++) {
+			auto& endpoints = mEndpoints[axis];
+			endpoints.erase(std::remove_if(endpoints.begin(), endpoints.end(),
+						[&] (const Endpoint& e) { return e.Data >> 1 == proxy; }),
+					endpoints.end());
+		}
+		for(unsigned int i = 0; i < mPairs.size(); ) {
+			const ProxyPair& pair = mPairs[i];
+			if(pair.Proxies[0] == proxy || pair.Proxies[1] == proxy)
+				removePair(pair.Proxies[0], pair.Proxies[1]);
+			else
+				i++;
+		}
+		mProxies[proxy].Live = false;
+		mProxies[proxy].Body = nullptr;
+		mFreeProxies.push_back(proxy);
+	}
+
+	RigidBody* Broadphase::getBody(unsigned int proxy) const
+	{
+		return mProxies[proxy].Body;
+	}
+
+	const Common::Vector2& Broadphase::getHalfSize(unsigned int proxy) const
+	{
+		return mProxies[proxy].HalfSize;
+	}
+
+	unsigned int Broadphase::getNumProxies() const
+	{
+		return mProxies.size() - mFreeProxies.size();
+	}
+
+	void Broadphase::update()
+	{
+		for(auto& p : mProxies) {
+			if(!p.Live)
+				continue;
+			Common::Vector2 pos = p.Body->getPosition();
+			if(mContinuous) {
+				// the box turning about its centre anywhere on
+				// the way, and the margin of the contacts
+				float r = p.HalfSize.length() + ContactMargin;
+				p.Min[0] = std::min(pos.x, p.StartPosition.x) - r;
+				p.Max[0] = std::max(pos.x, p.StartPosition.x) + r;
+				p.Min[1] = std::min(pos.y, p.StartPosition.y) - r;
+				p.Max[1] = std::max(pos.y, p.StartPosition.y) + r;
+				continue;
+			}
+			Common::Vector2 o = p.Body->getOrientation();
+			// the body x axis is (o.y, -o.x), its y axis o
+			float ex = p.HalfSize.x * fabs(o.y) + p.HalfSize.y * fabs(o.x) + ContactMargin;
+			float ey = p.HalfSize.x * fabs(o.x) + p.HalfSize.y * fabs(o.y) + ContactMargin;
+			p.Min[0] = pos.x - ex;
+			p.Max[0] = pos.x + ex;
+			p.Min[1] = pos.y - ey;
+			p.Max[1] = pos.y + ey;
+		}
+
+		for(int axis = 0; axis < 2; axis++) {
+			for(auto& e : mEndpoints[axis]) {
+				const Proxy& p = mProxies[e.Data >> 1];
+				e.Value = (e.Data & 1) ? p.Max[axis] : p.Min[axis];
+			}
+			sortAxis(axis);
+		}
+	}
+
+	const std::vector<ProxyPair>& Broadphase::getPairs() const
+	{
+		return mPairs;
+	}
+
+	void Broadphase::startStep()
+	{
+		mContinuous = true;
+		for(auto& p : mProxies) {
+			if(!p.Live)
+				continue;
+			p.StartPosition = p.Body->getPosition();
+			p.StartOrientation = p.Body->getOrientation();
+		}
+	}
+
+	SweptBox Broadphase::getSweep(unsigned int proxy) const
+	{
+		const Proxy& p = mProxies[proxy];
+		return getBodySweep(p.Body, p.HalfSize, p.StartPosition, p.StartOrientation);
+	}
+
+	void Broadphase::findTimesOfImpact(std::vector<Real>& times) const
+	{
+		times.assign(mProxies.size(), 1.0);
+		for(const auto& pair : mPairs) {
+			SweptBox a = getSweep(pair.Proxies[0]);
+			SweptBox b = getSweep(pair.Proxies[1]);
+			float motion = (a.Displacement - b.Displacement).length() +
+				fabs(a.Rotation) * a.Box.HalfSize.length() +
+				fabs(b.Rotation) * b.Box.HalfSize.length();
+			if(motion < std::min(smallerHalfSize(a.Box), smallerHalfSize(b.Box)))
+				continue;
+			Real toi;
+			if(timeOfImpact(a, b, toi)) {
+				for(unsigned int proxy : pair.Proxies)
+					times[proxy] = std::min(times[proxy], toi);
+			}
+		}
+	}
+
+	void Broadphase::generateContacts(std::vector<ContactManifold>& manifolds,
+			Real friction, Real restitution) const
+	{
+		ContactManifold m;
+		m.Friction = friction;
+		m.Restitution = restitution;
+		for(const auto& pair : mPairs) {
+			const Proxy& a = mProxies[pair.Proxies[0]];
+			const Proxy& b = mProxies[pair.Proxies[1]];
+			if(collideBoxes(getBodyBox(a.Body, a.HalfSize), getBodyBox(b.Body, b.HalfSize), m)) {
+				m.Bodies[0] = a.Body;
+				m.Bodies[1] = b.Body;
+				manifolds.push_back(m);
+			}
+		}
+	}
+
+	unsigned long long Broadphase::pairKey(unsigned int a, unsigned int b)
+	{
+		return ((unsigned long long)a << 32) | b;
+	}
+
+	// Boxes that only touch don't overlap. This matches the order of
+	// the endpoints, where a max comes before a min of the same value.
+	bool Broadphase::overlaps(unsigned int a, unsigned int b, int axis) const
+	{
+		const Proxy& pa = mProxies[a];
+		const Proxy& pb = mProxies[b];
+		return pa.Min[axis] < pb.Max[axis] && pb.Min[axis] < pa.Max[axis];
+	}
+
+	// Insertion sort, which is linear when little has changed. Each
+	// time an endpoint passes another one the two boxes start or stop
+	// overlapping on this axis.
+	void Broadphase::sortAxis(int axis)
+	{
+		auto& endpoints = mEndpoints[axis];
+		for(unsigned int i = 1; i < endpoints.size(); i++) {
+			Endpoint e = endpoints[i];
+			bool eMax = e.Data & 1;
+			unsigned int j = i;
+			while(j > 0) {
+				const Endpoint& f = endpoints[j - 1];
+				bool fMax = f.Data & 1;
+				if(!(e.Value < f.Value || (e.Value == f.Value && eMax && !fMax)))
+					break;
+
+				if(eMax != fMax) {
+					unsigned int a = e.Data >> 1;
+					unsigned int b = f.Data >> 1;
+					if(!eMax) {
+						if(overlaps(a, b, 1 - axis))
+							addPair(a, b);
+					} else {
+						removePair(a, b);
+					}
+				}
+				endpoints[j] = f;
+				j--;
+			}
+			endpoints[j] = e;
+		}
+	}
+
+	void Broadphase::addPair(unsigned int a, unsigned int b)
+	{
+		if(a > b)
+			std::swap(a, b);
+		auto ret = mPairIndex.insert(std::make_pair(pairKey(a, b), (unsigned int)mPairs.size()));
+		if(ret.second)
+			mPairs.push_back(ProxyPair{{a, b}});
+	}
+
+	void Broadphase::removePair(unsigned int a, unsigned int b)
+	{
+		if(a > b)
+			std::swap(a, b);
+		auto it = mPairIndex.find(pairKey(a, b));
+		if(it == mPairIndex.end())
+			return;
+		unsigned int i = it->second;
+		mPairIndex.erase(it);
+		if(i != mPairs.size() - 1) {
+			const ProxyPair& last = mPairs.back();
+			mPairIndex[pairKey(last.Proxies[0], last.Proxies[1])] = i;
+			mPairs[i] = last;
+		}
+		mPairs.pop_back();
+	}
+
+	bool collideBoxBarrier(const OrientedBox& box, const Barrier& barrier,
+			unsigned int featureBase, ContactManifold& manifold)
+	{
+		const Common::Vector2& n = barrier.Normal;
+		if((box.Center - barrier.Start).dot(n) < 0.0f)
+			return false;
+
+		// the corners behind the barrier and the ends of the barrier
+		// in the box, all pushed out along the barrier normal
+		Common::Vector2 dir = barrier.End - barrier.Start;
+		float length2 = dir.dot(dir);
+		Common::Vector2 ax = box.Axes[0] * box.HalfSize.x;
+		Common::Vector2 ay = box.Axes[1] * box.HalfSize.y;
+		Common::Vector2 positions[6];
+		float depths[6];
+		unsigned int features[6];
+		int num = 0;
+		for(int i = 0; i < 4; i++) {
+			Common::Vector2 corner = box.Center + ax * ((i & 1) ? -1.0f : 1.0f) +
+				ay * ((i & 2) ? -1.0f : 1.0f);
+			Common::Vector2 rel = corner - barrier.Start;
+			float depth = -rel.dot(n);
+			float along = rel.dot(dir);
+			if(depth < -ContactMargin || along < 0.0f || along > length2)
+				continue;
+			// half way between the corner and the barrier
+			positions[num] = corner + n * (depth * 0.5f);
+			depths[num] = depth;
+			features[num++] = featureBase * 8 + i;
+		}
+
+		float extent = fabs(ax.dot(n)) + fabs(ay.dot(n));
+		const Common::Vector2* ends[2] = {&barrier.Start, &barrier.End};
+		for(int i = 0; i < 2; i++) {
+			Common::Vector2 rel = *ends[i] - box.Center;
+			if(fabs(rel.dot(box.Axes[0])) >= box.HalfSize.x + ContactMargin ||
+					fabs(rel.dot(box.Axes[1])) >= box.HalfSize.y + ContactMargin)
+				continue;
+			float depth = rel.dot(n) + extent;
+			positions[num] = *ends[i] - n * (depth * 0.5f);
+			depths[num] = depth;
+			features[num++] = featureBase * 8 + 4 + i;
+		}
+		if(num == 0)
+			return false;
+
+		// keep the two deepest
+		manifold.Normal = n;
+		manifold.NumPoints = 0;
+		for(int k = 0; k < 2 && k < num; k++) {
+			int deepest = k;
+			for(int i = k + 1; i < num; i++) {
+				if(depths[i] > depths[deepest])
+					deepest = i;
+			}
+			std::swap(positions[k], positions[deepest]);
+			std::swap(depths[k], depths[deepest]);
+			std::swap(features[k], features[deepest]);
+			ContactPoint& p = manifold.Points[manifold.NumPoints++];
+			p.Position = positions[k];
+			p.Penetration = depths[k];
+			p.Feature = features[k];
+			p.NormalImpulse = 0.0;
+			p.TangentImpulse = 0.0;
+		}
+		return true;
+	}
+
+	// The corners of the box, in order around it.
+	static void getBoxCorners(const OrientedBox& box, Common::Vector2* corners)
+	{
+		Common::Vector2 ax = box.Axes[0] * box.HalfSize.x;
+		Common::Vector2 ay = box.Axes[1] * box.HalfSize.y;
+		corners[0] = box.Center + ax + ay;
+		corners[1] = box.Center - ax + ay;
+		corners[2] = box.Center - ax - ay;
+		corners[3] = box.Center + ax - ay;
+	}
+
+	static Common::Vector2 closestOnSegment(const Common::Vector2& p,
+			const Common::Vector2& a, const Common::Vector2& b)
+	{
+		Common::Vector2 ab = b - a;
+		float length2 = ab.dot(ab);
+		if(length2 <= 0.0f)
+			return a;
+		float s = std::max(0.0f, std::min(1.0f, (p - a).dot(ab) / length2));
+		return a + ab * s;
+	}
+
+	// Whether a side of one of the polygons separates them.
+	static bool separated(const Common::Vector2* a, int na, const Common::Vector2* b, int nb)
+	{
+		for(int k = 0; k < 2; k++) {
+			const Common::Vector2* p = k ? b : a;
+			int np = k ? nb : na;
+			for(int i = 0; i < np; i++) {
+				Common::Vector2 edge = p[(i + 1) % np] - p[i];
+				Common::Vector2 n(-edge.y, edge.x);
+				float minA = HUGE_VALF, maxA = -HUGE_VALF;
+				float minB = HUGE_VALF, maxB = -HUGE_VALF;
+				for(int j = 0; j < na; j++) {
+					minA = std::min(minA, n.dot(a[j]));
+					maxA = std::max(maxA, n.dot(a[j]));
+				}
+				for(int j = 0; j < nb; j++) {
+					minB = std::min(minB, n.dot(b[j]));
+					maxB = std::max(maxB, n.dot(b[j]));
+				}
+				if(maxA < minB || maxB < minA)
+					return true;
+			}
+		}
+		return false;
+	}
+
+	// The distance between two convex polygons, 0 if they overlap. A
+	// segment is a polygon of two corners. Sets normal to the
+	// direction from the closest point of b to the closest point of a.
+	static float polygonDistance(const Common::Vector2* a, int na,
+			const Common::Vector2* b, int nb, Common::Vector2& normal)
+	{
+		if(!separated(a, na, b, nb))
+			return 0.0f;
+		// apart, the closest points are a corner and a side
+		float distance2 = HUGE_VALF;
+		for(int k = 0; k < 2; k++) {
+			const Common::Vector2* p = k ? b : a;
+			const Common::Vector2* q = k ? a : b;
+			int np = k ? nb : na;
+			int nq = k ? na : nb;
+			for(int i = 0; i < np; i++) {
+				for(int j = 0; j < nq; j++) {
+					Common::Vector2 d = p[i] - closestOnSegment(p[i], q[j], q[(j + 1) % nq]);
+					float d2 = d.dot(d);
+					if(d2 < distance2) {
+						distance2 = d2;
+						normal = k ? d * -1.0f : d;
+					}
+				}
+			}
+		}
+		float distance = sqrt(distance2);
+		normal = normal * (1.0f / distance);
+		return distance;
+	}
+
+	// Conservative advancement of a box against another box, or a
+	// barrier if b is nullptr. Along the direction of the gap, the gap
+	// can't close faster than the shapes move towards each other plus
+	// the most their corners move by turning, so stepping the time on
+	// by the gap over that speed can't step past the first touch.
+	static bool advance(const SweptBox& a, const SweptBox* b, const Barrier* barrier, Real& toi)
+	{
+		Common::Vector2 cornersA[4];
+		Common::Vector2 cornersB[4];
+		int numB = b ? 4 : 2;
+		Common::Vector2 displacement = a.Displacement;
+		float turn = fabs(a.Rotation) * a.Box.HalfSize.length();
+		if(b) {
+			displacement -= b->Displacement;
+			turn += fabs(b->Rotation) * b->Box.HalfSize.length();
+		} else {
+			cornersB[0] = barrier->Start;
+			cornersB[1] = barrier->End;
+		}
+
+		Real t = 0.0;
+		float target = TimeOfImpactTarget;
+		for(unsigned int i = 0; i < MaxAdvancementSteps; i++) {
+			getBoxCorners(getSweptBox(a, t), cornersA);
+			if(b)
+				getBoxCorners(getSweptBox(*b, t), cornersB);
+			Common::Vector2 normal;
+			float distance = polygonDistance(cornersA, 4, cornersB, numB, normal);
+			if(i == 0) {
+				if(distance <= 0.0f)
+					return false;
+				target = std::min(target, distance * 0.5f);
+			}
+			if(distance <= target) {
+				toi = t;
+				return true;
+			}
+			float speed = turn - displacement.dot(normal);
+			if(speed <= 0.0f)
+				return false;
+			t += distance / speed;
+			if(t >= 1.0)
+				return false;
+		}
+		// close enough, and still before the touch
+		toi = t;
+		return true;
+	}
+
+	bool timeOfImpact(const SweptBox& a, const SweptBox& b, Real& toi)
+	{
+		return advance(a, &b, nullptr, toi);
+	}
+
+	bool timeOfImpact(const SweptBox& sweep, const Barrier& barrier, Real& toi)
+	{
+		if((sweep.Box.Center - barrier.Start).dot(barrier.Normal) < 0.0f)
+			return false;
+		return advance(sweep, nullptr, &barrier, toi);
+	}
+
+	BarrierTree::BarrierTree(const std::vector<Barrier>& barriers)
+		: mBarriers(barriers)
+	{
+		if(!mBarriers.empty())
+			build(0, mBarriers.size());
+	}
+
+	unsigned int BarrierTree::getNumBarriers() const
+	{
+		return mBarriers.size();
+	}
+
+	const Barrier& BarrierTree::getBarrier(unsigned int i) const
+	{
+		return mBarriers[i];
+	}
+
+	// Builds the node of the barriers [begin, end), splitting them in
+	// half along the longer side of the bounds of their centres.
+	// Returns the index of the node.
+	unsigned int BarrierTree::build(unsigned int begin, unsigned int end)
+	{
+		unsigned int index = mNodes.size();
+		mNodes.push_back(Node());
+		Node node;
+		float centerMin[2] = {HUGE_VALF, HUGE_VALF};
+		float centerMax[2] = {-HUGE_VALF, -HUGE_VALF};
+		for(int axis = 0; axis < 2; axis++) {
+			node.Min[axis] = HUGE_VALF;
+			node.Max[axis] = -HUGE_VALF;
+		}
+		for(unsigned int i = begin; i < end; i++) {
+			const Barrier& b = mBarriers[i];
+			float start[2] = {b.Start.x, b.Start.y};
+			float stop[2] = {b.End.x, b.End.y};
+			for(int axis = 0; axis < 2; axis++) {
+				node.Min[axis] = std::min(node.Min[axis], std::min(start[axis], stop[axis]));
+				node.Max[axis] = std::max(node.Max[axis], std::max(start[axis], stop[axis]));
+				float center = (start[axis] + stop[axis]) * 0.5f;
+				centerMin[axis] = std::min(centerMin[axis], center);
+				centerMax[axis] = std::max(centerMax[axis], center);
+			}
+		}
+
+		if(end - begin <= LeafSize) {
+			node.Index = begin;
+			node.Count = end - begin;
+		} else {
+			int axis = centerMax[0] - centerMin[0] > centerMax[1] - centerMin[1] ? 0 : 1;
+			unsigned int mid = (begin + end) / 2;
+			std::nth_element(mBarriers.begin() + begin, mBarriers.begin() + mid,
+					mBarriers.begin() + end,
+					[axis] (const Barrier& a, const Barrier& b) {
+						return axis ? a.Start.y + a.End.y < b.Start.y + b.End.y :
+							a.Start.x + a.End.x < b.Start.x + b.End.x;
+					});
+			build(begin, mid);
+			node.Index = build(mid, end);
+			node.Count = 0;
+		}
+		mNodes[index] = node;
+		return index;
+	}
+
+	void BarrierTree::query(const Common::Vector2& min, const Common::Vector2& max,
+			std::vector<unsigned int>& barriers) const
+	{
+		if(mNodes.empty())
+			return;
+		// the tree is balanced, so this is deep enough for any
+		// number of barriers
+		unsigned int stack[64];
+		int top = 0;
+		stack[top++] = 0;
+		while(top) {
+			unsigned int index = stack[--top];
+			const Node& node = mNodes[index];
+			if(node.Min[0] > max.x || node.Max[0] < min.x ||
+					node.Min[1] > max.y || node.Max[1] < min.y)
+				continue;
+			if(node.Count) {
+				for(unsigned int i = node.Index; i < node.Index + node.Count; i++)
+					barriers.push_back(i);
+			} else {
+				stack[top++] = node.Index;
+				stack[top++] = index + 1;
+			}
+		}
+	}
+
+	void BarrierTree::generateContacts(RigidBody* body, const Common::Vector2& halfSize,
+			std::vector<ContactManifold>& manifolds, Real friction, Real restitution) const
+	{
+		OrientedBox box = getBodyBox(body, halfSize);
+		float ex = halfSize.x * fabs(box.Axes[0].x) + halfSize.y * fabs(box.Axes[1].x) + ContactMargin;
+		float ey = halfSize.x * fabs(box.Axes[0].y) + halfSize.y * fabs(box.Axes[1].y) + ContactMargin;
+		Common::Vector2 extent(ex, ey);
+		std::vector<unsigned int> barriers;
+		query(box.Center - extent, box.Center + extent, barriers);
+
+		ContactManifold m;
+		m.Bodies[0] = body;
+		m.Bodies[1] = nullptr;
+		m.Friction = friction;
+		m.Restitution = restitution;
+		for(unsigned int i : barriers) {
+			if(collideBoxBarrier(box, mBarriers[i], i, m))
+				manifolds.push_back(m);
+		}
+	}
+
+	bool BarrierTree::timeOfImpact(const SweptBox& sweep, Real& toi) const
+	{
+		if(sweepMotion(sweep) < smallerHalfSize(sweep.Box))
+			return false;
+		const Common::Vector2& start = sweep.Box.Center;
+		Common::Vector2 end = start + sweep.Displacement;
+		float r = sweep.Box.HalfSize.length() + ContactMargin;
+		std::vector<unsigned int> barriers;
+		query(Common::Vector2(std::min(start.x, end.x) - r, std::min(start.y, end.y) - r),
+				Common::Vector2(std::max(start.x, end.x) + r, std::max(start.y, end.y) + r),
+				barriers);
+
+		bool hit = false;
+		for(unsigned int i : barriers) {
+			Real t;
+			if(Abyss::timeOfImpact(sweep, mBarriers[i], t) && (!hit || t < toi)) {
+				toi = t;
+				hit = true;
+			}
+		}
+		return hit;
+	}
+}
+
@@ -0,0 +1,310 @@
+#ifndef ABYSS_COLLISION_H
+#define ABYSS_COLLISION_H
+
+#include <vector>
+#include <unordered_map>
+
+#include "common/Vector2.h"
+
+#include "Prereq.h"
+
+namespace Abyss {
+	class RigidBody;
+
+	// A box centred on a body and oriented with it.
+	struct OrientedBox {
+		Common::Vector2 Center;
+		Common::Vector2 Axes[2]; // across and along the body orientation
+		Common::Vector2 HalfSize;
+	};
+
+	OrientedBox getBodyBox(const RigidBody* body, const Common::Vector2& halfSize);
+
+	// A box moving through a step: Box at the start, moved by
+	// Displacement and turned by Rotation radians about its centre
+	// at the end.
+	struct SweptBox {
+		OrientedBox Box;
+		Common::Vector2 Displacement;
+		Real Rotation;
+	};
+
+	// The box of the body moving from the start pose to where the
+	// body is now, turning less than half a turn.
+	SweptBox getBodySweep(const RigidBody* body, const Common::Vector2& halfSize,
+			const Common::Vector2& startPosition, const Common::Vector2& startOrientation);
+
+	// The box at time t, from 0 at the start of the step to 1 at the
+	// end.
+	OrientedBox getSweptBox(const SweptBox& sweep, Real t);
+
+	// Puts the body where its box is at time t.
+	void moveBodyAlongSweep(RigidBody* body, const SweptBox& sweep, Real t);
+
+	struct ContactPoint {
+		Common::Vector2 Position;
+		Real Penetration;
+		// Identifies the point between frames: which edge and corner
+		// it came from.
+		unsigned int Feature;
+		// The impulses the resolver applied, along the normal and
+		// the tangent.
+		Real NormalImpulse;
+		Real TangentImpulse;
+	};
+
+	// The points where two bodies touch.
+	struct ContactManifold {
+		// Bodies[1] may be nullptr (contact with scenery)
+		RigidBody* Bodies[2];
+		// points from Bodies[1] to Bodies[0]
+		Common::Vector2 Normal;
+		ContactPoint Points[2];
+		unsigned int NumPoints;
+		Real Friction;
+		Real Restitution;
+	};
+
+	// how far apart shapes are still in contact, with a negative
+	// penetration
+	static const float ContactMargin = 0.01f;
+
+	// Separating axis test of two boxes. If they overlap, fills in the
+	// normal and points of the manifold with a as Bodies[0], clipped
+	// from the edge of one box against the face of the other that
+	// overlap the least, and returns true. Boxes a centimetre or less
+	// apart are in contact too, with a negative penetration, so that
+	// the resolver stops them closing the gap too fast.
+	bool collideBoxes(const OrientedBox& a, const OrientedBox& b, ContactManifold& manifold);
+
+	// A wall along the line from Start to End. It pushes bodies out
+	// towards the side Normal points to and leaves alone bodies whose
+	// centre is behind it.
+	struct Barrier {
+		Common::Vector2 Start;
+		Common::Vector2 End;
+		Common::Vector2 Normal;
+	};
+
+	// If the corners of the box are behind the barrier, or its ends are
+	// in the box, fills in the manifold with the two deepest points,
+	// the box as Bodies[0] and nullptr as Bodies[1], and returns true.
+	// The feature ids of the points start at featureBase * 8. As with
+	// collideBoxes(), a centimetre counts as touching.
+	bool collideBoxBarrier(const OrientedBox& box, const Barrier& barrier,
+			unsigned int featureBase, ContactManifold& manifold);
+
+	// Continuous collision detection: the first time in the step, from
+	// 0 to 1, that the boxes come to a few millimetres of each other,
+	// found by conservative advancement. Returns false if they don't,
+	// or if they overlap at the start already, which is left to the
+	// contacts. Boxes that start closer than that must halve the gap.
+	bool timeOfImpact(const SweptBox& a, const SweptBox& b, Real& toi);
+	// The same for a box and a barrier. Boxes whose centre starts
+	// behind the barrier are left alone.
+	bool timeOfImpact(const SweptBox& sweep, const Barrier& barrier, Real& toi);
+
+	// Sequential impulses: the contact points are given impulses one
+	// after the other, along the normal to stop the bodies moving into
+	// each other and along the tangent for friction, until no impulse
+	// changes the velocity at its point by more than the tolerance.
+	// Penetration is removed by pushing the bodies apart a little
+	// every step. The impulses of a step start from the ones the same
+	// points got in the previous step, which is most of the time close
+	// to the answer.
+	class ContactResolver {
+		public:
+			ContactResolver(unsigned int iterations);
+			void setIterations(unsigned int iterations);
+			void setTolerance(Real velocity);
+			void setWarmStarting(bool warmStarting);
+			// Changes the velocity and rotation of the bodies. Contacts
+			// between sleeping bodies, or a sleeping body and
+			// scenery, are skipped. The others wake the bodies up.
+			void resolveContacts(ContactManifold* manifolds,
+					unsigned int numManifolds, Real duration);
+			unsigned int getIterationsUsed() const;
+
+		protected:
+			struct SolverBody {
+				RigidBody* Body;
+				Common::Vector2 Velocity;
+				Real Rotation;
+				Real InverseMass;
+				Real InverseInertiaTensor;
+			};
+
+			struct SolverPoint {
+				Common::Vector2 RelativePositions[2];
+				Real NormalMass;  // the inverse of the effective mass
+				Real TangentMass;
+				Real Bias;        // separating velocity to reach
+			};
+
+			struct SolverManifold {
+				ContactManifold* Manifold;
+				unsigned int Bodies[2];
+				SolverPoint Points[2];
+			};
+
+			// the impulses of the points of the previous call by
+			// bodies and feature
+			struct PointKey {
+				RigidBody* Bodies[2];
+				unsigned int Feature;
+				bool operator==(const PointKey& k) const;
+			};
+			struct PointKeyHash {
+				size_t operator()(const PointKey& k) const;
+			};
+			struct CachedImpulse {
+				Real Normal;
+				Real Tangent;
+			};
+			typedef std::unordered_map<PointKey, CachedImpulse, PointKeyHash> ImpulseCache;
+
+			unsigned int getSolverBody(RigidBody* body);
+			void prepare(SolverManifold& sm, Real duration);
+			void applyImpulse(const SolverManifold& sm, const SolverPoint& sp,
+					const Common::Vector2& impulse);
+			Real solve(SolverManifold& sm);
+
+			unsigned int mIterations;
+			unsigned int mIterationsUsed;
+			Real mTolerance;
+			bool mWarmStarting;
+
+			std::vector<SolverBody> mBodies; // the first one is the scenery
+			std::unordered_map<RigidBody*, unsigned int> mBodyIndex;
+			std::vector<SolverManifold> mManifolds;
+			ImpulseCache mCache;
+			ImpulseCache mNextCache;
+	};
+
+	// Two boxes whose bounds overlap, by proxy.
+	struct ProxyPair {
+		unsigned int Proxies[2]; // the lower one first
+	};
+
+	// Finds the boxes whose axis aligned bounds overlap with sweep and
+	// prune. Each box is centred on its body and oriented with it,
+	// halfSize.x across and halfSize.y along the orientation, and its
+	// bounds are grown by ContactMargin so that boxes close enough for a
+	// contact are paired. The bounds are kept sorted on both axes
+	// between updates, so when the bodies move little from step to step
+	// an update costs about as much as reading their positions, plus a
+	// little per pair that starts or stops overlapping.
+	class Broadphase {
+		public:
+			// The box is picked up by the next update().
+			unsigned int addProxy(RigidBody* body, const Common::Vector2& halfSize);
+			void removeProxy(unsigned int proxy);
+			RigidBody* getBody(unsigned int proxy) const;
+			const Common::Vector2& getHalfSize(unsigned int proxy) const;
+			unsigned int getNumProxies() const;
+
+			// Reads the body poses and updates the pairs. After
+			// startStep() the bounds cover the boxes all the way
+			// from where they were then.
+			void update();
+			const std::vector<ProxyPair>& getPairs() const;
+
+			// Continuous collision detection. Call before stepping
+			// the world, then after the step update() and
+			// findTimesOfImpact() to find where fast boxes would
+			// pass through each other.
+			void startStep();
+			// The motion of the box since startStep().
+			SweptBox getSweep(unsigned int proxy) const;
+			// Sets times[proxy] to the first time in the step that
+			// the box touches another, 1 if it doesn't. Pairs that
+			// move less in the step than the smaller half size of
+			// their boxes can't pass through each other and are
+			// left to the contacts.
+			void findTimesOfImpact(std::vector<Real>& times) const;
+
+			// Runs collideBoxes() on the pairs and appends the
+			// manifolds of the boxes that overlap.
+			void generateContacts(std::vector<ContactManifold>& manifolds,
+					Real friction, Real restitution) const;
+
+		private:
+			struct Proxy {
+				RigidBody* Body;
+				Common::Vector2 HalfSize;
+				float Min[2];
+				float Max[2];
+				bool Live;
+				// the pose at startStep()
+				Common::Vector2 StartPosition;
+				Common::Vector2 StartOrientation;
+			};
+
+			// the proxy shifted left by one, the lowest bit set for a
+			// max endpoint
+			struct Endpoint {
+				float Value;
+				unsigned int Data;
+			};
+
+			static unsigned long long pairKey(unsigned int a, unsigned int b);
+			bool overlaps(unsigned int a, unsigned int b, int axis) const;
+			void sortAxis(int axis);
+			void addPair(unsigned int a, unsigned int b);
+			void removePair(unsigned int a, unsigned int b);
+
+			std::vector<Proxy> mProxies;
+			std::vector<unsigned int> mFreeProxies;
+			std::vector<Endpoint> mEndpoints[2];
+			std::vector<ProxyPair> mPairs;
+			std::unordered_map<unsigned long long, unsigned int> mPairIndex;
+			bool mContinuous = false;
+	};
+
+	// Static bounding volume hierarchy over barriers, e.g. the edges of
+	// a track. Finding the barriers near a box takes time logarithmic
+	// in the number of barriers.
+	class BarrierTree {
+		public:
+			BarrierTree(const std::vector<Barrier>& barriers);
+			unsigned int getNumBarriers() const;
+			const Barrier& getBarrier(unsigned int i) const;
+
+			// Appends the barriers whose bounds overlap the bounds.
+			void query(const Common::Vector2& min, const Common::Vector2& max,
+					std::vector<unsigned int>& barriers) const;
+
+			// Runs collideBoxBarrier() on the barriers near the box
+			// of the body and appends the manifolds.
+			void generateContacts(RigidBody* body, const Common::Vector2& halfSize,
+					std::vector<ContactManifold>& manifolds,
+					Real friction, Real restitution) const;
+
+			// The first time in the step that the box touches a
+			// barrier, if it moves at least its smaller half size;
+			// slower boxes can't pass through a barrier and are
+			// left to the contacts.
+			bool timeOfImpact(const SweptBox& sweep, Real& toi) const;
+
+		private:
+			// A leaf holds Count barriers from Index on. An inner node
+			// has a Count of 0, its children are the next node and
+			// the node at Index.
+			struct Node {
+				float Min[2];
+				float Max[2];
+				unsigned int Index;
+				unsigned int Count;
+			};
+
+			static const unsigned int LeafSize = 4;
+
+			unsigned int build(unsigned int begin, unsigned int end);
+
+			std::vector<Barrier> mBarriers;
+			std::vector<Node> mNodes;
+	};
+}
+
+#endif
+
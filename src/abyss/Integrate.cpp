@@ -0,0 +1,476 @@
+#include <math.h>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "RigidBody.h"
+
+namespace Abyss {
+	// The body store arrays the kernels work on.
+	struct IntegrationArrays {
+		float* PositionX;
+		float* PositionY;
+		float* OrientationX;
+		float* OrientationY;
+		float* VelocityX;
+		float* VelocityY;
+		Real* Rotation;
+		float* ForceX;
+		float* ForceY;
+		Real* Torque;
+		const Real* InverseMass;
+		const Real* InverseInertiaTensor;
+		const Real* DampingFactor;
+		const Real* AngularDampingFactor;
+	};
+
+	// The orientation is turned by the rotation of the step by
+	// multiplying it as a complex number with cos + i sin of the
+	// angle. For angles up to MaxPolynomialAngle, which covers game
+	// time steps, sin and cos are their Taylor polynomials so that the
+	// SIMD kernels can evaluate them too. The result is normalised; the
+	// angle it is turned by is then off by at most 9e-6 rad, at the
+	// limit, mostly from the a^6 / 720 left out of cos.
+	static const Real MaxPolynomialAngle = 0.5;
+	static const Real CosC2 = 1.0 / 2.0;
+	static const Real CosC4 = 1.0 / 24.0;
+	static const Real SinC3 = 1.0 / 6.0;
+	static const Real SinC5 = 1.0 / 120.0;
+
+	static inline void rotateOrientation(float& ox, float& oy, Real angle)
+	{
+		Real c, s;
+		if(fabs(angle) <= MaxPolynomialAngle) {
+			Real a2 = angle * angle;
+			c = Real(1) - a2 * (CosC2 - a2 * CosC4);
+			s = angle * (Real(1) - a2 * (SinC3 - a2 * SinC5));
+		} else {
+			c = cos(angle);
+			s = sin(angle);
+		}
+		Real x = ox * c - oy * s;
+		Real y = ox * s + oy * c;
+		Real len = sqrt(x * x + y * y);
+		ox = x / len;
+		oy = y / len;
+	}
+
+	// The kernels advance the velocity, rotation, position and
+	// orientation of the bodies [begin, end) and clear their
+	// accumulators. The math is done in Real and each kernel does the
+	// same operations in the same order, so the results are bitwise
+	// the same as long as the compiler doesn't contract them to fused
+	// multiply-adds (the Makefile builds with -ffp-contract=off).
+
+	static void integrateScalar(const IntegrationArrays& a,
+			unsigned int begin, unsigned int end, Real duration)
+	{
+		for(unsigned int i = begin; i < end; i++) {
+			Real vx = (a.VelocityX[i] + a.ForceX[i] * a.InverseMass[i] * duration) *
+				a.DampingFactor[i];
+			Real vy = (a.VelocityY[i] + a.ForceY[i] * a.InverseMass[i] * duration) *
+				a.DampingFactor[i];
+			Real px = a.PositionX[i] + vx * duration;
+			Real py = a.PositionY[i] + vy * duration;
+			a.VelocityX[i] = vx;
+			a.VelocityY[i] = vy;
+			a.PositionX[i] = px;
+			a.PositionY[i] = py;
+			a.ForceX[i] = 0.0f;
+			a.ForceY[i] = 0.0f;
+
+			a.Rotation[i] = (a.Rotation[i] + a.Torque[i] * a.InverseInertiaTensor[i] * duration) *
+				a.AngularDampingFactor[i];
+			a.Torque[i] = 0.0;
+			rotateOrientation(a.OrientationX[i], a.OrientationY[i], a.Rotation[i] * duration);
+		}
+	}
+
+	// Redoes the orientation of the bodies of a SIMD block whose
+	// angle was too large for the polynomials. ox and oy are the
+	// orientations before the step.
+	static void fixLargeRotations(const IntegrationArrays& a, unsigned int i, int mask,
+			const float* ox, const float* oy, Real duration)
+	{
+		for(int j = 0; mask; j++, mask >>= 1) {
+			if(mask & 1) {
+				a.OrientationX[i + j] = ox[j];
+				a.OrientationY[i + j] = oy[j];
+				rotateOrientation(a.OrientationX[i + j], a.OrientationY[i + j],
+						a.Rotation[i + j] * duration);
+			}
+		}
+	}
+
+#if defined(__SSE2__) && !defined(ABYSS_SINGLE_PRECISION)
+	// Double precision: the float state is widened to double lanes.
+
+	static inline __m128d lowToDouble(__m128 v)
+	{
+		return _mm_cvtps_pd(v);
+	}
+
+	static inline __m128d highToDouble(__m128 v)
+	{
+		return _mm_cvtps_pd(_mm_movehl_ps(v, v));
+	}
+
+	static inline __m128 toFloat(__m128d lo, __m128d hi)
+	{
+		return _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi));
+	}
+
+	static void integrateSSE2(const IntegrationArrays& a,
+			unsigned int begin, unsigned int end, double duration)
+	{
+		const __m128d dt = _mm_set1_pd(duration);
+		const __m128d one = _mm_set1_pd(1.0);
+		const __m128d signMask = _mm_set1_pd(-0.0);
+		const __m128d maxAngle = _mm_set1_pd(MaxPolynomialAngle);
+		unsigned int i = begin;
+		for(; i + 4 <= end; i += 4) {
+			__m128d im[2] = { _mm_loadu_pd(a.InverseMass + i), _mm_loadu_pd(a.InverseMass + i + 2) };
+			__m128d df[2] = { _mm_loadu_pd(a.DampingFactor + i), _mm_loadu_pd(a.DampingFactor + i + 2) };
+
+			float* pos[2] = { a.PositionX + i, a.PositionY + i };
+			float* vel[2] = { a.VelocityX + i, a.VelocityY + i };
+			float* force[2] = { a.ForceX + i, a.ForceY + i };
+			for(int c = 0; c < 2; c++) {
+				__m128 f = _mm_loadu_ps(force[c]);
+				__m128 v = _mm_loadu_ps(vel[c]);
+				__m128 p = _mm_loadu_ps(pos[c]);
+				__m128d vd[2] = { lowToDouble(v), highToDouble(v) };
+				__m128d fd[2] = { lowToDouble(f), highToDouble(f) };
+				__m128d pd[2] = { lowToDouble(p), highToDouble(p) };
+				for(int h = 0; h < 2; h++) {
+					vd[h] = _mm_mul_pd(_mm_add_pd(vd[h],
+								_mm_mul_pd(_mm_mul_pd(fd[h], im[h]), dt)), df[h]);
+					pd[h] = _mm_add_pd(pd[h], _mm_mul_pd(vd[h], dt));
+				}
+				_mm_storeu_ps(vel[c], toFloat(vd[0], vd[1]));
+				_mm_storeu_ps(pos[c], toFloat(pd[0], pd[1]));
+				_mm_storeu_ps(force[c], _mm_setzero_ps());
+			}
+
+			__m128 ox = _mm_loadu_ps(a.OrientationX + i);
+			__m128 oy = _mm_loadu_ps(a.OrientationY + i);
+			__m128d oxd[2] = { lowToDouble(ox), highToDouble(ox) };
+			__m128d oyd[2] = { lowToDouble(oy), highToDouble(oy) };
+			int large = 0;
+			for(int h = 0; h < 2; h++) {
+				__m128d r = _mm_loadu_pd(a.Rotation + i + h * 2);
+				__m128d t = _mm_loadu_pd(a.Torque + i + h * 2);
+				__m128d iit = _mm_loadu_pd(a.InverseInertiaTensor + i + h * 2);
+				__m128d adf = _mm_loadu_pd(a.AngularDampingFactor + i + h * 2);
+				r = _mm_mul_pd(_mm_add_pd(r, _mm_mul_pd(_mm_mul_pd(t, iit), dt)), adf);
+				_mm_storeu_pd(a.Rotation + i + h * 2, r);
+				_mm_storeu_pd(a.Torque + i + h * 2, _mm_setzero_pd());
+
+				__m128d ang = _mm_mul_pd(r, dt);
+				large |= _mm_movemask_pd(_mm_cmpgt_pd(_mm_andnot_pd(signMask, ang), maxAngle)) << (h * 2);
+				__m128d a2 = _mm_mul_pd(ang, ang);
+				__m128d co = _mm_sub_pd(one, _mm_mul_pd(a2,
+							_mm_sub_pd(_mm_set1_pd(CosC2), _mm_mul_pd(a2, _mm_set1_pd(CosC4)))));
+				__m128d si = _mm_mul_pd(ang, _mm_sub_pd(one, _mm_mul_pd(a2,
+								_mm_sub_pd(_mm_set1_pd(SinC3), _mm_mul_pd(a2, _mm_set1_pd(SinC5))))));
+				__m128d x = _mm_sub_pd(_mm_mul_pd(oxd[h], co), _mm_mul_pd(oyd[h], si));
+				__m128d y = _mm_add_pd(_mm_mul_pd(oxd[h], si), _mm_mul_pd(oyd[h], co));
+				__m128d len = _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(x, x), _mm_mul_pd(y, y)));
+				oxd[h] = _mm_div_pd(x, len);
+				oyd[h] = _mm_div_pd(y, len);
+			}
+			_mm_storeu_ps(a.OrientationX + i, toFloat(oxd[0], oxd[1]));
+			_mm_storeu_ps(a.OrientationY + i, toFloat(oyd[0], oyd[1]));
+			if(large) {
+				float oldX[4], oldY[4];
+				_mm_storeu_ps(oldX, ox);
+				_mm_storeu_ps(oldY, oy);
+				fixLargeRotations(a, i, large, oldX, oldY, duration);
+			}
+		}
+		integrateScalar(a, i, end, duration);
+	}
+
+	__attribute__((target("avx2")))
+	static void integrateAVX2(const IntegrationArrays& a,
+			unsigned int begin, unsigned int end, double duration)
+	{
+		const __m256d dt = _mm256_set1_pd(duration);
+		const __m256d one = _mm256_set1_pd(1.0);
+		const __m256d signMask = _mm256_set1_pd(-0.0);
+		const __m256d maxAngle = _mm256_set1_pd(MaxPolynomialAngle);
+		unsigned int i = begin;
+		for(; i + 4 <= end; i += 4) {
+			__m256d im = _mm256_loadu_pd(a.InverseMass + i);
+			__m256d df = _mm256_loadu_pd(a.DampingFactor + i);
+
+			float* pos[2] = { a.PositionX + i, a.PositionY + i };
+			float* vel[2] = { a.VelocityX + i, a.VelocityY + i };
+			float* force[2] = { a.ForceX + i, a.ForceY + i };
+			for(int c = 0; c < 2; c++) {
+				__m256d f = _mm256_cvtps_pd(_mm_loadu_ps(force[c]));
+				__m256d v = _mm256_cvtps_pd(_mm_loadu_ps(vel[c]));
+				__m256d p = _mm256_cvtps_pd(_mm_loadu_ps(pos[c]));
+				v = _mm256_mul_pd(_mm256_add_pd(v, _mm256_mul_pd(_mm256_mul_pd(f, im), dt)), df);
+				p = _mm256_add_pd(p, _mm256_mul_pd(v, dt));
+				_mm_storeu_ps(vel[c], _mm256_cvtpd_ps(v));
+				_mm_storeu_ps(pos[c], _mm256_cvtpd_ps(p));
+				_mm_storeu_ps(force[c], _mm_setzero_ps());
+			}
+
+			__m256d r = _mm256_loadu_pd(a.Rotation + i);
+			__m256d t = _mm256_loadu_pd(a.Torque + i);
+			__m256d iit = _mm256_loadu_pd(a.InverseInertiaTensor + i);
+			__m256d adf = _mm256_loadu_pd(a.AngularDampingFactor + i);
+			r = _mm256_mul_pd(_mm256_add_pd(r, _mm256_mul_pd(_mm256_mul_pd(t, iit), dt)), adf);
+			_mm256_storeu_pd(a.Rotation + i, r);
+			_mm256_storeu_pd(a.Torque + i, _mm256_setzero_pd());
+
+			__m128 ox = _mm_loadu_ps(a.OrientationX + i);
+			__m128 oy = _mm_loadu_ps(a.OrientationY + i);
+			__m256d oxd = _mm256_cvtps_pd(ox);
+			__m256d oyd = _mm256_cvtps_pd(oy);
+			__m256d ang = _mm256_mul_pd(r, dt);
+			int large = _mm256_movemask_pd(_mm256_cmp_pd(_mm256_andnot_pd(signMask, ang),
+						maxAngle, _CMP_GT_OQ));
+			__m256d a2 = _mm256_mul_pd(ang, ang);
+			__m256d co = _mm256_sub_pd(one, _mm256_mul_pd(a2,
+						_mm256_sub_pd(_mm256_set1_pd(CosC2), _mm256_mul_pd(a2, _mm256_set1_pd(CosC4)))));
+			__m256d si = _mm256_mul_pd(ang, _mm256_sub_pd(one, _mm256_mul_pd(a2,
+							_mm256_sub_pd(_mm256_set1_pd(SinC3), _mm256_mul_pd(a2, _mm256_set1_pd(SinC5))))));
+			__m256d x = _mm256_sub_pd(_mm256_mul_pd(oxd, co), _mm256_mul_pd(oyd, si));
+			__m256d y = _mm256_add_pd(_mm256_mul_pd(oxd, si), _mm256_mul_pd(oyd, co));
+			__m256d len = _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(x, x), _mm256_mul_pd(y, y)));
+			_mm_storeu_ps(a.OrientationX + i, _mm256_cvtpd_ps(_mm256_div_pd(x, len)));
+			_mm_storeu_ps(a.OrientationY + i, _mm256_cvtpd_ps(_mm256_div_pd(y, len)));
+			if(large) {
+				float oldX[4], oldY[4];
+				_mm_storeu_ps(oldX, ox);
+				_mm_storeu_ps(oldY, oy);
+				fixLargeRotations(a, i, large, oldX, oldY, duration);
+			}
+		}
+		integrateScalar(a, i, end, duration);
+	}
+#elif defined(__SSE2__)
+	// Single precision: the state is used as is.
+
+	static void integrateSSE2(const IntegrationArrays& a,
+			unsigned int begin, unsigned int end, float duration)
+	{
+		const __m128 dt = _mm_set1_ps(duration);
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 signMask = _mm_set1_ps(-0.0f);
+		const __m128 maxAngle = _mm_set1_ps(MaxPolynomialAngle);
+		unsigned int i = begin;
+		for(; i + 4 <= end; i += 4) {
+			__m128 im = _mm_loadu_ps(a.InverseMass + i);
+			__m128 df = _mm_loadu_ps(a.DampingFactor + i);
+
+			float* pos[2] = { a.PositionX + i, a.PositionY + i };
+			float* vel[2] = { a.VelocityX + i, a.VelocityY + i };
+			float* force[2] = { a.ForceX + i, a.ForceY + i };
+			for(int c = 0; c < 2; c++) {
+				__m128 f = _mm_loadu_ps(force[c]);
+				__m128 v = _mm_loadu_ps(vel[c]);
+				__m128 p = _mm_loadu_ps(pos[c]);
+				v = _mm_mul_ps(_mm_add_ps(v, _mm_mul_ps(_mm_mul_ps(f, im), dt)), df);
+				p = _mm_add_ps(p, _mm_mul_ps(v, dt));
+				_mm_storeu_ps(vel[c], v);
+				_mm_storeu_ps(pos[c], p);
+				_mm_storeu_ps(force[c], _mm_setzero_ps());
+			}
+
+			__m128 r = _mm_loadu_ps(a.Rotation + i);
+			__m128 t = _mm_loadu_ps(a.Torque + i);
+			__m128 iit = _mm_loadu_ps(a.InverseInertiaTensor + i);
+			__m128 adf = _mm_loadu_ps(a.AngularDampingFactor + i);
+			r = _mm_mul_ps(_mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(t, iit), dt)), adf);
+			_mm_storeu_ps(a.Rotation + i, r);
+			_mm_storeu_ps(a.Torque + i, _mm_setzero_ps());
+
+			__m128 ox = _mm_loadu_ps(a.OrientationX + i);
+			__m128 oy = _mm_loadu_ps(a.OrientationY + i);
+			__m128 ang = _mm_mul_ps(r, dt);
+			int large = _mm_movemask_ps(_mm_cmpgt_ps(_mm_andnot_ps(signMask, ang), maxAngle));
+			__m128 a2 = _mm_mul_ps(ang, ang);
+			__m128 co = _mm_sub_ps(one, _mm_mul_ps(a2,
+						_mm_sub_ps(_mm_set1_ps(CosC2), _mm_mul_ps(a2, _mm_set1_ps(CosC4)))));
+			__m128 si = _mm_mul_ps(ang, _mm_sub_ps(one, _mm_mul_ps(a2,
+							_mm_sub_ps(_mm_set1_ps(SinC3), _mm_mul_ps(a2, _mm_set1_ps(SinC5))))));
+			__m128 x = _mm_sub_ps(_mm_mul_ps(ox, co), _mm_mul_ps(oy, si));
+			__m128 y = _mm_add_ps(_mm_mul_ps(ox, si), _mm_mul_ps(oy, co));
+			__m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)));
+			_mm_storeu_ps(a.OrientationX + i, _mm_div_ps(x, len));
+			_mm_storeu_ps(a.OrientationY + i, _mm_div_ps(y, len));
+			if(large) {
+				float oldX[4], oldY[4];
+				_mm_storeu_ps(oldX, ox);
+				_mm_storeu_ps(oldY, oy);
+				fixLargeRotations(a, i, large, oldX, oldY, duration);
+			}
+		}
+		integrateScalar(a, i, end, duration);
+	}
+
+	__attribute__((target("avx2")))
+	static void integrateAVX2(const IntegrationArrays& a,
+			unsigned int begin, unsigned int end, float duration)
+	{
+		const __m256 dt = _mm256_set1_ps(duration);
+		const __m256 one = _mm256_set1_ps(1.0f);
+		const __m256 signMask = _mm256_set1_ps(-0.0f);
+		const __m256 maxAngle = _mm256_set1_ps(MaxPolynomialAngle);
+		unsigned int i = begin;
+		for(; i + 8 <= end; i += 8) {
+			__m256 im = _mm256_loadu_ps(a.InverseMass + i);
+			__m256 df = _mm256_loadu_ps(a.DampingFactor + i);
+
+			float* pos[2] = { a.PositionX + i, a.PositionY + i };
+			float* vel[2] = { a.VelocityX + i, a.VelocityY + i };
+			float* force[2] = { a.ForceX + i, a.ForceY + i };
+			for(int c = 0; c < 2; c++) {
+				__m256 f = _mm256_loadu_ps(force[c]);
+				__m256 v = _mm256_loadu_ps(vel[c]);
+				__m256 p = _mm256_loadu_ps(pos[c]);
+				v = _mm256_mul_ps(_mm256_add_ps(v, _mm256_mul_ps(_mm256_mul_ps(f, im), dt)), df);
+				p = _mm256_add_ps(p, _mm256_mul_ps(v, dt));
+				_mm256_storeu_ps(vel[c], v);
+				_mm256_storeu_ps(pos[c], p);
+				_mm256_storeu_ps(force[c], _mm256_setzero_ps());
+			}
+
+			__m256 r = _mm256_loadu_ps(a.Rotation + i);
+			__m256 t = _mm256_loadu_ps(a.Torque + i);
+			__m256 iit = _mm256_loadu_ps(a.InverseInertiaTensor + i);
+			__m256 adf = _mm256_loadu_ps(a.AngularDampingFactor + i);
+			r = _mm256_mul_ps(_mm256_add_ps(r, _mm256_mul_ps(_mm256_mul_ps(t, iit), dt)), adf);
+			_mm256_storeu_ps(a.Rotation + i, r);
+			_mm256_storeu_ps(a.Torque + i, _mm256_setzero_ps());
+
+			__m256 ox = _mm256_loadu_ps(a.OrientationX + i);
+			__m256 oy = _mm256_loadu_ps(a.OrientationY + i);
+			__m256 ang = _mm256_mul_ps(r, dt);
+			int large = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_andnot_ps(signMask, ang),
+						maxAngle, _CMP_GT_OQ));
+			__m256 a2 = _mm256_mul_ps(ang, ang);
+			__m256 co = _mm256_sub_ps(one, _mm256_mul_ps(a2,
+						_mm256_sub_ps(_mm256_set1_ps(CosC2), _mm256_mul_ps(a2, _mm256_set1_ps(CosC4)))));
+			__m256 si = _mm256_mul_ps(ang, _mm256_sub_ps(one, _mm256_mul_ps(a2,
+							_mm256_sub_ps(_mm256_set1_ps(SinC3), _mm256_mul_ps(a2, _mm256_set1_ps(SinC5))))));
+			__m256 x = _mm256_sub_ps(_mm256_mul_ps(ox, co), _mm256_mul_ps(oy, si));
+			__m256 y = _mm256_add_ps(_mm256_mul_ps(ox, si), _mm256_mul_ps(oy, co));
+			__m256 len = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)));
+			_mm256_storeu_ps(a.OrientationX + i, _mm256_div_ps(x, len));
+			_mm256_storeu_ps(a.OrientationY + i, _mm256_div_ps(y, len));
+			if(large) {
+				float oldX[8], oldY[8];
+				_mm256_storeu_ps(oldX, ox);
+				_mm256_storeu_ps(oldY, oy);
+				fixLargeRotations(a, i, large, oldX, oldY, duration);
+			}
+		}
+		integrateScalar(a, i, end, duration);
+	}
+#endif
+
+	typedef void (*IntegrateFunc)(const IntegrationArrays&,
+			unsigned int, unsigned int, Real);
+
+	static IntegrateFunc getIntegrateFunc(IntegrationKernel k)
+	{
+		switch(k) {
+#if defined(__SSE2__)
+			case IntegrationKernel::SSE2:
+				return integrateSSE2;
+			case IntegrationKernel::AVX2:
+				return integrateAVX2;
+#endif
+			default:
+				return integrateScalar;
+		}
+	}
+
+	bool integrationKernelSupported(IntegrationKernel k)
+	{
+		switch(k) {
+			case IntegrationKernel::Scalar:
+				return true;
+#if defined(__SSE2__)
+			case IntegrationKernel::SSE2:
+				return true;
+			case IntegrationKernel::AVX2:
+				return __builtin_cpu_supports("avx2");
+#endif
+			default:
+				return false;
+		}
+	}
+
+	const char* integrationKernelName(IntegrationKernel k)
+	{
+		switch(k) {
+			case IntegrationKernel::Scalar:
+				return "scalar";
+			case IntegrationKernel::SSE2:
+				return "SSE2";
+			case IntegrationKernel::AVX2:
+				return "AVX2";
+		}
+		return "";
+	}
+
+	void World::setIntegrationKernel(IntegrationKernel k)
+	{
+		assert(integrationKernelSupported(k));
+		mKernel = k;
+	}
+
+	IntegrationKernel World::getIntegrationKernel() const
+	{
+		return mKernel;
+	}
+
+	// The damping factors only change with the time step. The adaptive
+	// stepping alternates between a step and its halves, which both
+	// use the cached factors.
+	void World::prepareDampingFactors(Real duration)
+	{
+		if(duration != mDampingDuration && duration != mDampingDuration * 0.5)
+			updateDampingFactors(duration);
+	}
+
+	void World::updateDampingFactors(Real duration)
+	{
+		auto& b = mBodies;
+		for(unsigned int i = 0; i < b.Handle.size(); i++) {
+			b.DampingFactor[i] = pow(b.Damping[i], duration);
+			b.AngularDampingFactor[i] = pow(b.AngularDamping[i], duration);
+			b.HalfDampingFactor[i] = sqrt(b.DampingFactor[i]);
+			b.HalfAngularDampingFactor[i] = sqrt(b.AngularDampingFactor[i]);
+		}
+		mDampingDuration = duration;
+	}
+
+	void World::integrate(unsigned int begin, unsigned int end, Real duration)
+	{
+		prepareDampingFactors(duration);
+		bool half = duration != mDampingDuration;
+
+		auto& b = mBodies;
+		IntegrationArrays a = {
+			b.PositionX.data(), b.PositionY.data(),
+			b.OrientationX.data(), b.OrientationY.data(),
+			b.VelocityX.data(), b.VelocityY.data(),
+			b.Rotation.data(),
+			b.ForceX.data(), b.ForceY.data(),
+			b.Torque.data(),
+			b.InverseMass.data(), b.InverseInertiaTensor.data(),
+			half ? b.HalfDampingFactor.data() : b.DampingFactor.data(),
+			half ? b.HalfAngularDampingFactor.data() : b.AngularDampingFactor.data()
+		};
+		getIntegrateFunc(mKernel)(a, begin, end, duration);
+	}
+}
+
@@ -1,8 +1,15 @@
 #include "Particle.h"
 
 #include <cassert>
+#include <cmath>
 
 namespace Abyss {
+	// how fast a contact may still close and how deep it may still
+	// penetrate to count as resolved, so that rounding residues and
+	// the slow convergence of contacts sharing particles don't use up
+	// all iterations
+	static const Real ResolvedVelocity = 0.001;
+	static const Real ResolvedPenetration = 0.0001;
 
 	void Particle::integrate(Real time)
 	{
@@ -153,10 +160,18 @@ namespace Abyss {
 
 	void ParticleContact::resolve(Real duration)
 	{
+		particleMovement[0] = Common::Vector2();
+		particleMovement[1] = Common::Vector2();
 		resolveVelocity(duration);
 		resolveInterpenetration(duration);
 	}
 
+	bool ParticleContact::isResolved() const
+	{
+		return calculateSeparatingVelocity() >= -ResolvedVelocity &&
+			penetration <= ResolvedPenetration;
+	}
+
 	Real ParticleContact::calculateSeparatingVelocity() const
 	{
 		assert(particles[0] != nullptr);
@@ -219,16 +234,25 @@ namespace Abyss {
 		if(totInvMass <= 0.0)
 			return;
 
-		Common::Vector2 movePerInvMass = contactNormal * (-penetration / totInvMass);
+		Common::Vector2 movePerInvMass = contactNormal * (penetration / totInvMass);
 
-		particles[0]->position += movePerInvMass * particles[0]->inverseMass;
+		particleMovement[0] = movePerInvMass * particles[0]->inverseMass;
+		particles[0]->position += particleMovement[0];
 		if(particles[1]) {
-			particles[1]->velocity += movePerInvMass * -particles[1]->inverseMass;
+			// opposite direction
+			particleMovement[1] = movePerInvMass * -particles[1]->inverseMass;
+			particles[1]->position += particleMovement[1];
 		}
+
+		// exactly, rather than the rounding residue of subtracting
+		// the movements, which would keep the contact penetrating
+		penetration = 0.0;
 	}
 
 	ParticleContactResolver::ParticleContactResolver(unsigned int iterations)
-		: mIterations(iterations)
+		: mIterations(iterations),
+		mIterationsUsed(0),
+		mContacts(nullptr)
 	{
 	}
 
@@ -237,27 +261,165 @@ namespace Abyss {
 		mIterations = iterations;
 	}
 
+	unsigned int ParticleContactResolver::getIterationsUsed() const
+	{
+		return mIterationsUsed;
+	}
+
 	void ParticleContactResolver::resolveContacts(ParticleContact* contactArray,
 			unsigned int numContacts, Real duration)
 	{
 		mIterationsUsed = 0;
+		if(numContacts == 0)
+			return;
+		mContacts = contactArray;
+		findParticleContacts(numContacts);
+
+		mKeys.resize(numContacts);
+		mHeap.resize(numContacts);
+		mHeapPositions.resize(numContacts);
+		for(unsigned int i = 0; i < numContacts; i++) {
+			mKeys[i] = getKey(contactArray[i]);
+			mHeap[i] = i;
+			mHeapPositions[i] = i;
+		}
+		for(unsigned int i = numContacts / 2; i-- > 0; )
+			siftDown(i);
+
 		while(mIterationsUsed < mIterations) {
-			Real maxV = 0;
-			unsigned int maxIndex = numContacts;
-			for(unsigned int i = 0; i < numContacts; i++) {
-				Real sepVel = contactArray[i].calculateSeparatingVelocity();
-				if(sepVel > maxV) {
-					maxV = sepVel;
-					maxIndex = i;
+			unsigned int index = mHeap[0];
+			if(mKeys[index] == HUGE_VAL)
+				break;
+
+			ParticleContact& contact = contactArray[index];
+			contact.resolve(duration);
+			mIterationsUsed++;
+
+			for(int k = 0; k < 2; k++) {
+				unsigned int p = mContactParticles[index * 2 + k];
+				if(p == (unsigned int)-1)
+					continue;
+				for(unsigned int i = mParticleContactStart[p];
+						i < mParticleContactStart[p + 1]; i++) {
+					if(mParticleContacts[i] != index)
+						updateContact(mParticleContacts[i], contact.particles[k],
+								contact.particleMovement[k]);
 				}
 			}
+			updateKey(index);
+		}
+	}
+
+	// Lists the contacts of each particle: counts them, turns the
+	// counts into where each list ends and fills the lists from the
+	// back, which leaves the starts.
+	void ParticleContactResolver::findParticleContacts(unsigned int numContacts)
+	{
+		mParticleIndex.clear();
+		mParticleContactStart.clear();
+		mContactParticles.resize(numContacts * 2);
+		for(unsigned int i = 0; i < numContacts; i++) {
+			for(int k = 0; k < 2; k++) {
+				Particle* particle = mContacts[i].particles[k];
+				if(!particle) {
+					mContactParticles[i * 2 + k] = -1;
+					continue;
+				}
+				auto ret = mParticleIndex.insert(std::make_pair(particle,
+							(unsigned int)mParticleContactStart.size()));
+				if(ret.second)
+					mParticleContactStart.push_back(0);
+				mContactParticles[i * 2 + k] = ret.first->second;
+				mParticleContactStart[ret.first->second]++;
+			}
+		}
+
+		unsigned int total = 0;
+		for(auto& start : mParticleContactStart) {
+			total += start;
+			start = total;
+		}
+		mParticleContactStart.push_back(total);
+		mParticleContacts.resize(total);
+		for(unsigned int i = numContacts; i-- > 0; ) {
+			for(int k = 0; k < 2; k++) {
+				unsigned int p = mContactParticles[i * 2 + k];
+				if(p != (unsigned int)-1)
+					mParticleContacts[--mParticleContactStart[p]] = i;
+			}
+		}
+	}
+
+	Real ParticleContactResolver::getKey(const ParticleContact& contact) const
+	{
+		if(contact.isResolved())
+			return HUGE_VAL;
+		return contact.calculateSeparatingVelocity();
+	}
+
+	// The lowest separating velocity first, then the lowest index.
+	bool ParticleContactResolver::before(unsigned int a, unsigned int b) const
+	{
+		return mKeys[a] < mKeys[b] || (mKeys[a] == mKeys[b] && a < b);
+	}
 
-			if(maxIndex == numContacts)
+	void ParticleContactResolver::siftUp(unsigned int pos)
+	{
+		unsigned int index = mHeap[pos];
+		while(pos > 0) {
+			unsigned int parent = (pos - 1) / 2;
+			if(!before(index, mHeap[parent]))
 				break;
+			mHeap[pos] = mHeap[parent];
+			mHeapPositions[mHeap[pos]] = pos;
+			pos = parent;
+		}
+		mHeap[pos] = index;
+		mHeapPositions[index] = pos;
+	}
 
-			contactArray[maxIndex].resolve(duration);
-			mIterationsUsed++;
+	void ParticleContactResolver::siftDown(unsigned int pos)
+	{
+		unsigned int index = mHeap[pos];
+		unsigned int size = mHeap.size();
+		while(1) {
+			unsigned int child = pos * 2 + 1;
+			if(child >= size)
+				break;
+			if(child + 1 < size && before(mHeap[child + 1], mHeap[child]))
+				child++;
+			if(!before(mHeap[child], index))
+				break;
+			mHeap[pos] = mHeap[child];
+			mHeapPositions[mHeap[pos]] = pos;
+			pos = child;
 		}
+		mHeap[pos] = index;
+		mHeapPositions[index] = pos;
+	}
+
+	// The particle of the contact was moved and its velocity changed.
+	void ParticleContactResolver::updateContact(unsigned int contact, const Particle* particle,
+			const Common::Vector2& movement)
+	{
+		ParticleContact& c = mContacts[contact];
+		if(c.particles[0] == particle)
+			c.penetration -= movement.dot(c.contactNormal);
+		if(c.particles[1] == particle)
+			c.penetration += movement.dot(c.contactNormal);
+		updateKey(contact);
+	}
+
+	// The separating velocity or penetration of the contact changed.
+	void ParticleContactResolver::updateKey(unsigned int contact)
+	{
+		Real key = getKey(mContacts[contact]);
+		bool up = key < mKeys[contact];
+		mKeys[contact] = key;
+		if(up)
+			siftUp(mHeapPositions[contact]);
+		else
+			siftDown(mHeapPositions[contact]);
 	}
 
 	Real ParticleLink::currentLength() const
@@ -2,6 +2,7 @@
 #define ABYSS_PARTICLE_H
 
 #include <vector>
+#include <unordered_map>
 
 #include "common/Vector2.h"
 
@@ -105,6 +106,8 @@ namespace Abyss {
 	class ParticleContact {
 		public:
 			void resolve(Real duration);
+			// neither closing nor penetrating, within a tolerance
+			bool isResolved() const;
 			Real calculateSeparatingVelocity() const;
 
 			// particles[1] may be nullptr (contact with scenery)
@@ -112,22 +115,56 @@ namespace Abyss {
 			Real restitution;
 			Common::Vector2 contactNormal;
 			Real penetration;
+			// how far resolve() moved the particles
+			Common::Vector2 particleMovement[2];
 
 		private:
 			void resolveVelocity(Real duration);
 			void resolveInterpenetration(Real duration);
 	};
 
+	// Resolves the contact closing the fastest first, or a penetrating
+	// one, up to the given number of times. The contacts are kept in a
+	// heap by separating velocity. Resolving a contact only changes
+	// the particles of that contact, so only the contacts sharing a
+	// particle with it get their separating velocity and penetration
+	// updated, and an iteration costs about the logarithm of the
+	// number of contacts instead of a pass over all of them.
 	class ParticleContactResolver {
 		public:
 			ParticleContactResolver(unsigned int iterations);
 			void setIterations(unsigned int iterations);
 			void resolveContacts(ParticleContact* contactArray,
 					unsigned int numContacts, Real duration);
+			unsigned int getIterationsUsed() const;
 
 		protected:
+			void findParticleContacts(unsigned int numContacts);
+			Real getKey(const ParticleContact& contact) const;
+			bool before(unsigned int a, unsigned int b) const;
+			void siftUp(unsigned int pos);
+			void siftDown(unsigned int pos);
+			void updateContact(unsigned int contact, const Particle* particle,
+					const Common::Vector2& movement);
+			void updateKey(unsigned int contact);
+
 			unsigned int mIterations;
 			unsigned int mIterationsUsed;
+
+			ParticleContact* mContacts;
+			// separating velocity, infinite for contacts with
+			// nothing to resolve
+			std::vector<Real> mKeys;
+			std::vector<unsigned int> mHeap;
+			std::vector<unsigned int> mHeapPositions;
+
+			// the contacts of each particle, from
+			// mParticleContactStart[p] to mParticleContactStart[p + 1]
+			// in mParticleContacts
+			std::unordered_map<Particle*, unsigned int> mParticleIndex;
+			std::vector<unsigned int> mContactParticles; // two per contact
+			std::vector<unsigned int> mParticleContactStart;
+			std::vector<unsigned int> mParticleContacts;
 	};
 
 	class ParticleLink {
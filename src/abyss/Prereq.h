@@ -2,7 +2,13 @@
 #define ABYSS_PREREQ_H
 
 namespace Abyss {
+	// The engine is built in double precision unless
+	// ABYSS_SINGLE_PRECISION is defined.
+#ifdef ABYSS_SINGLE_PRECISION
+	typedef float Real;
+#else
 	typedef double Real;
+#endif
 }
 
 #endif
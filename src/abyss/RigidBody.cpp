@@ -1,4 +1,5 @@
 #include "RigidBody.h"
+#include "ThreadPool.h"
 
 #include <math.h>
 #include <iostream>
@@ -9,11 +10,10 @@
 namespace Abyss {
 	Common::Matrix22 getRotationMatrix(const Common::Vector2& orientation)
 	{
+		// the orientation is a unit vector, i.e. already the cosine
+		// and sine of the angle
 		assert(fabs(orientation.length() - 1.0) < 0.001);
-		Real theta = atan2(orientation.x, orientation.y);
-		Real s = sin(theta);
-		Real c = cos(theta);
-		return Common::Matrix22(c, s, -s, c);
+		return Common::Matrix22(orientation.y, orientation.x, -orientation.x, orientation.y);
 	}
 
 	Common::Vector2 localToWorld(const Common::Vector2& local, const Common::Vector2& pos,
@@ -30,61 +30,105 @@ namespace Abyss {
 		return rotationMatrix.inverse() * world - pos;
 	}
 
-	void RigidBody::addForce(const Common::Vector2& force)
+	RigidBody::RigidBody(World* world)
+		: mWorld(world)
 	{
-		forceAccum += force;
+		mHandle = mWorld->addBody();
 	}
 
-	void RigidBody::addTorque(Real t)
+	RigidBody::~RigidBody()
 	{
-		torqueAccum += t;
+		mWorld->removeBody(mHandle);
 	}
 
 	void RigidBody::integrate(Real duration)
 	{
-		Common::Vector2 lastFrameAcceleration = forceAccum * inverseMass;
-		Real angularAcceleration = torqueAccum * inverseInertiaTensor;
-
-		velocity += lastFrameAcceleration * duration;
-		rotation += angularAcceleration * duration;
-
-		velocity *= pow(damping, duration);
-		rotation *= pow(angularDamping, duration);
-
-		position += velocity * duration;
-		orientation = Common::Math::rotate2D(orientation, rotation * duration);
-
-		calculateDerivedData();
-		clearAccumulators();
+		unsigned int i = getSlot();
+		mWorld->integrate(i, i + 1, duration);
 	}
 
 	bool RigidBody::hasFiniteMass() const
 	{
-		return inverseMass != 0.0;
+		return getInverseMass() != 0.0;
 	}
 
 	Real RigidBody::getMass() const
 	{
-		assert(inverseMass);
-		return 1.0 / inverseMass;
+		assert(getInverseMass());
+		return 1.0 / getInverseMass();
 	}
 
 	void RigidBody::setMass(Real m)
 	{
 		assert(m);
-		inverseMass = 1.0 / m;
+		mWorld->mBodies.InverseMass[getSlot()] = 1.0 / m;
 	}
 
 	void RigidBody::setInertiaTensor(Real i)
 	{
 		assert(i);
-		inverseInertiaTensor = 1.0 / i;
+		mWorld->mBodies.InverseInertiaTensor[getSlot()] = 1.0 / i;
+	}
+
+	Real RigidBody::getInverseInertiaTensor() const
+	{
+		return mWorld->mBodies.InverseInertiaTensor[getSlot()];
+	}
+
+	void RigidBody::setPosition(const Common::Vector2& p)
+	{
+		auto& b = mWorld->mBodies;
+		unsigned int i = getAwakeSlot();
+		b.PositionX[i] = p.x;
+		b.PositionY[i] = p.y;
+	}
+
+	void RigidBody::setOrientation(const Common::Vector2& o)
+	{
+		auto& b = mWorld->mBodies;
+		unsigned int i = getAwakeSlot();
+		b.OrientationX[i] = o.x;
+		b.OrientationY[i] = o.y;
+	}
+
+	void RigidBody::setVelocity(const Common::Vector2& v)
+	{
+		auto& b = mWorld->mBodies;
+		unsigned int i = getAwakeSlot();
+		b.VelocityX[i] = v.x;
+		b.VelocityY[i] = v.y;
+	}
+
+	void RigidBody::setRotation(Real r)
+	{
+		mWorld->mBodies.Rotation[getAwakeSlot()] = r;
+	}
+
+	void RigidBody::setDamping(Real d)
+	{
+		auto& b = mWorld->mBodies;
+		unsigned int i = getSlot();
+		b.Damping[i] = d;
+		b.DampingFactor[i] = pow(d, mWorld->mDampingDuration);
+		b.HalfDampingFactor[i] = sqrt(b.DampingFactor[i]);
+	}
+
+	void RigidBody::setAngularDamping(Real d)
+	{
+		auto& b = mWorld->mBodies;
+		unsigned int i = getSlot();
+		b.AngularDamping[i] = d;
+		b.AngularDampingFactor[i] = pow(d, mWorld->mDampingDuration);
+		b.HalfAngularDampingFactor[i] = sqrt(b.AngularDampingFactor[i]);
 	}
 
 	void RigidBody::clearAccumulators()
 	{
-		forceAccum.zero();
-		torqueAccum = 0.0;
+		auto& b = mWorld->mBodies;
+		unsigned int i = getSlot();
+		b.ForceX[i] = 0.0f;
+		b.ForceY[i] = 0.0f;
+		b.Torque[i] = 0.0;
 	}
 
 	void RigidBody::addForceAtBodyPoint(const Common::Vector2& force, const Common::Vector2& point)
@@ -100,32 +144,30 @@ namespace Abyss {
 		assert(!isnan(worldpoint.x));
 		assert(!isnan(worldpoint.y));
 
-		forceAccum += force;
+		auto& b = mWorld->mBodies;
+		unsigned int i = getAwakeSlot();
+		b.ForceX[i] += force.x;
+		b.ForceY[i] += force.y;
 
-		Common::Vector2 momentArm = worldpoint - position;
+		Common::Vector2 momentArm = worldpoint - Common::Vector2(b.PositionX[i], b.PositionY[i]);
 		Real torque = momentArm.cross2d(force);
 
-		torqueAccum += torque;
-	}
-
-	void RigidBody::calculateDerivedData()
-	{
-		calculateRotationMatrix();
+		b.Torque[i] += torque;
 	}
 
-	void RigidBody::calculateRotationMatrix()
+	Common::Vector2 RigidBody::getPointInWorldSpace(const Common::Vector2& p) const
 	{
-		rotationMatrix = Abyss::getRotationMatrix(orientation);
+		return localToWorld(p, getPosition(), getRotationMatrix());
 	}
 
-	Common::Vector2 RigidBody::getPointInWorldSpace(const Common::Vector2& p) const
+	bool RigidBody::isAwake() const
 	{
-		return localToWorld(p, position, rotationMatrix);
+		return getSlot() < mWorld->mNumAwake;
 	}
 
-	const Common::Matrix22& RigidBody::getRotationMatrix() const
+	void RigidBody::wake()
 	{
-		return rotationMatrix;
+		getAwakeSlot();
 	}
 
 	Gravity::Gravity(const Common::Vector2& gravity)
@@ -185,7 +227,7 @@ namespace Abyss {
 
 	void Drag::updateForce(RigidBody* p, Real duration)
 	{
-		Common::Vector2 force = p->velocity;
+		Common::Vector2 force = p->getVelocity();
 		Real dragCoeff = force.length();
 		dragCoeff = mk1 * dragCoeff + mk2 * dragCoeff * dragCoeff;
 
@@ -222,70 +264,621 @@ namespace Abyss {
 		body->addForceAtPoint(force, lws);
 	}
 
-	void ForceRegistry::add(RigidBody* body, ForceGenerator* fg)
+	void ForceGenerator::updateForces(ForceGenerator* const* generators,
+			RigidBody* const* bodies, unsigned int num, Real duration)
+	{
+		for(unsigned int i = 0; i < num; i++)
+			generators[i]->updateForce(bodies[i], duration);
+	}
+
+	ForceRegistry::ForceGroup::ForceGroup(std::type_index type)
+		: Type(type)
+	{
+	}
+
+	ForceRegistration ForceRegistry::add(RigidBody* body, ForceGenerator* fg)
 	{
+		std::type_index type(typeid(*fg));
+		auto it = std::find_if(groups.begin(), groups.end(),
+				[&] (const ForceGroup& g) { return g.Type == type; });
+		if(it == groups.end()) {
+			groups.push_back(ForceGroup(type));
+			it = groups.end() - 1;
+		}
+
+		unsigned int index;
+		if(freeRegistrations.empty()) {
+			index = registrations.size();
+			registrations.push_back(RegistrationSlot());
+			registrations.back().Generation = 0;
+		} else {
+			index = freeRegistrations.back();
+			freeRegistrations.pop_back();
+		}
+		auto& slot = registrations[index];
+		slot.Group = it - groups.begin();
+		slot.Position = it->Bodies.size();
+		slot.Live = true;
+
+		it->Bodies.push_back(body);
+		it->Generators.push_back(fg);
+		it->Registrations.push_back(index);
+		version++;
+
 		ForceRegistration reg;
-		reg.body = body;
-		reg.fg = fg;
-		registrations.push_back(reg);
+		reg.Index = index;
+		reg.Generation = slot.Generation;
+		return reg;
+	}
+
+	void ForceRegistry::remove(const ForceRegistration& reg)
+	{
+		if(reg.Index >= registrations.size())
+			return;
+		auto& slot = registrations[reg.Index];
+		if(!slot.Live || slot.Generation != reg.Generation)
+			return;
+
+		// leave a hole so that the order of the others stays the same
+		auto& g = groups[slot.Group];
+		g.Bodies[slot.Position] = nullptr;
+		g.Generators[slot.Position] = nullptr;
+		slot.Live = false;
+		slot.Generation++;
+		freeRegistrations.push_back(reg.Index);
+		numRemoved++;
+		version++;
 	}
 
-	void ForceRegistry::remove(RigidBody* body, ForceGenerator* fg)
+	void ForceRegistry::clear()
 	{
-		for(auto it = registrations.begin(); it != registrations.end(); ++it) {
-			if(it->body == body &&
-					it->fg == fg) {
-				registrations.erase(it);
-				return;
+		groups.clear();
+		freeRegistrations.clear();
+		for(unsigned int i = 0; i < registrations.size(); i++) {
+			auto& slot = registrations[i];
+			if(slot.Live) {
+				slot.Live = false;
+				slot.Generation++;
 			}
+			freeRegistrations.push_back(i);
 		}
+		numRemoved = 0;
+		version++;
 	}
 
-	void ForceRegistry::clear()
+	// Closes the holes left by removed registrations.
+	void ForceRegistry::compact()
 	{
-		registrations.clear();
+		if(!numRemoved)
+			return;
+		for(auto& g : groups) {
+			unsigned int k = 0;
+			for(unsigned int i = 0; i < g.Generators.size(); i++) {
+				if(!g.Generators[i])
+					continue;
+				g.Bodies[k] = g.Bodies[i];
+				g.Generators[k] = g.Generators[i];
+				g.Registrations[k] = g.Registrations[i];
+				registrations[g.Registrations[k]].Position = k;
+				k++;
+			}
+			g.Bodies.resize(k);
+			g.Generators.resize(k);
+			g.Registrations.resize(k);
+		}
+		numRemoved = 0;
 	}
 
 	void ForceRegistry::updateForces(Real duration)
 	{
-		for(auto& reg : registrations) {
-			reg.fg->updateForce(reg.body, duration);
+		compact();
+		for(auto& g : groups) {
+			if(!g.Bodies.empty())
+				g.Generators[0]->updateForces(g.Generators.data(), g.Bodies.data(),
+						g.Bodies.size(), duration);
+		}
+	}
+
+	World::World()
+		: mNumAwake(0),
+		mDampingDuration(0.0),
+		mKernel(IntegrationKernel::Scalar),
+		mThreadPool(nullptr),
+		mSleepLinearVelocity(0.0),
+		mSleepAngularVelocity(0.0),
+		mSleepTime(0.0),
+		mAwakeForceGroupsDirty(true),
+		mAwakeForceGroupsVersion(0),
+		mTolerance(0.0),
+		mMaxSubsteps(1),
+		mSubstep(0.0)
+	{
+		for(auto k : { IntegrationKernel::SSE2, IntegrationKernel::AVX2 }) {
+			if(integrationKernelSupported(k))
+				mKernel = k;
 		}
 	}
 
+	World::~World()
+	{
+		delete mThreadPool;
+	}
+
+	void World::setNumThreads(unsigned int numThreads)
+	{
+		assert(numThreads > 0);
+		delete mThreadPool;
+		mThreadPool = numThreads > 1 ? new ThreadPool(numThreads) : nullptr;
+	}
+
+	unsigned int World::getNumThreads() const
+	{
+		return mThreadPool ? mThreadPool->getNumThreads() : 1;
+	}
+
 	ForceRegistry* World::getForceRegistry()
 	{
 		return &mRegistry;
 	}
 
-	void World::addBody(RigidBody* b)
+	unsigned int World::getNumBodies() const
 	{
-		mBodyRegistration.push_back(b);
+		return mBodies.Handle.size();
 	}
 
-	void World::removeBody(RigidBody* b)
+	unsigned int World::addBody()
 	{
-		mBodyRegistration.erase(std::remove(mBodyRegistration.begin(),
-					mBodyRegistration.end(), b),
-				mBodyRegistration.end());
+		unsigned int handle;
+		if(mFreeHandles.empty()) {
+			handle = mSlots.size();
+			mSlots.push_back(0);
+		} else {
+			handle = mFreeHandles.back();
+			mFreeHandles.pop_back();
+		}
+
+		auto& b = mBodies;
+		mSlots[handle] = b.Handle.size();
+		b.PositionX.push_back(0.0f);
+		b.PositionY.push_back(0.0f);
+		b.OrientationX.push_back(1.0f);
+		b.OrientationY.push_back(0.0f);
+		b.VelocityX.push_back(0.0f);
+		b.VelocityY.push_back(0.0f);
+		b.Rotation.push_back(0.0);
+		b.ForceX.push_back(0.0f);
+		b.ForceY.push_back(0.0f);
+		b.Torque.push_back(0.0);
+		b.InverseMass.push_back(0.0);
+		b.InverseInertiaTensor.push_back(0.0);
+		b.Damping.push_back(1.0);
+		b.AngularDamping.push_back(1.0);
+		b.DampingFactor.push_back(1.0);
+		b.AngularDampingFactor.push_back(1.0);
+		b.HalfDampingFactor.push_back(1.0);
+		b.HalfAngularDampingFactor.push_back(1.0);
+		b.SleepTime.push_back(0.0);
+		b.Handle.push_back(handle);
+
+		// new bodies are awake
+		swapSlots(b.Handle.size() - 1, mNumAwake);
+		mNumAwake++;
+		mAwakeForceGroupsDirty = true;
+		return handle;
+	}
+
+	template<typename T>
+	static void moveLast(std::vector<T>& v, unsigned int slot)
+	{
+		v[slot] = v.back();
+		v.pop_back();
+	}
+
+	void World::removeBody(unsigned int handle)
+	{
+		auto& b = mBodies;
+		unsigned int slot = mSlots[handle];
+		if(slot < mNumAwake) {
+			// keep the awake bodies first
+			mNumAwake--;
+			swapSlots(slot, mNumAwake);
+			slot = mNumAwake;
+		}
+		mAwakeForceGroupsDirty = true;
+		moveLast(b.PositionX, slot);
+		moveLast(b.PositionY, slot);
+		moveLast(b.OrientationX, slot);
+		moveLast(b.OrientationY, slot);
+		moveLast(b.VelocityX, slot);
+		moveLast(b.VelocityY, slot);
+		moveLast(b.Rotation, slot);
+		moveLast(b.ForceX, slot);
+		moveLast(b.ForceY, slot);
+		moveLast(b.Torque, slot);
+		moveLast(b.InverseMass, slot);
+		moveLast(b.InverseInertiaTensor, slot);
+		moveLast(b.Damping, slot);
+		moveLast(b.AngularDamping, slot);
+		moveLast(b.DampingFactor, slot);
+		moveLast(b.AngularDampingFactor, slot);
+		moveLast(b.HalfDampingFactor, slot);
+		moveLast(b.HalfAngularDampingFactor, slot);
+		moveLast(b.SleepTime, slot);
+		moveLast(b.Handle, slot);
+		if(slot < b.Handle.size())
+			mSlots[b.Handle[slot]] = slot;
+		mFreeHandles.push_back(handle);
+	}
+
+	void World::clearAccumulators(unsigned int begin, unsigned int end)
+	{
+		auto& b = mBodies;
+		std::fill(b.ForceX.begin() + begin, b.ForceX.begin() + end, 0.0f);
+		std::fill(b.ForceY.begin() + begin, b.ForceY.begin() + end, 0.0f);
+		std::fill(b.Torque.begin() + begin, b.Torque.begin() + end, 0.0);
 	}
 
 	void World::startFrame()
 	{
-		for(auto& b : mBodyRegistration) {
-			b->clearAccumulators();
-			b->calculateDerivedData();
+		unsigned int numBodies = mNumAwake;
+		if(!mThreadPool) {
+			clearAccumulators(0, numBodies);
+			return;
+		}
+
+		unsigned int numJobs = (numBodies + JobSize - 1) / JobSize;
+		mThreadPool->run(numJobs, [&] (unsigned int job) {
+			unsigned int begin = job * JobSize;
+			unsigned int end = std::min(numBodies, begin + JobSize);
+			clearAccumulators(begin, end);
+		});
+	}
+
+	// Sorts the registrations of each force group by the job their
+	// body belongs to, keeping the registration order within each job.
+	// Registrations of sleeping bodies are left out.
+	void World::partitionRegistrations(unsigned int numJobs)
+	{
+		const auto& groups = mRegistry.groups;
+		mJobForceGroups.resize(groups.size());
+		for(unsigned int g = 0; g < groups.size(); g++) {
+			const auto& group = groups[g];
+			auto& jg = mJobForceGroups[g];
+			jg.JobStart.assign(numJobs + 1, 0);
+			for(auto body : group.Bodies) {
+				unsigned int slot = mSlots[body->mHandle];
+				if(slot < mNumAwake)
+					jg.JobStart[slot / JobSize + 1]++;
+			}
+			for(unsigned int j = 0; j < numJobs; j++)
+				jg.JobStart[j + 1] += jg.JobStart[j];
+
+			std::vector<unsigned int> next(jg.JobStart.begin(), jg.JobStart.end() - 1);
+			jg.Bodies.resize(jg.JobStart[numJobs]);
+			jg.Generators.resize(jg.JobStart[numJobs]);
+			for(unsigned int i = 0; i < group.Bodies.size(); i++) {
+				unsigned int slot = mSlots[group.Bodies[i]->mHandle];
+				if(slot >= mNumAwake)
+					continue;
+				unsigned int k = next[slot / JobSize]++;
+				jg.Bodies[k] = group.Bodies[i];
+				jg.Generators[k] = group.Generators[i];
+			}
 		}
 	}
 
 	void World::runPhysics(Real duration)
 	{
-		mRegistry.updateForces(duration);
+		mSteppingStats.Frames++;
+		if(mTolerance > 0.0) {
+			runAdaptive(duration);
+		} else {
+			step(duration);
+			mSteppingStats.Substeps++;
+		}
+		if(mSleepTime > 0.0)
+			updateSleeping(duration);
+	}
+
+	void World::step(Real duration)
+	{
+		mRegistry.compact();
+		unsigned int numBodies = mNumAwake;
+		if(!mThreadPool) {
+			updateForces(duration);
+			integrate(0, numBodies, duration);
+			return;
+		}
+
+		// Each job updates the forces of a block of bodies and later
+		// integrates them. The forces of a body are added in the same
+		// order as by ForceRegistry::updateForces() and the integration
+		// kernels don't depend on the block boundaries, so every body
+		// goes through exactly the same operations as on the serial
+		// path.
+		unsigned int numJobs = (numBodies + JobSize - 1) / JobSize;
+		partitionRegistrations(numJobs);
+		mThreadPool->run(numJobs, [&] (unsigned int job) {
+			for(auto& jg : mJobForceGroups) {
+				unsigned int start = jg.JobStart[job];
+				unsigned int num = jg.JobStart[job + 1] - start;
+				if(num)
+					jg.Generators[start]->updateForces(jg.Generators.data() + start,
+							jg.Bodies.data() + start, num, duration);
+			}
+		});
+
+		// all forces must be in before any body moves as generators
+		// may look at other bodies
+		prepareDampingFactors(duration);
+		mThreadPool->run(numJobs, [&] (unsigned int job) {
+			unsigned int begin = job * JobSize;
+			integrate(begin, std::min(numBodies, begin + JobSize), duration);
+		});
+	}
+
+	void World::setAdaptiveStepping(Real tolerance, unsigned int maxSubsteps)
+	{
+		assert(tolerance >= 0.0 && maxSubsteps > 0);
+		mTolerance = tolerance;
+		mMaxSubsteps = maxSubsteps;
+		mSubstep = 0.0;
+	}
+
+	const World::SteppingStats& World::getSteppingStats() const
+	{
+		return mSteppingStats;
+	}
+
+	void World::resetSteppingStats()
+	{
+		mSteppingStats = SteppingStats();
+	}
+
+	void World::saveState(StepState& s) const
+	{
+		const auto& b = mBodies;
+		s.PositionX = b.PositionX;
+		s.PositionY = b.PositionY;
+		s.OrientationX = b.OrientationX;
+		s.OrientationY = b.OrientationY;
+		s.VelocityX = b.VelocityX;
+		s.VelocityY = b.VelocityY;
+		s.Rotation = b.Rotation;
+		s.ForceX = b.ForceX;
+		s.ForceY = b.ForceY;
+		s.Torque = b.Torque;
+	}
+
+	void World::restoreState(const StepState& s)
+	{
+		auto& b = mBodies;
+		b.PositionX = s.PositionX;
+		b.PositionY = s.PositionY;
+		b.OrientationX = s.OrientationX;
+		b.OrientationY = s.OrientationY;
+		b.VelocityX = s.VelocityX;
+		b.VelocityY = s.VelocityY;
+		b.Rotation = s.Rotation;
+	}
+
+	void World::restoreForces(const StepState& s)
+	{
+		auto& b = mBodies;
+		b.ForceX = s.ForceX;
+		b.ForceY = s.ForceY;
+		b.Torque = s.Torque;
+	}
 
-		for(auto& b : mBodyRegistration) {
-			b->integrate(duration);
+	// Richardson extrapolation from a whole step to the two halves
+	// in the store, which cancels the first order error term.
+	void World::extrapolate(const StepState& full)
+	{
+		auto& b = mBodies;
+		for(unsigned int i = 0; i < mNumAwake; i++) {
+			b.PositionX[i] = 2.0 * b.PositionX[i] - full.PositionX[i];
+			b.PositionY[i] = 2.0 * b.PositionY[i] - full.PositionY[i];
+			b.VelocityX[i] = 2.0 * b.VelocityX[i] - full.VelocityX[i];
+			b.VelocityY[i] = 2.0 * b.VelocityY[i] - full.VelocityY[i];
+			b.Rotation[i] = 2.0 * b.Rotation[i] - full.Rotation[i];
+			Common::Vector2 o(2.0 * b.OrientationX[i] - full.OrientationX[i],
+					2.0 * b.OrientationY[i] - full.OrientationY[i]);
+			o.normalize();
+			b.OrientationX[i] = o.x;
+			b.OrientationY[i] = o.y;
 		}
 	}
 
+	// Step doubling: each substep is taken once whole and once as two
+	// halves. The difference between the two estimates the error of
+	// the halves. If it is within the tolerance the substep is kept,
+	// extrapolated from both. The integrator is first order, so the
+	// local error grows with the square of the step and the next size
+	// is scaled by the square root of tolerance / error.
+	void World::runAdaptive(Real duration)
+	{
+		unsigned int numBodies = mNumAwake;
+		// forces added before runPhysics() apply to every substep
+		saveState(mFrameStart);
+
+		Real minStep = duration / mMaxSubsteps;
+		Real h = mSubstep > 0.0 ? mSubstep : duration;
+		Real remaining = duration;
+		bool retry = false;
+		while(remaining > 0.0) {
+			h = std::min(std::max(h, minStep), remaining);
+			// don't leave a sliver at the end of the frame, unless
+			// that would undo the shrinking of a rejected step
+			if(!retry && remaining - h < minStep)
+				h = remaining;
+			// a step this small is taken whatever the error
+			bool smallest = h < minStep * 2.0;
+
+			saveState(mStepStart);
+			restoreForces(mFrameStart);
+			step(h);
+			saveState(mFullStep);
+
+			restoreState(mStepStart);
+			for(int i = 0; i < 2; i++) {
+				restoreForces(mFrameStart);
+				step(h * 0.5);
+			}
+
+			const auto& b = mBodies;
+			Real error = 0.0;
+			for(unsigned int i = 0; i < numBodies; i++) {
+				Real dp = hypot(b.PositionX[i] - mFullStep.PositionX[i],
+						b.PositionY[i] - mFullStep.PositionY[i]);
+				Real dor = hypot(b.OrientationX[i] - mFullStep.OrientationX[i],
+						b.OrientationY[i] - mFullStep.OrientationY[i]);
+				error = std::max(error, std::max(dp, dor));
+			}
+
+			Real scale = error > 0.0 ? 0.9 * sqrt(mTolerance / error) : 2.0;
+			scale = std::min<Real>(2.0, std::max<Real>(0.2, scale));
+			if(error <= mTolerance || smallest) {
+				mSteppingStats.Substeps++;
+				extrapolate(mFullStep);
+				mSubstep = h * scale;
+				remaining = h == remaining ? 0.0 : remaining - h;
+				h = mSubstep;
+				retry = false;
+			} else {
+				mSteppingStats.Rejected++;
+				restoreState(mStepStart);
+				h *= scale;
+				retry = true;
+			}
+		}
+	}
+
+	// Updates the forces of the awake bodies in the same order as
+	// ForceRegistry::updateForces().
+	void World::updateForces(Real duration)
+	{
+		if(mNumAwake == mBodies.Handle.size()) {
+			mRegistry.updateForces(duration);
+			return;
+		}
+
+		if(mAwakeForceGroupsDirty || mAwakeForceGroupsVersion != mRegistry.version) {
+			const auto& groups = mRegistry.groups;
+			mAwakeForceGroups.resize(groups.size());
+			for(unsigned int g = 0; g < groups.size(); g++) {
+				auto& ag = mAwakeForceGroups[g];
+				ag.Bodies.clear();
+				ag.Generators.clear();
+				for(unsigned int i = 0; i < groups[g].Bodies.size(); i++) {
+					if(mSlots[groups[g].Bodies[i]->mHandle] < mNumAwake) {
+						ag.Bodies.push_back(groups[g].Bodies[i]);
+						ag.Generators.push_back(groups[g].Generators[i]);
+					}
+				}
+			}
+			mAwakeForceGroupsDirty = false;
+			mAwakeForceGroupsVersion = mRegistry.version;
+		}
+
+		for(auto& ag : mAwakeForceGroups) {
+			if(!ag.Bodies.empty())
+				ag.Generators[0]->updateForces(ag.Generators.data(), ag.Bodies.data(),
+						ag.Bodies.size(), duration);
+		}
+	}
+
+	void World::setSleeping(Real linearVelocity, Real angularVelocity, Real sleepTime)
+	{
+		assert(linearVelocity >= 0.0 && angularVelocity >= 0.0 && sleepTime >= 0.0);
+		mSleepLinearVelocity = linearVelocity;
+		mSleepAngularVelocity = angularVelocity;
+		mSleepTime = sleepTime;
+		if(sleepTime == 0.0) {
+			while(mNumAwake < mBodies.Handle.size())
+				wakeBody(mNumAwake);
+		}
+	}
+
+	unsigned int World::getNumAwakeBodies() const
+	{
+		return mNumAwake;
+	}
+
+	void World::updateSleeping(Real duration)
+	{
+		auto& b = mBodies;
+		Real maxSpeedSquared = mSleepLinearVelocity * mSleepLinearVelocity;
+		unsigned int i = 0;
+		while(i < mNumAwake) {
+			Real speedSquared = b.VelocityX[i] * b.VelocityX[i] + b.VelocityY[i] * b.VelocityY[i];
+			if(speedSquared > maxSpeedSquared || fabs(b.Rotation[i]) > mSleepAngularVelocity) {
+				b.SleepTime[i] = 0.0;
+			} else {
+				b.SleepTime[i] += duration;
+				if(b.SleepTime[i] >= mSleepTime) {
+					// the last awake body moves to this slot
+					sleepBody(i);
+					continue;
+				}
+			}
+			i++;
+		}
+	}
+
+	void World::sleepBody(unsigned int slot)
+	{
+		auto& b = mBodies;
+		b.VelocityX[slot] = 0.0f;
+		b.VelocityY[slot] = 0.0f;
+		b.Rotation[slot] = 0.0;
+		mNumAwake--;
+		swapSlots(slot, mNumAwake);
+		mAwakeForceGroupsDirty = true;
+	}
+
+	// Returns the new slot of the body.
+	unsigned int World::wakeBody(unsigned int slot)
+	{
+		assert(slot >= mNumAwake);
+		mBodies.SleepTime[slot] = 0.0;
+		swapSlots(slot, mNumAwake);
+		mAwakeForceGroupsDirty = true;
+		return mNumAwake++;
+	}
+
+	template<typename T>
+	static void swapElements(std::vector<T>& v, unsigned int a, unsigned int b)
+	{
+		std::swap(v[a], v[b]);
+	}
+
+	void World::swapSlots(unsigned int s1, unsigned int s2)
+	{
+		if(s1 == s2)
+			return;
+		auto& b = mBodies;
+		swapElements(b.PositionX, s1, s2);
+		swapElements(b.PositionY, s1, s2);
+		swapElements(b.OrientationX, s1, s2);
+		swapElements(b.OrientationY, s1, s2);
+		swapElements(b.VelocityX, s1, s2);
+		swapElements(b.VelocityY, s1, s2);
+		swapElements(b.Rotation, s1, s2);
+		swapElements(b.ForceX, s1, s2);
+		swapElements(b.ForceY, s1, s2);
+		swapElements(b.Torque, s1, s2);
+		swapElements(b.InverseMass, s1, s2);
+		swapElements(b.InverseInertiaTensor, s1, s2);
+		swapElements(b.Damping, s1, s2);
+		swapElements(b.AngularDamping, s1, s2);
+		swapElements(b.DampingFactor, s1, s2);
+		swapElements(b.AngularDampingFactor, s1, s2);
+		swapElements(b.HalfDampingFactor, s1, s2);
+		swapElements(b.HalfAngularDampingFactor, s1, s2);
+		swapElements(b.SleepTime, s1, s2);
+		swapElements(b.Handle, s1, s2);
+		mSlots[b.Handle[s1]] = s1;
+		mSlots[b.Handle[s2]] = s2;
+	}
 }
 
@@ -1,9 +1,10 @@
 #ifndef ABYSS_RIGIDBODY_H
 #define ABYSS_RIGIDBODY_H
 
-#include <list>
 #include <vector>
 #include <cassert>
+#include <typeinfo>
+#include <typeindex>
 
 #include "common/Vector2.h"
 #include "common/Matrix22.h"
@@ -17,8 +18,31 @@ namespace Abyss {
 	Common::Vector2 worldToLocal(const Common::Vector2& world, const Common::Vector2& pos,
 			const Common::Matrix22& rotationMatrix);
 
+	class World;
+	class ThreadPool;
+
+	// Kernels World integrates the bodies with. All of them give
+	// bitwise the same results, Scalar is the reference.
+	enum class IntegrationKernel {
+		Scalar,
+		SSE2,
+		AVX2
+	};
+
+	bool integrationKernelSupported(IntegrationKernel k);
+	const char* integrationKernelName(IntegrationKernel k);
+
+	// A rigid body in a World. The state of the body lives in the
+	// world's body store, RigidBody is a handle to it. The body is
+	// added to the world on construction and removed on destruction,
+	// so the world must outlive it.
 	class RigidBody {
 		public:
+			RigidBody(World* world);
+			~RigidBody();
+			RigidBody(const RigidBody&) = delete;
+			RigidBody& operator=(const RigidBody&) = delete;
+
 			void addForce(const Common::Vector2& force);
 			void addForceAtBodyPoint(const Common::Vector2& force, const Common::Vector2& point);
 			void addForceAtPoint(const Common::Vector2& force, const Common::Vector2& worldpoint);
@@ -28,41 +52,74 @@ namespace Abyss {
 			bool hasFiniteMass() const;
 			Real getMass() const;
 			void setMass(Real m);
+			Real getInverseMass() const;
 			void setInertiaTensor(Real i);
+			Real getInverseInertiaTensor() const;
+
+			Common::Vector2 getPosition() const;
+			void setPosition(const Common::Vector2& p);
+			Common::Vector2 getOrientation() const;
+			void setOrientation(const Common::Vector2& o);
+			Common::Vector2 getVelocity() const;
+			void setVelocity(const Common::Vector2& v);
+			Real getRotation() const;
+			void setRotation(Real r);
+			void setDamping(Real d);
+			void setAngularDamping(Real d);
 
 			Common::Vector2 getPointInWorldSpace(const Common::Vector2& p) const;
-			const Common::Matrix22& getRotationMatrix() const;
-			void calculateDerivedData();
+			Common::Matrix22 getRotationMatrix() const;
 			void clearAccumulators();
 
-			Real inverseMass = 0.0;
-			Real inverseInertiaTensor = 0.0;
-			Common::Vector2 position;
-			Common::Vector2 orientation = Common::Vector2(1.0, 0.0);
-
-			Common::Vector2 velocity;
-			Real rotation = 0.0;
-
-			Common::Vector2 forceAccum;
-			Real torqueAccum = 0.0;
-			Real damping = 1.0;
-			Real angularDamping = 1.0;
-
+			// Sleeping bodies are skipped by the world until they are
+			// woken up by adding a force, setting their state or
+			// calling wake().
+			bool isAwake() const;
+			void wake();
 
 		private:
-			void calculateRotationMatrix();
+			friend class World;
+
+			unsigned int getSlot() const;
+			unsigned int getAwakeSlot();
 
-			// derived
-			Common::Matrix22 rotationMatrix;
+			World* mWorld;
+			unsigned int mHandle;
 	};
 
 	class ForceGenerator {
 		public:
 			virtual ~ForceGenerator() { }
 			virtual void updateForce(RigidBody* body, Real duration) = 0;
+
+			// Updates num registrations of generators that are all of
+			// the same type as this one. The registry calls this once
+			// per generator type; by default it calls updateForce()
+			// for each registration.
+			virtual void updateForces(ForceGenerator* const* generators,
+					RigidBody* const* bodies, unsigned int num, Real duration);
 	};
 
-	class Gravity : public ForceGenerator {
+	// Base for force generators of type T whose registrations are
+	// updated in a loop without virtual calls.
+	template<typename T>
+	class BatchedForceGenerator : public ForceGenerator {
+		public:
+			virtual void updateForces(ForceGenerator* const* generators,
+					RigidBody* const* bodies, unsigned int num, Real duration) override
+			{
+				// a class derived from T may have its own updateForce()
+				if(typeid(*generators[0]) != typeid(T)) {
+					ForceGenerator::updateForces(generators, bodies, num, duration);
+					return;
+				}
+
+				for(unsigned int i = 0; i < num; i++)
+					static_cast<T*>(generators[i])->T::updateForce(bodies[i], duration);
+			}
+	};
+
+	class Gravity : public BatchedForceGenerator<Gravity> {
 		public:
 			Gravity(const Common::Vector2& gravity);
 			virtual void updateForce(RigidBody* body, Real duration) override;
@@ -71,7 +128,7 @@ namespace Abyss {
 			Common::Vector2 mGravity;
 	};
 
-	class Buoyancy : public ForceGenerator {
+	class Buoyancy : public BatchedForceGenerator<Buoyancy> {
 		public:
 			Buoyancy(const Common::Vector2& center,
 					Real maxDepth,       // depth of the body
@@ -88,7 +145,7 @@ namespace Abyss {
 			Real mLiquidDensity;
 	};
 
-	class Drag : public ForceGenerator {
+	class Drag : public BatchedForceGenerator<Drag> {
 		public:
 			Drag(Real k1, Real k2);
 			virtual void updateForce(RigidBody* p, Real duration) override;
@@ -98,7 +155,7 @@ namespace Abyss {
 			Real mk2;
 	};
 
-	class Spring : public ForceGenerator {
+	class Spring : public BatchedForceGenerator<Spring> {
 		public:
 			Spring(const Common::Vector2& localConnectionPoint,
 					RigidBody* other,
@@ -115,34 +172,271 @@ namespace Abyss {
 			Real mRestLength;
 	};
 
+	// Identifies a registration in a ForceRegistry.
+	struct ForceRegistration {
+		unsigned int Index = ~0u;
+		unsigned int Generation = 0;
+	};
+
+	// Registrations are grouped by the type of the generator and each
+	// group is updated with one updateForces() call. The groups are
+	// updated in the order their type was first added, and within a
+	// group the registrations are in the order they were added.
 	class ForceRegistry {
 		protected:
-			struct ForceRegistration {
-				RigidBody* body;
-				ForceGenerator* fg;
+			friend class World;
+
+			struct ForceGroup {
+				ForceGroup(std::type_index type);
+
+				std::type_index Type;
+				std::vector<RigidBody*> Bodies;
+				std::vector<ForceGenerator*> Generators; // nullptr if removed
+				std::vector<unsigned int> Registrations;
 			};
 
-			std::vector<ForceRegistration> registrations;
+			// where each registration is in the groups
+			struct RegistrationSlot {
+				unsigned int Group;
+				unsigned int Position;
+				unsigned int Generation;
+				bool Live;
+			};
+
+			std::vector<ForceGroup> groups;
+			unsigned int version = 0; // changed by every add or removal
+			std::vector<RegistrationSlot> registrations;
+			std::vector<unsigned int> freeRegistrations;
+			unsigned int numRemoved = 0; // still in the groups
+
+			void compact();
 
 		public:
-			void add(RigidBody* body, ForceGenerator* fg);
-			void remove(RigidBody* body, ForceGenerator* fg);
+			// Adding and removing is O(1). Removed registrations
+			// are dropped from the groups on the next update.
+			// Removing a registration that was already removed, also
+			// by clear(), does nothing.
+			ForceRegistration add(RigidBody* body, ForceGenerator* fg);
+			void remove(const ForceRegistration& reg);
 			void clear();
 			void updateForces(Real duration);
 	};
 
 	class World {
 		public:
+			World();
+			~World();
+			World(const World&) = delete;
+			World& operator=(const World&) = delete;
 			void startFrame();
 			void runPhysics(Real duration);
-			void addBody(RigidBody* b);
-			void removeBody(RigidBody* b);
 			ForceRegistry* getForceRegistry();
+			unsigned int getNumBodies() const;
+
+			// defaults to the fastest kernel the CPU supports
+			void setIntegrationKernel(IntegrationKernel k);
+			IntegrationKernel getIntegrationKernel() const;
+
+			// Steps the world on numThreads threads, 1 (the default)
+			// steps it on the calling thread. The results are the
+			// same whatever the thread count. With more than one
+			// thread the force generators run concurrently and may
+			// only add forces to the body they're updating.
+			void setNumThreads(unsigned int numThreads);
+			unsigned int getNumThreads() const;
+
+			// Error controlled stepping. With a tolerance above 0,
+			// runPhysics() splits the duration into substeps sized
+			// by step doubling so that the estimated error of each
+			// substep in position (m) and orientation (rad) stays
+			// within the tolerance, taking at most about maxSubsteps
+			// substeps. The force generators run three times per
+			// substep. A tolerance of 0 (the default) steps the
+			// whole duration at once.
+			void setAdaptiveStepping(Real tolerance, unsigned int maxSubsteps = 64);
+
+			struct SteppingStats {
+				unsigned long Frames = 0;   // runPhysics() calls
+				unsigned long Substeps = 0; // accepted substeps
+				unsigned long Rejected = 0; // substeps retried smaller
+			};
+			const SteppingStats& getSteppingStats() const;
+			void resetSteppingStats();
+
+			// Bodies whose velocity and rotation stay below the given
+			// limits for sleepTime seconds are put to sleep: their
+			// velocity is zeroed and their force generators and
+			// integration are skipped. A sleepTime of 0 (the default)
+			// keeps all bodies awake. Force generators that act on
+			// another body, like Spring, don't wake it.
+			void setSleeping(Real linearVelocity, Real angularVelocity, Real sleepTime);
+			unsigned int getNumAwakeBodies() const;
 
 		private:
-			std::list<RigidBody*> mBodyRegistration;
+			friend class RigidBody;
+
+			unsigned int addBody();
+			void removeBody(unsigned int handle);
+			void integrate(unsigned int begin, unsigned int end, Real duration);
+			void prepareDampingFactors(Real duration);
+			void updateDampingFactors(Real duration);
+			void clearAccumulators(unsigned int begin, unsigned int end);
+			void partitionRegistrations(unsigned int numJobs);
+			void step(Real duration);
+			void runAdaptive(Real duration);
+			void updateForces(Real duration);
+			void updateSleeping(Real duration);
+			void sleepBody(unsigned int slot);
+			unsigned int wakeBody(unsigned int slot);
+			void swapSlots(unsigned int a, unsigned int b);
+
+			// bodies per job when stepping on several threads
+			static const unsigned int JobSize = 256;
+
+			// Body state as a structure of arrays indexed by slot.
+			// The slots are kept dense: when a body is removed, the
+			// last body moves to its slot. Handles stay the same.
+			// The awake bodies come first, in [0, mNumAwake).
+			struct BodyStore {
+				std::vector<float> PositionX;
+				std::vector<float> PositionY;
+				std::vector<float> OrientationX;
+				std::vector<float> OrientationY;
+				std::vector<float> VelocityX;
+				std::vector<float> VelocityY;
+				std::vector<Real> Rotation;
+				std::vector<float> ForceX;
+				std::vector<float> ForceY;
+				std::vector<Real> Torque;
+				std::vector<Real> InverseMass;
+				std::vector<Real> InverseInertiaTensor;
+				std::vector<Real> Damping;
+				std::vector<Real> AngularDamping;
+				std::vector<Real> DampingFactor;        // Damping ^ mDampingDuration
+				std::vector<Real> AngularDampingFactor; // AngularDamping ^ mDampingDuration
+				// the same for half of mDampingDuration, for the
+				// half steps of the adaptive stepping
+				std::vector<Real> HalfDampingFactor;
+				std::vector<Real> HalfAngularDampingFactor;
+				std::vector<Real> SleepTime; // time spent below the sleep limits
+				std::vector<unsigned int> Handle;
+			} mBodies;
+			unsigned int mNumAwake;
+
+			std::vector<unsigned int> mSlots; // slot of each handle
+			std::vector<unsigned int> mFreeHandles;
 			ForceRegistry mRegistry;
+			Real mDampingDuration;
+			IntegrationKernel mKernel;
+
+			ThreadPool* mThreadPool;
+			// registrations of each force group sorted by the job of
+			// their body
+			struct JobForceGroup {
+				std::vector<RigidBody*> Bodies;
+				std::vector<ForceGenerator*> Generators;
+				std::vector<unsigned int> JobStart;
+			};
+			std::vector<JobForceGroup> mJobForceGroups;
+
+			Real mSleepLinearVelocity;
+			Real mSleepAngularVelocity;
+			Real mSleepTime;
+			// registrations of the awake bodies, rebuilt when bodies
+			// fall asleep or wake up or the registry changes
+			std::vector<JobForceGroup> mAwakeForceGroups;
+			bool mAwakeForceGroupsDirty;
+			unsigned int mAwakeForceGroupsVersion;
+
+			// The state that changes in a step, saved while trying
+			// out substeps.
+			struct StepState {
+				std::vector<float> PositionX;
+				std::vector<float> PositionY;
+				std::vector<float> OrientationX;
+				std::vector<float> OrientationY;
+				std::vector<float> VelocityX;
+				std::vector<float> VelocityY;
+				std::vector<Real> Rotation;
+				std::vector<float> ForceX;
+				std::vector<float> ForceY;
+				std::vector<Real> Torque;
+			};
+			void saveState(StepState& s) const;
+			void restoreState(const StepState& s);
+			void restoreForces(const StepState& s);
+			void extrapolate(const StepState& full);
+
+			Real mTolerance;
+			unsigned int mMaxSubsteps;
+			Real mSubstep; // size of the last accepted substep
+			SteppingStats mSteppingStats;
+			StepState mFrameStart;
+			StepState mStepStart;
+			StepState mFullStep;
 	};
+
+	inline unsigned int RigidBody::getSlot() const
+	{
+		return mWorld->mSlots[mHandle];
+	}
+
+	inline unsigned int RigidBody::getAwakeSlot()
+	{
+		unsigned int i = getSlot();
+		if(i >= mWorld->mNumAwake)
+			i = mWorld->wakeBody(i);
+		return i;
+	}
+
+	inline void RigidBody::addForce(const Common::Vector2& force)
+	{
+		auto& b = mWorld->mBodies;
+		unsigned int i = getAwakeSlot();
+		b.ForceX[i] += force.x;
+		b.ForceY[i] += force.y;
+	}
+
+	inline void RigidBody::addTorque(Real t)
+	{
+		mWorld->mBodies.Torque[getAwakeSlot()] += t;
+	}
+
+	inline Real RigidBody::getInverseMass() const
+	{
+		return mWorld->mBodies.InverseMass[getSlot()];
+	}
+
+	inline Common::Vector2 RigidBody::getPosition() const
+	{
+		const auto& b = mWorld->mBodies;
+		unsigned int i = getSlot();
+		return Common::Vector2(b.PositionX[i], b.PositionY[i]);
+	}
+
+	inline Common::Vector2 RigidBody::getOrientation() const
+	{
+		const auto& b = mWorld->mBodies;
+		unsigned int i = getSlot();
+		return Common::Vector2(b.OrientationX[i], b.OrientationY[i]);
+	}
+
+	inline Common::Vector2 RigidBody::getVelocity() const
+	{
+		const auto& b = mWorld->mBodies;
+		unsigned int i = getSlot();
+		return Common::Vector2(b.VelocityX[i], b.VelocityY[i]);
+	}
+
+	inline Real RigidBody::getRotation() const
+	{
+		return mWorld->mBodies.Rotation[getSlot()];
+	}
+
+	inline Common::Matrix22 RigidBody::getRotationMatrix() const
+	{
+		return Abyss::getRotationMatrix(getOrientation());
+	}
 }
 
 #endif
@@ -0,0 +1,131 @@
+#include <cassert>
+
+#include "ThreadPool.h"
+
+namespace Abyss {
+	static unsigned long long packRange(unsigned int begin, unsigned int end)
+	{
+		return ((unsigned long long)begin << 32) | end;
+	}
+
+	ThreadPool::ThreadPool(unsigned int numThreads)
+		: mNumThreads(numThreads),
+		mJob(nullptr),
+		mGeneration(0),
+		mBusy(0),
+		mQuit(false)
+	{
+		assert(numThreads > 0);
+		mQueues = new JobQueue[mNumThreads];
+		for(unsigned int i = 0; i < mNumThreads; i++)
+			mQueues[i].Range = packRange(0, 0);
+		for(unsigned int i = 1; i < mNumThreads; i++)
+			mWorkers.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mQuit = true;
+		}
+		mWake.notify_all();
+		for(auto& t : mWorkers)
+			t.join();
+		delete[] mQueues;
+	}
+
+	unsigned int ThreadPool::getNumThreads() const
+	{
+		return mNumThreads;
+	}
+
+	void ThreadPool::run(unsigned int numJobs, const std::function<void (unsigned int)>& job)
+	{
+		for(unsigned int i = 0; i < mNumThreads; i++) {
+			unsigned int begin = (unsigned long long)numJobs * i / mNumThreads;
+			unsigned int end = (unsigned long long)numJobs * (i + 1) / mNumThreads;
+			mQueues[i].Range = packRange(begin, end);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mJob = &job;
+			mBusy = mNumThreads - 1;
+			mGeneration++;
+		}
+		mWake.notify_all();
+
+		work(0);
+
+		std::unique_lock<std::mutex> lock(mMutex);
+		mDone.wait(lock, [&] { return mBusy == 0; });
+		mJob = nullptr;
+	}
+
+	void ThreadPool::workerLoop(unsigned int thread)
+	{
+		unsigned int generation = 0;
+		while(1) {
+			{
+				std::unique_lock<std::mutex> lock(mMutex);
+				mWake.wait(lock, [&] { return mQuit || mGeneration != generation; });
+				if(mQuit)
+					return;
+				generation = mGeneration;
+			}
+
+			work(thread);
+
+			std::lock_guard<std::mutex> lock(mMutex);
+			if(--mBusy == 0)
+				mDone.notify_one();
+		}
+	}
+
+	void ThreadPool::work(unsigned int thread)
+	{
+		unsigned int job;
+		while(popFront(thread, job))
+			(*mJob)(job);
+
+		for(unsigned int i = 1; i < mNumThreads; i++) {
+			unsigned int victim = (thread + i) % mNumThreads;
+			while(popBack(victim, job))
+				(*mJob)(job);
+		}
+	}
+
+	bool ThreadPool::popFront(unsigned int queue, unsigned int& job)
+	{
+		auto& range = mQueues[queue].Range;
+		unsigned long long r = range.load();
+		while(1) {
+			unsigned int begin = r >> 32;
+			unsigned int end = r & 0xffffffff;
+			if(begin >= end)
+				return false;
+			if(range.compare_exchange_weak(r, packRange(begin + 1, end))) {
+				job = begin;
+				return true;
+			}
+		}
+	}
+
+	bool ThreadPool::popBack(unsigned int queue, unsigned int& job)
+	{
+		auto& range = mQueues[queue].Range;
+		unsigned long long r = range.load();
+		while(1) {
+			unsigned int begin = r >> 32;
+			unsigned int end = r & 0xffffffff;
+			if(begin >= end)
+				return false;
+			if(range.compare_exchange_weak(r, packRange(begin, end - 1))) {
+				job = end - 1;
+				return true;
+			}
+		}
+	}
+}
+
@@ -0,0 +1,58 @@
+#ifndef ABYSS_THREADPOOL_H
+#define ABYSS_THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Abyss {
+	// A fixed set of threads that run batches of jobs. Each thread
+	// starts with its own share of the jobs and steals from the others
+	// once it runs out.
+	class ThreadPool {
+		public:
+			// numThreads includes the thread calling run()
+			ThreadPool(unsigned int numThreads);
+			~ThreadPool();
+			ThreadPool(const ThreadPool&) = delete;
+			ThreadPool& operator=(const ThreadPool&) = delete;
+
+			unsigned int getNumThreads() const;
+
+			// Runs job(i) for each i in [0, numJobs) and returns
+			// once all of them are done.
+			void run(unsigned int numJobs, const std::function<void (unsigned int)>& job);
+
+		private:
+			// The jobs [begin, end) of a thread packed in one word so
+			// that the owner can take from the front and thieves from
+			// the back without locking.
+			struct JobQueue {
+				std::atomic<unsigned long long> Range;
+				char Padding[64 - sizeof(std::atomic<unsigned long long>)];
+			};
+
+			void workerLoop(unsigned int thread);
+			void work(unsigned int thread);
+			bool popFront(unsigned int queue, unsigned int& job);
+			bool popBack(unsigned int queue, unsigned int& job);
+
+			unsigned int mNumThreads;
+			JobQueue* mQueues;
+			std::vector<std::thread> mWorkers;
+			const std::function<void (unsigned int)>* mJob;
+
+			std::mutex mMutex;
+			std::condition_variable mWake;
+			std::condition_variable mDone;
+			unsigned int mGeneration;
+			unsigned int mBusy;
+			bool mQuit;
+	};
+}
+
+#endif
+
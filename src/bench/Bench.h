@@ -0,0 +1,39 @@
+#ifndef BENCH_BENCH_H
+#define BENCH_BENCH_H
+
+#include <chrono>
+
+class BenchTimer {
+	public:
+		BenchTimer();
+		void reset();
+		double elapsed() const; // in seconds
+
+	private:
+		std::chrono::steady_clock::time_point mStart;
+};
+
+void bench_track_queries();
+void bench_track_distance_field();
+void bench_track_hints();
+void bench_curve_distance();
+void bench_track_batch();
+void bench_track_position();
+void bench_track_load();
+void bench_track_tessellation();
+void bench_track_stress();
+void bench_physics_step();
+void bench_physics_integrate();
+void bench_physics_threads();
+void bench_physics_forces();
+void bench_physics_adaptive();
+void bench_physics_sleep();
+void bench_physics_churn();
+void bench_physics_broadphase();
+void bench_physics_contacts();
+void bench_physics_barriers();
+void bench_physics_ccd();
+void bench_physics_particles();
+
+#endif
+
@@ -0,0 +1,1388 @@
+#include <iostream>
+#include <random>
+#include <vector>
+#include <list>
+#include <memory>
+#include <cmath>
+#include <unordered_map>
+#include <algorithm>
+
+#include "common/Vector2.h"
+#include "common/Matrix22.h"
+#include "common/Math.h"
+
+#include "abyss/Particle.h"
+#include "abyss/RigidBody.h"
+#include "abyss/Collision.h"
+
+#include "scr/Car.h"
+#include "scr/TrackBarriers.h"
+#include "scr/TrackGenerator.h"
+
+#include "Bench.h"
+
+using namespace Common;
+using namespace Abyss;
+
+// The rigid body world as it was before the body store: each body is
+// its own heap object with its state interleaved, kept in a std::list.
+// Used as the reference for the body store benchmarks.
+
+// the rotation matrix as it was computed before, through the angle
+static Matrix22 rotation_matrix_from_angle(const Vector2& orientation)
+{
+	Real theta = atan2(orientation.x, orientation.y);
+	Real s = sin(theta);
+	Real c = cos(theta);
+	return Matrix22(c, s, -s, c);
+}
+
+struct ListBody {
+	Real InverseMass = 0.0;
+	Real InverseInertiaTensor = 0.0;
+	Vector2 Position;
+	Vector2 Orientation = Vector2(1.0, 0.0);
+	Vector2 Velocity;
+	Real Rotation = 0.0;
+	Vector2 ForceAccum;
+	Real TorqueAccum = 0.0;
+	Real Damping = 1.0;
+	Real AngularDamping = 1.0;
+	Matrix22 RotationMatrix;
+
+	void integrate(Real duration)
+	{
+		Vector2 lastFrameAcceleration = ForceAccum * InverseMass;
+		Real angularAcceleration = TorqueAccum * InverseInertiaTensor;
+
+		Velocity += lastFrameAcceleration * duration;
+		Rotation += angularAcceleration * duration;
+
+		Velocity *= pow(Damping, duration);
+		Rotation *= pow(AngularDamping, duration);
+
+		Position += Velocity * duration;
+		Orientation = Math::rotate2D(Orientation, Rotation * duration);
+
+		RotationMatrix = rotation_matrix_from_angle(Orientation);
+		ForceAccum.zero();
+		TorqueAccum = 0.0;
+	}
+};
+
+class ListWorld {
+	public:
+		void startFrame()
+		{
+			for(auto b : mBodies) {
+				b->ForceAccum.zero();
+				b->TorqueAccum = 0.0;
+				b->RotationMatrix = rotation_matrix_from_angle(b->Orientation);
+			}
+		}
+
+		void runPhysics(Real duration)
+		{
+			for(auto b : mBodies)
+				b->integrate(duration);
+		}
+
+		std::list<ListBody*> mBodies;
+};
+
+struct BodyInit {
+	Vector2 Velocity;
+	Real Rotation;
+	Vector2 Force;
+};
+
+static std::vector<BodyInit> body_inits(unsigned int num)
+{
+	std::mt19937 gen(99);
+	std::uniform_real_distribution<float> dist(-10.0f, 10.0f);
+	std::vector<BodyInit> ret(num);
+	for(auto& b : ret) {
+		b.Velocity = Vector2(dist(gen), dist(gen));
+		b.Rotation = dist(gen) * 0.1f;
+		b.Force = Vector2(dist(gen), dist(gen)) * 100.0f;
+	}
+	return ret;
+}
+
+void bench_physics_step()
+{
+	const Real timestep = 0.01;
+	for(unsigned int num : {10, 100, 1000, 10000, 100000}) {
+		unsigned int steps = std::max(10u, 2000000 / num);
+		auto inits = body_inits(num);
+
+		// the bodies of the list world are embedded in larger objects
+		// around the heap like the car body is
+		ListWorld listWorld;
+		std::vector<std::unique_ptr<char[]>> padding;
+		std::vector<std::unique_ptr<ListBody>> listBodies;
+		for(const auto& init : inits) {
+			padding.emplace_back(new char[256]);
+			ListBody* b = new ListBody();
+			listBodies.emplace_back(b);
+			b->InverseMass = 1.0 / 1000.0;
+			b->InverseInertiaTensor = 1.0 / 2000.0;
+			b->AngularDamping = 0.9;
+			b->Velocity = init.Velocity;
+			b->Rotation = init.Rotation;
+			listWorld.mBodies.push_back(b);
+		}
+
+		World world;
+		std::vector<std::unique_ptr<RigidBody>> bodies;
+		for(const auto& init : inits) {
+			RigidBody* b = new RigidBody(&world);
+			bodies.emplace_back(b);
+			b->setMass(1000.0);
+			b->setInertiaTensor(2000.0);
+			b->setAngularDamping(0.9);
+			b->setVelocity(init.Velocity);
+			b->setRotation(init.Rotation);
+		}
+
+		BenchTimer timer;
+		for(unsigned int i = 0; i < steps; i++) {
+			listWorld.startFrame();
+			unsigned int j = 0;
+			for(auto b : listWorld.mBodies)
+				b->ForceAccum += inits[j++].Force;
+			listWorld.runPhysics(timestep);
+		}
+		double listTime = timer.elapsed();
+
+		timer.reset();
+		for(unsigned int i = 0; i < steps; i++) {
+			world.startFrame();
+			for(unsigned int j = 0; j < num; j++)
+				bodies[j]->addForce(inits[j].Force);
+			world.runPhysics(timestep);
+		}
+		double storeTime = timer.elapsed();
+
+		// the body store integrates in double so the results differ
+		// from the list world by rounding
+		float maxDiff = 0.0f;
+		for(unsigned int j = 0; j < num; j++) {
+			maxDiff = std::max(maxDiff, bodies[j]->getPosition().distance(listBodies[j]->Position));
+			maxDiff = std::max(maxDiff, bodies[j]->getOrientation().distance(listBodies[j]->Orientation));
+		}
+
+		std::cout << num << " bodies, " << steps << " steps: list " <<
+			listTime * 1.0e9 / (steps * (double)num) << " ns/body/step, body store " <<
+			storeTime * 1.0e9 / (steps * (double)num) << " ns/body/step; max difference " <<
+			maxDiff << "\n";
+	}
+}
+
+static const IntegrationKernel integration_kernels[] = {
+	IntegrationKernel::Scalar,
+	IntegrationKernel::SSE2,
+	IntegrationKernel::AVX2
+};
+
+// Bodies with random mass, damping and state, for comparing the
+// integration kernels.
+static void add_random_bodies(World& world, std::vector<std::unique_ptr<RigidBody>>& bodies,
+		unsigned int num)
+{
+	std::mt19937 gen(123);
+	std::uniform_real_distribution<float> dist(-10.0f, 10.0f);
+	std::uniform_real_distribution<double> damping(0.5, 1.0);
+	for(unsigned int i = 0; i < num; i++) {
+		RigidBody* b = new RigidBody(&world);
+		bodies.emplace_back(b);
+		b->setMass(500.0 + dist(gen) * 20.0);
+		b->setInertiaTensor(1000.0 + dist(gen) * 50.0);
+		b->setDamping(damping(gen));
+		b->setAngularDamping(damping(gen));
+		b->setPosition(Vector2(dist(gen), dist(gen)) * 100.0f);
+		Vector2 o(dist(gen), dist(gen));
+		o.normalize();
+		b->setOrientation(o);
+		b->setVelocity(Vector2(dist(gen), dist(gen)));
+		b->setRotation(dist(gen) * 0.1);
+	}
+}
+
+static bool same_state(const RigidBody& a, const RigidBody& b)
+{
+	return a.getPosition().x == b.getPosition().x &&
+		a.getPosition().y == b.getPosition().y &&
+		a.getOrientation().x == b.getOrientation().x &&
+		a.getOrientation().y == b.getOrientation().y &&
+		a.getVelocity().x == b.getVelocity().x &&
+		a.getVelocity().y == b.getVelocity().y &&
+		a.getRotation() == b.getRotation();
+}
+
+void bench_physics_integrate()
+{
+	// differential test: every kernel must match the scalar kernel
+	// bitwise. The body count is not a multiple of the SIMD width and
+	// the time step changes, so the tails and the damping factor
+	// updates are covered as well.
+	const unsigned int num = 1003;
+	const unsigned int steps = 1000;
+	std::vector<World*> worlds;
+	std::vector<std::vector<std::unique_ptr<RigidBody>>> bodies(3);
+	for(auto k : integration_kernels) {
+		if(!integrationKernelSupported(k)) {
+			std::cout << integrationKernelName(k) << " kernel not supported\n";
+			continue;
+		}
+		World* world = new World();
+		world->setIntegrationKernel(k);
+		auto& bs = bodies[worlds.size()];
+		worlds.push_back(world);
+		add_random_bodies(*world, bs, num);
+		std::mt19937 gen(7);
+		std::uniform_real_distribution<float> dist(-1000.0f, 1000.0f);
+		for(unsigned int i = 0; i < steps; i++) {
+			Real timestep = i % 100 < 50 ? 0.01 : 1.0 / 60.0;
+			world->startFrame();
+			for(auto& b : bs) {
+				Vector2 force(dist(gen), dist(gen));
+				b->addForceAtBodyPoint(force, Vector2(dist(gen), dist(gen)) * 0.001f);
+			}
+			if(i % 10 == 0) {
+				// single bodies use the same kernels
+				for(unsigned int j = 0; j < num; j += 13)
+					bs[j]->integrate(timestep);
+			}
+			world->runPhysics(timestep);
+		}
+	}
+
+	for(unsigned int w = 1; w < worlds.size(); w++) {
+		unsigned int mismatches = 0;
+		for(unsigned int j = 0; j < num; j++) {
+			if(!same_state(*bodies[0][j], *bodies[w][j]))
+				mismatches++;
+		}
+		std::cout << integrationKernelName(worlds[w]->getIntegrationKernel()) <<
+			" vs scalar: " << num << " bodies, " << steps << " steps, mismatches " <<
+			mismatches << "\n";
+	}
+	for(unsigned int w = 0; w < worlds.size(); w++) {
+		bodies[w].clear();
+		delete worlds[w];
+	}
+
+	// throughput
+	const Real timestep = 0.01;
+	for(unsigned int n : {100, 1000, 10000, 100000}) {
+		unsigned int nsteps = std::max(10u, 2000000 / n);
+		std::cout << n << " bodies, " << nsteps << " steps:";
+		for(auto k : integration_kernels) {
+			if(!integrationKernelSupported(k))
+				continue;
+			World world;
+			world.setIntegrationKernel(k);
+			std::vector<std::unique_ptr<RigidBody>> bs;
+			add_random_bodies(world, bs, n);
+			world.startFrame();
+			BenchTimer timer;
+			for(unsigned int i = 0; i < nsteps; i++)
+				world.runPhysics(timestep);
+			double t = timer.elapsed();
+			std::cout << " " << integrationKernelName(k) << " " <<
+				t * 1.0e9 / (nsteps * (double)n) << " ns/body/step";
+			bs.clear();
+		}
+		std::cout << "\n";
+	}
+}
+
+// A world of bodies with the same force generators each, plus a
+// spring to the previous body so that generators read other bodies.
+struct SpringWorld {
+	SpringWorld(unsigned int num, unsigned int numThreads);
+	~SpringWorld();
+	void step(Real duration);
+
+	World mWorld;
+	Gravity mGravity;
+	Drag mDrag;
+	std::vector<RigidBody*> mBodies;
+	std::vector<Spring*> mSprings;
+};
+
+SpringWorld::SpringWorld(unsigned int num, unsigned int numThreads)
+	: mGravity(Vector2(0.0f, -9.81f)),
+	mDrag(0.1, 0.01)
+{
+	mWorld.setNumThreads(numThreads);
+	std::vector<std::unique_ptr<RigidBody>> bodies;
+	add_random_bodies(mWorld, bodies, num);
+	for(auto& b : bodies)
+		mBodies.push_back(b.release());
+
+	auto reg = mWorld.getForceRegistry();
+	for(unsigned int i = 0; i < num; i++) {
+		reg->add(mBodies[i], &mGravity);
+		if(i > 0) {
+			Spring* s = new Spring(Vector2(0.5f, 0.0f), mBodies[i - 1],
+					Vector2(-0.5f, 0.0f), 100.0, 1.0);
+			mSprings.push_back(s);
+			reg->add(mBodies[i], s);
+		}
+		reg->add(mBodies[i], &mDrag);
+	}
+}
+
+SpringWorld::~SpringWorld()
+{
+	mWorld.getForceRegistry()->clear();
+	for(auto s : mSprings)
+		delete s;
+	for(auto b : mBodies)
+		delete b;
+}
+
+void SpringWorld::step(Real duration)
+{
+	mWorld.startFrame();
+	mWorld.runPhysics(duration);
+}
+
+void bench_physics_threads()
+{
+	const Real timestep = 0.01;
+	for(unsigned int num : {1000, 10000, 100000}) {
+		unsigned int steps = std::max(10u, 1000000 / num);
+
+		SpringWorld serial(num, 1);
+		BenchTimer timer;
+		for(unsigned int i = 0; i < steps; i++)
+			serial.step(timestep);
+		double serialTime = timer.elapsed();
+		std::cout << num << " bodies, " << steps << " steps: serial " <<
+			serialTime * 1.0e9 / (steps * (double)num) << " ns/body/step\n";
+
+		for(unsigned int threads : {1, 2, 4, 8, 16, 32, 64}) {
+			SpringWorld parallel(num, threads);
+			timer.reset();
+			for(unsigned int i = 0; i < steps; i++)
+				parallel.step(timestep);
+			double t = timer.elapsed();
+
+			unsigned int mismatches = 0;
+			for(unsigned int j = 0; j < num; j++) {
+				if(!same_state(*serial.mBodies[j], *parallel.mBodies[j]))
+					mismatches++;
+			}
+			std::cout << "  " << threads << " threads: " <<
+				t * 1.0e9 / (steps * (double)num) << " ns/body/step, speedup " <<
+				serialTime / t << ", mismatches " << mismatches << "\n";
+		}
+	}
+}
+
+// The force registry as it was before the registrations were grouped
+// by generator type: one virtual call per registration, in the order
+// they were added.
+class VirtualRegistry : public ForceRegistry {
+	public:
+		// takes the registrations of the registry
+		VirtualRegistry(ForceRegistry* registry, const std::vector<RigidBody*>& bodyOrder);
+		void updateForces(Real duration);
+
+	private:
+		std::vector<std::pair<RigidBody*, ForceGenerator*>> mRegistrations;
+};
+
+VirtualRegistry::VirtualRegistry(ForceRegistry* registry, const std::vector<RigidBody*>& bodyOrder)
+{
+	// the registrations of a body in registration order, assuming
+	// each body registers its generators in type order like a car
+	auto registryGroups = &VirtualRegistry::groups;
+	std::unordered_map<RigidBody*, std::vector<ForceGenerator*>> regs;
+	for(const auto& g : registry->*registryGroups) {
+		for(unsigned int i = 0; i < g.Bodies.size(); i++)
+			regs[g.Bodies[i]].push_back(g.Generators[i]);
+	}
+	for(auto body : bodyOrder) {
+		for(auto fg : regs[body])
+			mRegistrations.push_back(std::make_pair(body, fg));
+	}
+	registry->clear();
+}
+
+void VirtualRegistry::updateForces(Real duration)
+{
+	for(auto& reg : mRegistrations)
+		reg.second->updateForce(reg.first, duration);
+}
+
+void bench_physics_forces()
+{
+	const Real timestep = 0.01;
+	CarConfig carconf;
+	for(unsigned int num : {1, 100, 10000}) {
+		unsigned int steps = std::max(10u, 1000000 / num);
+
+		// two worlds with the same cars. The registrations are moved
+		// out of the world registries so that the force updates can
+		// be timed on their own.
+		World oldWorld;
+		World newWorld;
+		std::vector<std::unique_ptr<Car>> oldCars;
+		std::vector<std::unique_ptr<Car>> newCars;
+		std::vector<RigidBody*> oldBodies;
+		for(unsigned int i = 0; i < num; i++) {
+			oldCars.emplace_back(new Car(&carconf, &oldWorld, nullptr));
+			newCars.emplace_back(new Car(&carconf, &newWorld, nullptr));
+			oldBodies.push_back(oldCars.back()->getBody());
+			for(auto& cars : {&oldCars, &newCars}) {
+				Car* car = cars->back().get();
+				car->setVelocity(Vector2(sin(i * 0.1f), 1.0f) * 20.0f);
+				car->setThrottle(0.5f + 0.5f * sin(i * 0.3f));
+				car->setSteering(sin(i * 0.7f));
+			}
+		}
+		VirtualRegistry oldRegistry(oldWorld.getForceRegistry(), oldBodies);
+		ForceRegistry newRegistry = *newWorld.getForceRegistry();
+		newWorld.getForceRegistry()->clear();
+
+		double oldTime = 0.0;
+		double newTime = 0.0;
+		for(unsigned int i = 0; i < steps; i++) {
+			oldWorld.startFrame();
+			BenchTimer timer;
+			oldRegistry.updateForces(timestep);
+			oldTime += timer.elapsed();
+			oldWorld.runPhysics(timestep);
+
+			newWorld.startFrame();
+			timer.reset();
+			newRegistry.updateForces(timestep);
+			newTime += timer.elapsed();
+			newWorld.runPhysics(timestep);
+		}
+
+		unsigned int mismatches = 0;
+		for(unsigned int j = 0; j < num; j++) {
+			if(!same_state(*oldCars[j]->getBody(), *newCars[j]->getBody()))
+				mismatches++;
+		}
+
+		std::cout << num << " cars, " << steps << " steps: per registration " <<
+			oldTime * 1.0e9 / (steps * num) << " ns/car/step, by type " <<
+			newTime * 1.0e9 / (steps * num) << " ns/car/step; mismatches " <<
+			mismatches << "\n";
+	}
+}
+
+// Drives a car for duration seconds in frames of frameTime with
+// inputs that change every frame, running each frame either in
+// substeps fixed steps or adaptively if tolerance is above 0. Returns
+// the car position after each frame.
+static std::vector<Vector2> drive_car(float duration, float frameTime,
+		unsigned int substeps, Real tolerance, double& wallTime,
+		World::SteppingStats& stats)
+{
+	CarConfig carconf;
+	World world;
+	Car car(&carconf, &world, nullptr);
+	car.setVelocity(Vector2(0.0f, 5.0f));
+	if(tolerance > 0.0)
+		world.setAdaptiveStepping(tolerance, 256);
+
+	unsigned int frames = duration / frameTime;
+	std::vector<Vector2> positions;
+	BenchTimer timer;
+	for(unsigned int i = 0; i < frames; i++) {
+		// straights alternating with hard turns
+		float t = i * frameTime;
+		float steering = sin(t * 0.8f);
+		car.setThrottle(0.5f + 0.5f * sin(t * 0.5f));
+		car.setSteering(steering * steering * steering);
+		if(tolerance > 0.0) {
+			world.startFrame();
+			world.runPhysics(frameTime);
+		} else {
+			for(unsigned int j = 0; j < substeps; j++) {
+				world.startFrame();
+				world.runPhysics(frameTime / substeps);
+			}
+		}
+		positions.push_back(car.getPosition());
+	}
+	wallTime = timer.elapsed();
+	stats = world.getSteppingStats();
+	return positions;
+}
+
+void bench_physics_adaptive()
+{
+	const float duration = 10.0f;
+	const float frameTime = 1.0f / 30.0f;
+	double wallTime;
+	World::SteppingStats stats;
+	auto reference = drive_car(duration, frameTime, 256, 0.0, wallTime, stats);
+
+	auto report = [&] (const char* name, const std::vector<Vector2>& positions) {
+		float maxError = 0.0f;
+		for(unsigned int i = 0; i < positions.size(); i++)
+			maxError = std::max(maxError, positions[i].distance(reference[i]));
+		std::cout << name << ": " << wallTime * 1.0e6 / duration << " us per simulated s, " <<
+			stats.Substeps / double(positions.size()) <<
+			" substeps per frame, " << stats.Rejected << " rejected, max error " <<
+			maxError << " m\n";
+	};
+
+	std::cout << "Car driven for " << duration << " s in frames of " << frameTime <<
+		" s, error against 256 substeps per frame\n";
+	for(unsigned int substeps : {1, 2, 4, 8, 16, 32, 64}) {
+		auto positions = drive_car(duration, frameTime, substeps, 0.0, wallTime, stats);
+		std::string name = "fixed, " + std::to_string(substeps) + " substeps";
+		report(name.c_str(), positions);
+	}
+	for(Real tolerance : {1.0e-2, 1.0e-3, 1.0e-4, 1.0e-5}) {
+		auto positions = drive_car(duration, frameTime, 1, tolerance, wallTime, stats);
+		std::string name = "adaptive, tolerance " + std::to_string(tolerance);
+		report(name.c_str(), positions);
+	}
+}
+
+void bench_physics_sleep()
+{
+	const Real timestep = 0.01;
+	const unsigned int num = 1000;
+	const unsigned int steps = 500;
+	CarConfig carconf;
+	std::cout << num << " cars, " << steps << " steps\n";
+	for(unsigned int idlePercent : {0, 50, 90, 99}) {
+		// the idle cars stand still, the others drive around
+		World worlds[2];
+		std::vector<std::unique_ptr<Car>> cars[2];
+		worlds[1].setSleeping(0.1, 0.05, 1.0);
+		for(int w = 0; w < 2; w++) {
+			for(unsigned int i = 0; i < num; i++) {
+				cars[w].emplace_back(new Car(&carconf, &worlds[w], nullptr));
+				Car* car = cars[w].back().get();
+				car->setPosition(Vector2(i * 10.0f, 0.0f));
+				if(i % 100 >= idlePercent) {
+					car->setVelocity(Vector2(sin(i * 0.1f), 1.0f) * 20.0f);
+					car->setThrottle(0.5f + 0.5f * sin(i * 0.3f));
+					car->setSteering(sin(i * 0.7f));
+				}
+			}
+		}
+
+		double times[2];
+		for(int w = 0; w < 2; w++) {
+			// let the idle cars fall asleep
+			for(unsigned int i = 0; i < 200; i++) {
+				worlds[w].startFrame();
+				worlds[w].runPhysics(timestep);
+			}
+			BenchTimer timer;
+			for(unsigned int i = 0; i < steps; i++) {
+				worlds[w].startFrame();
+				worlds[w].runPhysics(timestep);
+			}
+			times[w] = timer.elapsed();
+		}
+
+		unsigned int mismatches = 0;
+		for(unsigned int i = 0; i < num; i++) {
+			if(!same_state(*cars[0][i]->getBody(), *cars[1][i]->getBody()))
+				mismatches++;
+		}
+
+		// giving an idle car some throttle wakes it up
+		bool woken = true;
+		if(idlePercent) {
+			Car* car = cars[1][0].get();
+			Vector2 pos = car->getPosition();
+			car->setThrottle(1.0f);
+			worlds[1].startFrame();
+			worlds[1].runPhysics(timestep);
+			woken = car->getBody()->isAwake() && car->getPosition().distance(pos) > 0.0f;
+		}
+
+		std::cout << idlePercent << " % idle: awake " <<
+			worlds[1].getNumAwakeBodies() << ", always awake " <<
+			times[0] * 1.0e9 / (steps * num) << " ns/car/step, sleeping " <<
+			times[1] * 1.0e9 / (steps * num) << " ns/car/step; mismatches " <<
+			mismatches << (woken ? "" : ", idle car did not wake up") << "\n";
+	}
+}
+
+
+
+struct ChurnState {
+	Vector2 Position;
+	Vector2 Orientation;
+	Vector2 Velocity;
+	Real Rotation;
+};
+
+static ChurnState churn_state(const RigidBody& b)
+{
+	return ChurnState{b.getPosition(), b.getOrientation(), b.getVelocity(), b.getRotation()};
+}
+
+static bool same_churn_state(const ChurnState& a, const ChurnState& b)
+{
+	return a.Position.x == b.Position.x && a.Position.y == b.Position.y &&
+		a.Orientation.x == b.Orientation.x && a.Orientation.y == b.Orientation.y &&
+		a.Velocity.x == b.Velocity.x && a.Velocity.y == b.Velocity.y &&
+		a.Rotation == b.Rotation;
+}
+
+static Car* spawn_churn_car(const CarConfig* carconf, World* world)
+{
+	Car* car = new Car(carconf, world, nullptr);
+	car->setVelocity(Vector2(0.0f, 10.0f));
+	car->setThrottle(0.7f);
+	car->setSteering(0.3f);
+	return car;
+}
+
+void bench_physics_churn()
+{
+	const Real timestep = 0.01;
+	CarConfig carconf;
+
+	// despawning every car in random order. The registry removal as it
+	// was before the handles searched the registrations of the
+	// generator type and erased from the middle, which is timed here
+	// on the same registrations.
+	for(unsigned int num : {1000, 10000, 50000}) {
+		World world;
+		std::vector<std::unique_ptr<Car>> cars;
+		std::vector<std::pair<RigidBody*, ForceGenerator*>> oldRegistrations;
+		for(unsigned int i = 0; i < num; i++) {
+			cars.emplace_back(spawn_churn_car(&carconf, &world));
+			for(unsigned int j = 0; j < 5; j++)
+				oldRegistrations.push_back(std::make_pair(cars.back()->getBody(), nullptr));
+		}
+		std::vector<unsigned int> order(num);
+		for(unsigned int i = 0; i < num; i++)
+			order[i] = i;
+		std::shuffle(order.begin(), order.end(), std::mt19937(123));
+
+		BenchTimer timer;
+		for(unsigned int i : order) {
+			RigidBody* body = cars[i]->getBody();
+			for(unsigned int j = 0; j < 5; j++) {
+				auto it = std::find_if(oldRegistrations.begin(), oldRegistrations.end(),
+						[&] (const std::pair<RigidBody*, ForceGenerator*>& r) {
+							return r.first == body;
+						});
+				oldRegistrations.erase(it);
+			}
+		}
+		double oldTime = timer.elapsed();
+
+		timer.reset();
+		for(unsigned int i : order)
+			cars[i].reset();
+		double newTime = timer.elapsed();
+		world.startFrame();
+		world.runPhysics(timestep);
+
+		std::cout << num << " cars despawned: linear removal " <<
+			oldTime * 1.0e9 / num << " ns/car, handles " <<
+			newTime * 1.0e9 / num << " ns/car (including the body)\n";
+	}
+
+	// steady churn: every step one car in a hundred is replaced by a
+	// new one. Each surviving car must be where a car of the same age
+	// is in a world of its own.
+	const unsigned int num = 10000;
+	const unsigned int steps = 500;
+	std::vector<ChurnState> reference;
+	{
+		World world;
+		std::unique_ptr<Car> car(spawn_churn_car(&carconf, &world));
+		reference.push_back(churn_state(*car->getBody()));
+		for(unsigned int i = 0; i < steps; i++) {
+			world.startFrame();
+			world.runPhysics(timestep);
+			reference.push_back(churn_state(*car->getBody()));
+		}
+	}
+
+	World world;
+	std::vector<std::unique_ptr<Car>> cars;
+	std::vector<unsigned int> ages;
+	for(unsigned int i = 0; i < num; i++) {
+		cars.emplace_back(spawn_churn_car(&carconf, &world));
+		ages.push_back(0);
+	}
+	std::mt19937 gen(123);
+	BenchTimer timer;
+	double churnTime = 0.0;
+	for(unsigned int i = 0; i < steps; i++) {
+		BenchTimer churnTimer;
+		for(unsigned int j = 0; j < num / 100; j++) {
+			unsigned int k = std::uniform_int_distribution<unsigned int>(0, num - 1)(gen);
+			cars[k].reset(spawn_churn_car(&carconf, &world));
+			ages[k] = 0;
+		}
+		churnTime += churnTimer.elapsed();
+		world.startFrame();
+		world.runPhysics(timestep);
+		for(auto& age : ages)
+			age++;
+	}
+	double totalTime = timer.elapsed();
+
+	unsigned int mismatches = 0;
+	for(unsigned int i = 0; i < num; i++) {
+		if(!same_churn_state(churn_state(*cars[i]->getBody()), reference[ages[i]]))
+			mismatches++;
+	}
+	std::cout << num << " cars, " << num / 100 << " replaced per step, " << steps <<
+		" steps: " << totalTime * 1.0e6 / steps << " us/step, of which churn " <<
+		churnTime * 1.0e6 / steps << " us/step; mismatches " << mismatches << "\n";
+}
+
+
+// The overlapping pairs by testing every box, grown by the contact
+// margin, against every other.
+static std::vector<std::pair<unsigned int, unsigned int>> brute_force_pairs(
+		const Broadphase& broadphase, const std::vector<unsigned int>& proxies)
+{
+	struct Bounds {
+		float Min[2];
+		float Max[2];
+	};
+	std::vector<Bounds> bounds;
+	for(unsigned int proxy : proxies) {
+		const RigidBody* body = broadphase.getBody(proxy);
+		Vector2 h = broadphase.getHalfSize(proxy);
+		Vector2 pos = body->getPosition();
+		Vector2 o = body->getOrientation();
+		float ex = h.x * fabs(o.y) + h.y * fabs(o.x) + ContactMargin;
+		float ey = h.x * fabs(o.x) + h.y * fabs(o.y) + ContactMargin;
+		bounds.push_back(Bounds{{pos.x - ex, pos.y - ey}, {pos.x + ex, pos.y + ey}});
+	}
+	std::vector<std::pair<unsigned int, unsigned int>> pairs;
+	for(unsigned int i = 0; i < proxies.size(); i++) {
+		for(unsigned int j = i + 1; j < proxies.size(); j++) {
+			if(bounds[i].Min[0] < bounds[j].Max[0] && bounds[j].Min[0] < bounds[i].Max[0] &&
+					bounds[i].Min[1] < bounds[j].Max[1] && bounds[j].Min[1] < bounds[i].Max[1])
+				pairs.push_back(std::make_pair(std::min(proxies[i], proxies[j]),
+							std::max(proxies[i], proxies[j])));
+		}
+	}
+	std::sort(pairs.begin(), pairs.end());
+	return pairs;
+}
+
+// A pack of cars in rows of eight driving up the y axis at slightly
+// different speeds and weaving, so that they keep running into each
+// other (they don't collide yet).
+static void add_car_pack(const CarConfig* carconf, World* world, unsigned int num,
+		std::vector<std::unique_ptr<Car>>& cars)
+{
+	for(unsigned int i = 0; i < num; i++) {
+		cars.emplace_back(new Car(carconf, world, nullptr));
+		Car* car = cars.back().get();
+		car->setPosition(Vector2((i % 8) * 3.0f, (i / 8) * 7.0f));
+		car->setVelocity(Vector2(0.0f, 40.0f + 4.0f * sin(i * 0.37f)));
+		car->setThrottle(0.5f + 0.5f * sin(i * 0.3f));
+	}
+}
+
+void bench_physics_broadphase()
+{
+	const Real timestep = 0.01;
+	CarConfig carconf;
+	for(unsigned int num : {10, 100, 1000, 10000}) {
+		unsigned int steps = std::max(20u, 200000 / num);
+		World world;
+		std::vector<std::unique_ptr<Car>> cars;
+		add_car_pack(&carconf, &world, num, cars);
+
+		Broadphase broadphase;
+		std::vector<unsigned int> proxies;
+		for(auto& car : cars) {
+			proxies.push_back(broadphase.addProxy(car->getBody(),
+						Vector2(car->getWidth(), car->getLength()) * 0.5f));
+		}
+		broadphase.update();
+
+		double updateTime = 0.0;
+		double bruteTime = 0.0;
+		unsigned long numPairs = 0;
+		unsigned int mismatches = 0;
+		for(unsigned int i = 0; i < steps; i++) {
+			for(unsigned int j = 0; j < num; j++)
+				cars[j]->setSteering(0.3f * sin(i * 0.05f + j * 0.9f));
+			world.startFrame();
+			world.runPhysics(timestep);
+
+			BenchTimer timer;
+			broadphase.update();
+			updateTime += timer.elapsed();
+			numPairs += broadphase.getPairs().size();
+
+			// the brute force check is quadratic, only time it
+			// for some of the steps with many cars
+			if(num <= 1000 || i % 10 == 0) {
+				timer.reset();
+				auto expected = brute_force_pairs(broadphase, proxies);
+				bruteTime += timer.elapsed() * (num <= 1000 ? 1 : 10);
+
+				std::vector<std::pair<unsigned int, unsigned int>> pairs;
+				for(const auto& p : broadphase.getPairs())
+					pairs.push_back(std::make_pair(p.Proxies[0], p.Proxies[1]));
+				std::sort(pairs.begin(), pairs.end());
+				if(pairs != expected)
+					mismatches++;
+			}
+		}
+
+		std::cout << num << " cars, " << steps << " steps: " <<
+			numPairs / double(steps) << " pairs per step, sweep and prune " <<
+			updateTime * 1.0e9 / (steps * num) << " ns/car/step, all pairs " <<
+			bruteTime * 1.0e9 / (steps * num) << " ns/car/step; mismatching steps " <<
+			mismatches << "\n";
+	}
+}
+
+
+static Vector2 total_momentum(const std::vector<std::unique_ptr<Car>>& cars)
+{
+	Vector2 momentum;
+	for(const auto& car : cars)
+		momentum += car->getBody()->getVelocity() * car->getBody()->getMass();
+	return momentum;
+}
+
+// Runs a pack of cars with contacts: weaving, so that the cars keep
+// bumping into each other, or in a jam, where they run into a braking
+// row in front and keep pushing against each other.
+static void run_contact_pack(const CarConfig* carconf, unsigned int num, bool jam,
+		bool warmStarting)
+{
+	const Real timestep = 0.01;
+	const unsigned int steps = 500;
+	World world;
+	std::vector<std::unique_ptr<Car>> cars;
+	CarConfig jamconf = *carconf;
+	jamconf.ThrottleCoefficient = 2000.0f;
+	add_car_pack(jam ? &jamconf : carconf, &world, num, cars);
+	if(jam) {
+		for(unsigned int j = 0; j < num; j++) {
+			cars[j]->setPosition(Vector2((j % 8) * 3.0f, (j / 8) * 6.0f));
+			if(j / 8 == (num - 1) / 8) {
+				cars[j]->setVelocity(Vector2());
+				cars[j]->setThrottle(0.0f);
+				cars[j]->setBrake(1.0f);
+			} else {
+				cars[j]->setVelocity(Vector2(0.0f, 10.0f));
+				cars[j]->setThrottle(1.0f);
+			}
+		}
+	}
+	Broadphase broadphase;
+	for(auto& car : cars) {
+		broadphase.addProxy(car->getBody(),
+				Vector2(car->getWidth(), car->getLength()) * 0.5f);
+	}
+	ContactResolver resolver(100);
+	resolver.setWarmStarting(warmStarting);
+
+	std::vector<ContactManifold> manifolds;
+	double narrowTime = 0.0;
+	double resolveTime = 0.0;
+	unsigned long numManifolds = 0;
+	unsigned long iterations = 0;
+	unsigned int maxIterations = 0;
+	double penetration = 0.0;
+	for(unsigned int i = 0; i < steps; i++) {
+		for(unsigned int j = 0; j < num && !jam; j++)
+			cars[j]->setSteering(0.3f * sin(i * 0.05f + j * 0.9f));
+		world.startFrame();
+		world.runPhysics(timestep);
+		broadphase.update();
+
+		BenchTimer timer;
+		manifolds.clear();
+		broadphase.generateContacts(manifolds, 0.5, jam ? 0.0 : 0.3);
+		narrowTime += timer.elapsed();
+
+		Real maxPenetration = 0.0;
+		for(const auto& m : manifolds) {
+			for(unsigned int k = 0; k < m.NumPoints; k++)
+				maxPenetration = std::max(maxPenetration, m.Points[k].Penetration);
+		}
+		penetration += maxPenetration;
+		numManifolds += manifolds.size();
+		if(manifolds.empty())
+			continue;
+
+		timer.reset();
+		resolver.resolveContacts(&manifolds[0], manifolds.size(), timestep);
+		resolveTime += timer.elapsed();
+		iterations += resolver.getIterationsUsed();
+		maxIterations = std::max(maxIterations, resolver.getIterationsUsed());
+	}
+
+	std::cout << num << " cars " << (jam ? "in a jam, " : "weaving, ") <<
+		steps << " steps, " << (warmStarting ? "warm started: " : "cold: ") <<
+		numManifolds / double(steps) << " manifolds per step, narrowphase " <<
+		narrowTime * 1.0e6 / steps << " us/step, " <<
+		iterations / double(steps) << " iterations per step (max " <<
+		maxIterations << "), resolver " << resolveTime * 1.0e6 / steps <<
+		" us/step, largest penetration " << penetration / steps << " m on average\n";
+}
+
+void bench_physics_contacts()
+{
+	const Real timestep = 0.01;
+	CarConfig carconf;
+
+	// two cars head on: the impulses keep the momentum and stop them
+	// closing in
+	{
+		World world;
+		std::vector<std::unique_ptr<Car>> cars;
+		for(int i = 0; i < 2; i++) {
+			cars.emplace_back(new Car(&carconf, &world, nullptr));
+			RigidBody* body = cars.back()->getBody();
+			body->setPosition(Vector2(0.3f * i, 5.2f * i));
+			body->setOrientation(Vector2(0.0f, i ? -1.0f : 1.0f));
+			body->setVelocity(Vector2(0.0f, i ? -10.0f : 10.0f));
+		}
+		Broadphase broadphase;
+		for(auto& car : cars) {
+			broadphase.addProxy(car->getBody(),
+					Vector2(car->getWidth(), car->getLength()) * 0.5f);
+		}
+		ContactResolver resolver(100);
+		std::vector<ContactManifold> manifolds;
+		float maxMomentumChange = 0.0f;
+		float maxClosingVelocity = 0.0f;
+		unsigned int contactSteps = 0;
+		for(unsigned int i = 0; i < 100; i++) {
+			world.startFrame();
+			world.runPhysics(timestep);
+			broadphase.update();
+			manifolds.clear();
+			broadphase.generateContacts(manifolds, 0.5, 0.3);
+			if(manifolds.empty())
+				continue;
+			contactSteps++;
+			Vector2 momentum = total_momentum(cars);
+			resolver.resolveContacts(&manifolds[0], manifolds.size(), timestep);
+			maxMomentumChange = std::max(maxMomentumChange,
+					total_momentum(cars).distance(momentum));
+			Vector2 separating = cars[0]->getBody()->getVelocity() -
+				cars[1]->getBody()->getVelocity();
+			maxClosingVelocity = std::max(maxClosingVelocity,
+					-separating.dot(manifolds[0].Normal));
+		}
+		std::cout << "Head on at 20 m/s: in contact for " << contactSteps <<
+			" steps, largest momentum change " << maxMomentumChange <<
+			" kg m/s, closing velocity after resolving " << maxClosingVelocity <<
+			" m/s, cars " << cars[0]->getPosition().distance(cars[1]->getPosition()) <<
+			" m apart in the end\n";
+	}
+
+	for(bool jam : {false, true}) {
+		for(unsigned int num : {100, 1000}) {
+			for(bool warmStarting : {false, true})
+				run_contact_pack(&carconf, num, jam, warmStarting);
+		}
+	}
+}
+
+
+// Cars spread over the track, heading along it at speed with the
+// steering stuck, so that they run into the barriers.
+static void add_cars_on_track(const CarConfig* carconf, World* world, const Track* track,
+		unsigned int num, std::vector<std::unique_ptr<Car>>& cars)
+{
+	const auto& segments = track->getTrackSegments();
+	for(unsigned int i = 0; i < num; i++) {
+		auto line = segments[(unsigned long)i * segments.size() / num]->getCenterLine();
+		Vector2 dir = (line[1] - line[0]).normalized();
+		cars.emplace_back(new Car(carconf, world, track));
+		Car* car = cars.back().get();
+		car->setPosition(line[0]);
+		car->getBody()->setOrientation(dir);
+		car->setVelocity(dir * 30.0f);
+		car->setThrottle(1.0f);
+		car->setSteering(sin(i * 0.7f));
+	}
+}
+
+void bench_physics_barriers()
+{
+	const Real timestep = 0.01;
+	const float runoff = 2.0f;
+	const unsigned int num = 100;
+	const unsigned int steps = 300;
+	CarConfig carconf;
+	for(unsigned int size : {100, 1000, 10000}) {
+		TrackGenerator gen(size);
+		auto tc = gen.generate(size);
+		Track track(&tc);
+		BenchTimer timer;
+		BarrierTree tree(TrackBarriers(&track, runoff).Barriers);
+		double buildTime = timer.elapsed();
+
+		// the same cars with and without barriers
+		World worlds[2];
+		std::vector<std::unique_ptr<Car>> cars[2];
+		for(int w = 0; w < 2; w++)
+			add_cars_on_track(&carconf, &worlds[w], &track, num, cars[w]);
+		ContactResolver resolver(10);
+		std::vector<ContactManifold> manifolds;
+		std::vector<ContactManifold> expected;
+		double treeTime = 0.0;
+		double linearTime = 0.0;
+		double resolveTime = 0.0;
+		unsigned long numManifolds = 0;
+		unsigned int mismatches = 0;
+		for(unsigned int i = 0; i < steps; i++) {
+			for(int w = 0; w < 2; w++) {
+				worlds[w].startFrame();
+				worlds[w].runPhysics(timestep);
+			}
+
+			manifolds.clear();
+			timer.reset();
+			for(auto& car : cars[1]) {
+				tree.generateContacts(car->getBody(),
+						Vector2(car->getWidth(), car->getLength()) * 0.5f,
+						manifolds, 0.3, 0.2);
+			}
+			treeTime += timer.elapsed();
+			numManifolds += manifolds.size();
+
+			// testing every barrier finds the same contacts
+			expected.clear();
+			timer.reset();
+			for(auto& car : cars[1]) {
+				ContactManifold m;
+				m.Bodies[0] = car->getBody();
+				m.Bodies[1] = nullptr;
+				OrientedBox box = getBodyBox(car->getBody(),
+						Vector2(car->getWidth(), car->getLength()) * 0.5f);
+				for(unsigned int j = 0; j < tree.getNumBarriers(); j++) {
+					if(collideBoxBarrier(box, tree.getBarrier(j), j, m))
+						expected.push_back(m);
+				}
+			}
+			linearTime += timer.elapsed();
+			if(expected.size() != manifolds.size())
+				mismatches++;
+
+			if(!manifolds.empty()) {
+				timer.reset();
+				resolver.resolveContacts(&manifolds[0], manifolds.size(), timestep);
+				resolveTime += timer.elapsed();
+			}
+		}
+
+		// off the track further than the runoff and half a car
+		unsigned int escaped[2] = {0, 0};
+		for(int w = 0; w < 2; w++) {
+			for(auto& car : cars[w]) {
+				if(track.exactDistanceToEdge(car->getPosition()) < -runoff - carconf.Length * 0.5f)
+					escaped[w]++;
+			}
+		}
+
+		std::cout << track.getTrackSegments().size() << " segments, " <<
+			tree.getNumBarriers() << " barriers built in " << buildTime * 1000.0 <<
+			" ms, " << num << " cars, " << steps << " steps: " <<
+			numManifolds / double(steps) << " contacts per step, tree " <<
+			treeTime * 1.0e9 / (steps * num) << " ns/car/step, all barriers " <<
+			linearTime * 1.0e9 / (steps * num) << " ns/car/step, resolver " <<
+			resolveTime * 1.0e6 / steps << " us/step; mismatching steps " << mismatches <<
+			"; off the track " << escaped[0] << " cars without barriers, " <<
+			escaped[1] << " with\n";
+	}
+}
+
+
+// Steps the cars for a second at the given rate with contacts between
+// them and against the barriers of the track, if any, and with
+// continuous collision detection if asked. Counts the cars that get
+// further off the track than the barriers and half a car. Returns the
+// wall time of the steps.
+static double run_ccd_second(World* world, const std::vector<std::unique_ptr<Car>>& cars,
+		const Track* track, const BarrierTree* tree, float runoff,
+		bool continuous, unsigned int rate, unsigned int& escaped)
+{
+	Broadphase broadphase;
+	for(auto& car : cars)
+		broadphase.addProxy(car->getBody(), Vector2(car->getWidth(), car->getLength()) * 0.5f);
+	ContactResolver resolver(10);
+	std::vector<ContactManifold> manifolds;
+	std::vector<Real> times;
+	std::vector<bool> off(cars.size(), false);
+	double elapsed = 0.0;
+	for(unsigned int i = 0; i < rate; i++) {
+		BenchTimer timer;
+		if(continuous)
+			broadphase.startStep();
+		world->startFrame();
+		world->runPhysics(1.0 / rate);
+		broadphase.update();
+		if(continuous) {
+			broadphase.findTimesOfImpact(times);
+			for(unsigned int j = 0; j < cars.size(); j++) {
+				SweptBox sweep = broadphase.getSweep(j);
+				Real toi;
+				if(tree && tree->timeOfImpact(sweep, toi))
+					times[j] = std::min(times[j], toi);
+				if(times[j] < 1.0)
+					moveBodyAlongSweep(cars[j]->getBody(), sweep, times[j]);
+			}
+		}
+
+		manifolds.clear();
+		broadphase.generateContacts(manifolds, 0.3, 0.2);
+		if(tree) {
+			for(auto& car : cars) {
+				tree->generateContacts(car->getBody(),
+						Vector2(car->getWidth(), car->getLength()) * 0.5f,
+						manifolds, 0.3, 0.2);
+			}
+		}
+		if(!manifolds.empty())
+			resolver.resolveContacts(&manifolds[0], manifolds.size(), 1.0 / rate);
+		elapsed += timer.elapsed();
+
+		if(track) {
+			for(unsigned int j = 0; j < cars.size(); j++) {
+				if(track->exactDistanceToEdge(cars[j]->getPosition()) <
+						-runoff - cars[j]->getWidth() * 0.5f)
+					off[j] = true;
+			}
+		}
+	}
+	escaped = std::count(off.begin(), off.end(), true);
+	return elapsed;
+}
+
+void bench_physics_ccd()
+{
+	// flat out, about 330 km/h
+	const float speed = 92.0f;
+	const float runoff = 2.0f;
+	const unsigned int numCars = 100;
+	const unsigned int numPairs = 50;
+	CarConfig carconf = Car::readCarConfig("share/cars/formula.conf");
+	TrackGenerator gen(1000);
+	auto tc = gen.generate(1000);
+	Track track(&tc);
+	BarrierTree tree(TrackBarriers(&track, runoff).Barriers);
+	const auto& segments = track.getTrackSegments();
+
+	struct Mode {
+		bool Continuous;
+		unsigned int Rate;
+	};
+	for(const Mode& mode : {Mode{true, 30}, Mode{false, 30}, Mode{false, 60},
+			Mode{false, 120}, Mode{false, 240}, Mode{false, 480}}) {
+		// cars heading into the barriers at 70 degrees off the
+		// track, to both sides, starting at different distances
+		// from them so that they hit at any point of a step
+		World trackWorld;
+		std::vector<std::unique_ptr<Car>> trackCars;
+		for(unsigned int i = 0; i < numCars; i++) {
+			auto line = segments[i * segments.size() / numCars]->getCenterLine();
+			Vector2 dir = (line[1] - line[0]).normalized();
+			float angle = (i & 1) ? 1.22f : -1.22f;
+			dir = Vector2(dir.x * cos(angle) - dir.y * sin(angle),
+					dir.x * sin(angle) + dir.y * cos(angle));
+			trackCars.emplace_back(new Car(&carconf, &trackWorld, &track));
+			Car* car = trackCars.back().get();
+			car->setPosition(line[0] + dir * ((i % 16) * 0.2f - 1.6f));
+			car->getBody()->setOrientation(dir);
+			car->setVelocity(dir * speed);
+		}
+		unsigned int escaped;
+		double trackTime = run_ccd_second(&trackWorld, trackCars, &track, &tree, runoff,
+				mode.Continuous, mode.Rate, escaped);
+
+		// pairs of cars head on, a little off centre
+		World pairWorld;
+		std::vector<std::unique_ptr<Car>> pairCars;
+		for(unsigned int i = 0; i < numPairs; i++) {
+			for(int k = 0; k < 2; k++) {
+				pairCars.emplace_back(new Car(&carconf, &pairWorld, nullptr));
+				Car* car = pairCars.back().get();
+				Vector2 dir(k ? -1.0f : 1.0f, 0.0f);
+				car->setPosition(Vector2(k ? 30.0f + (i % 7) : 0.0f,
+							i * 10.0f + (k ? (i % 5) * 0.3f : 0.0f)));
+				car->getBody()->setOrientation(dir);
+				car->setVelocity(dir * speed);
+			}
+		}
+		unsigned int unused;
+		double pairTime = run_ccd_second(&pairWorld, pairCars, nullptr, nullptr, 0.0f,
+				mode.Continuous, mode.Rate, unused);
+		unsigned int passed = 0;
+		for(unsigned int i = 0; i < numPairs; i++) {
+			if(pairCars[i * 2]->getPosition().x > pairCars[i * 2 + 1]->getPosition().x)
+				passed++;
+		}
+
+		std::cout << (mode.Continuous ? "continuous " : "discrete ") << mode.Rate <<
+			" Hz: " << escaped << " of " << numCars << " cars through the barriers in " <<
+			trackTime * 1000.0 << " ms, " << passed << " of " << numPairs <<
+			" head on pairs through each other in " << pairTime * 1000.0 <<
+			" ms per simulated second\n";
+	}
+}
+
+
+// The resolver before the heap: a pass over all the contacts to find
+// the one to resolve and another to update the penetrations, per
+// iteration.
+static unsigned int resolve_particle_contacts_by_scanning(ParticleContact* contacts,
+		unsigned int num, Real duration, unsigned int iterations)
+{
+	unsigned int used = 0;
+	while(used < iterations) {
+		Real minV = HUGE_VAL;
+		unsigned int minIndex = num;
+		for(unsigned int i = 0; i < num; i++) {
+			Real sepVel = contacts[i].calculateSeparatingVelocity();
+			if(sepVel < minV && !contacts[i].isResolved()) {
+				minV = sepVel;
+				minIndex = i;
+			}
+		}
+		if(minIndex == num)
+			break;
+
+		ParticleContact& c = contacts[minIndex];
+		c.resolve(duration);
+		used++;
+		for(unsigned int i = 0; i < num; i++) {
+			ParticleContact& o = contacts[i];
+			if(&o == &c)
+				continue;
+			for(int k = 0; k < 2; k++) {
+				if(!c.particles[k])
+					continue;
+				if(o.particles[0] == c.particles[k])
+					o.penetration -= c.particleMovement[k].dot(o.contactNormal);
+				if(o.particles[1] == c.particles[k])
+					o.penetration += c.particleMovement[k].dot(o.contactNormal);
+			}
+		}
+	}
+	return used;
+}
+
+// A square net of particles half a metre apart, joined by rods to
+// their neighbours, thrown up a little at random like debris.
+static void make_particle_net(unsigned int side, std::vector<Particle>& particles,
+		std::vector<ParticleRod>& rods)
+{
+	std::mt19937 gen(side);
+	std::uniform_real_distribution<float> dis(-1.0f, 1.0f);
+	particles.resize(side * side);
+	for(unsigned int i = 0; i < side * side; i++) {
+		Particle& p = particles[i];
+		float x = (i % side) * 0.5f;
+		p.position = Vector2(x, 1.0f + x * 0.1f);
+		p.velocity = Vector2(dis(gen), dis(gen) + 2.0f);
+		p.acceleration = Vector2(0.0f, -9.81f);
+		p.damping = 0.99;
+		p.inverseMass = 1.0;
+	}
+	for(unsigned int i = 0; i < side * side; i++) {
+		unsigned int neighbours[2] = {i + 1, i + side};
+		for(int k = 0; k < 2; k++) {
+			if((k == 0 && (i + 1) % side == 0) || neighbours[k] >= side * side)
+				continue;
+			ParticleRod rod;
+			rod.particles[0] = &particles[i];
+			rod.particles[1] = &particles[neighbours[k]];
+			rod.length = 0.5;
+			rods.push_back(rod);
+		}
+	}
+}
+
+static void fill_particle_contacts(std::vector<Particle>& particles,
+		const std::vector<ParticleRod>& rods, std::vector<ParticleContact>& contacts)
+{
+	contacts.clear();
+	ParticleContact c;
+	for(const auto& rod : rods) {
+		if(rod.fillContact(&c, 1))
+			contacts.push_back(c);
+	}
+	for(auto& p : particles) {
+		if(p.position.y >= 0.0f)
+			continue;
+		c.particles[0] = &p;
+		c.particles[1] = nullptr;
+		c.contactNormal = Vector2(0.0f, 1.0f);
+		c.penetration = -p.position.y;
+		c.restitution = 0.3;
+		contacts.push_back(c);
+	}
+}
+
+void bench_physics_particles()
+{
+	const Real timestep = 0.01;
+	for(unsigned int side : {16, 64, 128}) {
+		// the same net for both resolvers
+		std::vector<Particle> particles[2];
+		std::vector<ParticleRod> rods[2];
+		for(int r = 0; r < 2; r++)
+			make_particle_net(side, particles[r], rods[r]);
+		unsigned int frames = 25600 / (side * side) + 1;
+		ParticleContactResolver resolver(0);
+		std::vector<ParticleContact> contacts;
+		double times[2] = {0.0, 0.0};
+		unsigned long numContacts = 0;
+		unsigned long iterations[2] = {0, 0};
+		for(unsigned int i = 0; i < frames; i++) {
+			for(int r = 0; r < 2; r++) {
+				for(auto& p : particles[r])
+					p.integrate(timestep);
+				fill_particle_contacts(particles[r], rods[r], contacts);
+				// as many iterations as contacts
+				unsigned int num = contacts.size();
+				BenchTimer timer;
+				if(r == 0) {
+					iterations[r] += resolve_particle_contacts_by_scanning(&contacts[0],
+							num, timestep, num);
+				} else {
+					resolver.setIterations(num);
+					resolver.resolveContacts(&contacts[0], num, timestep);
+					iterations[r] += resolver.getIterationsUsed();
+				}
+				times[r] += timer.elapsed();
+				numContacts += num;
+			}
+		}
+
+		float maxDifference = 0.0f;
+		for(unsigned int i = 0; i < particles[0].size(); i++) {
+			maxDifference = std::max(maxDifference,
+					(particles[0][i].position - particles[1][i].position).length());
+		}
+		std::cout << side * side << " particles, " << frames << " frames: " <<
+			numContacts / (2 * frames) << " contacts and " <<
+			iterations[1] / frames << " iterations per frame, scanning " <<
+			times[0] * 1.0e6 / frames << " us/frame, heap " <<
+			times[1] * 1.0e6 / frames << " us/frame; iterations differ by " <<
+			long(iterations[0] - iterations[1]) << ", positions by " << maxDifference << "\n";
+	}
+}
+
@@ -0,0 +1,567 @@
+#include <iostream>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+
+#include <jsoncpp/json/json.h>
+
+#include "common/Vector2.h"
+#include "common/Math.h"
+
+#include "scr/Track.h"
+#include "scr/TrackImage.h"
+#include "scr/TrackGenerator.h"
+#include "scr/TrackMesh.h"
+
+#include "Bench.h"
+
+using namespace Common;
+
+static TrackConfig::TSInfo curve(float offx, float offy, float dirx, float diry)
+{
+	TrackConfig::TSInfo info;
+	info.Type = TrackConfig::TSType::Curve;
+	info.Info.CurveInfo.endOffset_x = offx;
+	info.Info.CurveInfo.endOffset_y = offy;
+	info.Info.CurveInfo.endPosition_x = 0.0f;
+	info.Info.CurveInfo.endPosition_y = 0.0f;
+	info.Info.CurveInfo.endDirection_x = dirx;
+	info.Info.CurveInfo.endDirection_y = diry;
+	return info;
+}
+
+// A closed track of two long wiggly straights joined by hairpins,
+// 8 * wiggles + 4 segments in total.
+static TrackConfig wiggle_track(int wiggles)
+{
+	TrackConfig tc;
+	tc.Width = 8.0f;
+	for(int i = 0; i < wiggles; i++) {
+		tc.Segments.push_back(curve(20.0f, 2.0f, 1.0f, 0.2f));
+		tc.Segments.push_back(curve(20.0f, 2.0f, 1.0f, 0.0f));
+		tc.Segments.push_back(curve(20.0f, -2.0f, 1.0f, -0.2f));
+		tc.Segments.push_back(curve(20.0f, -2.0f, 1.0f, 0.0f));
+	}
+	tc.Segments.push_back(curve(50.0f, 50.0f, 0.0f, 1.0f));
+	tc.Segments.push_back(curve(-50.0f, 50.0f, -1.0f, 0.0f));
+	for(int i = 0; i < wiggles; i++) {
+		tc.Segments.push_back(curve(-20.0f, -2.0f, -1.0f, -0.2f));
+		tc.Segments.push_back(curve(-20.0f, -2.0f, -1.0f, 0.0f));
+		tc.Segments.push_back(curve(-20.0f, 2.0f, -1.0f, 0.2f));
+		tc.Segments.push_back(curve(-20.0f, 2.0f, -1.0f, 0.0f));
+	}
+	tc.Segments.push_back(curve(-50.0f, -50.0f, 0.0f, -1.0f));
+	tc.Segments.push_back(curve(50.0f, -50.0f, 1.0f, 0.0f));
+	return tc;
+}
+
+static void write_track_config(const TrackConfig& tc, const char* filename)
+{
+	Json::Value root;
+	root["width"] = tc.Width;
+	Json::Value& segs = root["segments"];
+	for(const auto& info : tc.Segments) {
+		Json::Value seg;
+		if(info.Type == TrackConfig::TSType::Straight) {
+			seg["type"] = "straight";
+			seg["length"] = info.Info.StraightInfo.Length;
+		} else {
+			const auto& ci = info.Info.CurveInfo;
+			seg["type"] = "curve";
+			seg["endOffset"][0u] = ci.endOffset_x;
+			seg["endOffset"][1u] = ci.endOffset_y;
+			seg["endPosition"][0u] = ci.endPosition_x;
+			seg["endPosition"][1u] = ci.endPosition_y;
+			seg["endDirection"][0u] = ci.endDirection_x;
+			seg["endDirection"][1u] = ci.endDirection_y;
+		}
+		segs.append(seg);
+	}
+	Json::StyledWriter writer;
+	std::ofstream out(filename);
+	out << writer.write(root);
+}
+
+// Points close to the track so that most of them hit non-empty cells.
+static std::vector<Vector2> query_points(const Track& t, unsigned int num)
+{
+	std::mt19937 gen(1234);
+	const auto& segs = t.getTrackSegments();
+	std::uniform_int_distribution<size_t> segdist(0, segs.size() - 1);
+	std::uniform_real_distribution<float> offdist(-10.0f, 10.0f);
+	std::vector<Vector2> ret;
+	for(unsigned int i = 0; i < num; i++) {
+		auto line = segs[segdist(gen)]->getCenterLine();
+		std::uniform_int_distribution<size_t> ptdist(0, line.size() - 1);
+		ret.push_back(line[ptdist(gen)] + Vector2(offdist(gen), offdist(gen)));
+	}
+	return ret;
+}
+
+// Positions of a point driving around the track in steps of about
+// step meters, weaving from side to side.
+static std::vector<Vector2> lap_points(const Track& t, float step)
+{
+	std::vector<Vector2> ret;
+	float dist = 0.0f;
+	for(auto s : t.getTrackSegments()) {
+		float len = s->getLength();
+		auto line = s->getCenterLine();
+		auto c = dynamic_cast<const CurveSegment*>(s);
+		for(float f = 0.0f; f < len; f += step) {
+			// follow the exact curve rather than its center line so
+			// that the path doesn't depend on the tessellation
+			float u = f / len;
+			Vector2 pt = c ? c->pointOnCurve(u) : line.front() + (line.back() - line.front()) * u;
+			Vector2 dir = c ? c->directionOnCurve(u) : (line.back() - line.front()).normalized();
+			Vector2 normal(-dir.y, dir.x);
+			float offset = 3.5f * sin(dist * 0.01f);
+			ret.push_back(pt + normal * offset);
+			dist += step;
+		}
+	}
+	return ret;
+}
+
+void bench_track_queries()
+{
+	for(int wiggles : {8, 64, 256, 1024}) {
+		auto tc = wiggle_track(wiggles);
+		Track t(&tc);
+		auto points = query_points(t, 20000);
+
+		BenchTimer timer;
+		unsigned int linearHits = 0;
+		unsigned int linearQueries = 0;
+		for(const auto& p : points) {
+			for(auto s : t.getTrackSegments()) {
+				if(s->onTrack(p)) {
+					linearHits++;
+					break;
+				}
+			}
+			linearQueries++;
+			if(timer.elapsed() > 2.0)
+				break;
+		}
+		double linearTime = timer.elapsed();
+
+		timer.reset();
+		unsigned int indexHits = 0;
+		unsigned int indexHitsCompared = 0;
+		for(unsigned int i = 0; i < points.size(); i++) {
+			if(t.onTrack(points[i])) {
+				indexHits++;
+				if(i < linearQueries)
+					indexHitsCompared++;
+			}
+		}
+		double indexTime = timer.elapsed();
+
+		std::cout << t.getTrackSegments().size() << " segments: linear scan " <<
+			linearTime * 1.0e9 / linearQueries << " ns/query, index " <<
+			indexTime * 1.0e9 / points.size() << " ns/query (" <<
+			indexHits << "/" << points.size() << " on track)\n";
+		if(linearHits != indexHitsCompared) {
+			std::cout << "Mismatch: linear scan found " << linearHits <<
+				" points on track, index " << indexHitsCompared << "\n";
+		}
+	}
+}
+
+void bench_track_distance_field()
+{
+	auto tc = wiggle_track(256);
+	Track t(&tc);
+	auto points = query_points(t, 200000);
+
+	std::vector<float> exact;
+	BenchTimer timer;
+	for(const auto& p : points)
+		exact.push_back(t.exactDistanceToEdge(p));
+	double exactTime = timer.elapsed();
+
+	for(float cellsize : {2.0f, 1.0f}) {
+		timer.reset();
+		t.bakeDistanceField(cellsize);
+		double bakeTime = timer.elapsed();
+
+		const char* filename = "/tmp/somecoolracing-bench.sdf";
+		t.saveDistanceField(filename);
+		timer.reset();
+		bool loaded = t.loadDistanceField(filename);
+		double loadTime = timer.elapsed();
+		remove(filename);
+		if(!loaded) {
+			std::cout << "Failed to reload the distance field.\n";
+			continue;
+		}
+
+		timer.reset();
+		unsigned int mismatches = 0;
+		float maxError = 0.0f;
+		for(unsigned int i = 0; i < points.size(); i++) {
+			float d = t.distanceToEdge(points[i]);
+			if((d > 0.0f) != (exact[i] > 0.0f))
+				mismatches++;
+			// only the edge region matters for onTrack()
+			if(fabs(exact[i]) < 2.0f)
+				maxError = std::max<float>(maxError, fabs(d - exact[i]));
+		}
+		double fieldTime = timer.elapsed();
+
+		std::cout << "Cell size " << cellsize << " m: bake " << bakeTime <<
+			" s, load " << loadTime << " s, lookup " <<
+			fieldTime * 1.0e9 / points.size() << " ns/query vs exact " <<
+			exactTime * 1.0e9 / points.size() << " ns/query; " <<
+			"max edge error " << maxError << " m, onTrack mismatches " <<
+			mismatches << "/" << points.size() << "\n";
+	}
+}
+
+void bench_track_hints()
+{
+	for(int wiggles : {8, 1024}) {
+		auto tc = wiggle_track(wiggles);
+		Track t(&tc);
+		auto points = lap_points(t, 0.5f);
+
+		BenchTimer timer;
+		std::vector<bool> plain;
+		for(const auto& p : points)
+			plain.push_back(t.onTrack(p));
+		double plainTime = timer.elapsed();
+
+		TrackQueryHint hint;
+		unsigned int mismatches = 0;
+		timer.reset();
+		for(unsigned int i = 0; i < points.size(); i++) {
+			if(t.onTrack(points[i], hint) != plain[i])
+				mismatches++;
+		}
+		double hintTime = timer.elapsed();
+
+		const auto& stats = hint.Stats;
+		std::cout << t.getTrackSegments().size() << " segments, " <<
+			points.size() << " steps: plain " <<
+			plainTime * 1.0e9 / points.size() << " ns/query, hinted " <<
+			hintTime * 1.0e9 / points.size() << " ns/query; " <<
+			"hint hits " << stats.Hits << ", neighbour hits " <<
+			stats.NeighbourHits << ", fallbacks " << stats.Fallbacks <<
+			" (hit rate " << 100.0 * (stats.Hits + stats.NeighbourHits) / points.size() <<
+			" %), mismatches " << mismatches << "\n";
+	}
+}
+
+void bench_curve_distance()
+{
+	std::mt19937 gen(1234);
+	std::uniform_real_distribution<float> tdist(0.0f, 1.0f);
+	std::uniform_real_distribution<float> offdist(-10.0f, 10.0f);
+
+	for(float radius : {10.0f, 50.0f, 200.0f, 1000.0f, 5000.0f}) {
+		CurveSegment curve(Vector2(0.0f, 0.0f), Vector2(1.0f, 0.0f),
+				Vector2(radius, radius), Vector2(0.0f, 1.0f), 8.0f, 0.05f);
+		auto line = curve.getCenterLine();
+
+		std::vector<Vector2> points;
+		for(int i = 0; i < 100000; i++)
+			points.push_back(curve.pointOnCurve(tdist(gen)) + Vector2(offdist(gen), offdist(gen)));
+
+		BenchTimer timer;
+		std::vector<float> polyline;
+		for(const auto& p : points) {
+			float best = -1.0f;
+			for(size_t i = 0; i < line.size() - 1; i++) {
+				float d = Math::pointToSegmentDistance(line[i], line[i + 1], p);
+				if(best < 0.0f || d < best)
+					best = d;
+			}
+			polyline.push_back(best);
+		}
+		double polylineTime = timer.elapsed();
+
+		timer.reset();
+		std::vector<float> exact;
+		for(const auto& p : points)
+			exact.push_back(curve.distance(p));
+		double exactTime = timer.elapsed();
+
+		// reference by dense sampling for a subset of the points
+		float polylineError = 0.0f;
+		float exactError = 0.0f;
+		for(unsigned int i = 0; i < points.size(); i++) {
+			polylineError = std::max<float>(polylineError, fabs(polyline[i] - exact[i]));
+			if(i % 100)
+				continue;
+			float ref = -1.0f;
+			for(int j = 0; j <= 20000; j++) {
+				float d = curve.pointOnCurve(j / 20000.0f).distance(points[i]);
+				if(ref < 0.0f || d < ref)
+					ref = d;
+			}
+			exactError = std::max<float>(exactError, exact[i] - ref);
+		}
+
+		std::cout << "Curve length " << curve.getLength() << " m, " <<
+			line.size() - 1 << " pieces: polyline " <<
+			polylineTime * 1.0e9 / points.size() << " ns/query, closed form " <<
+			exactTime * 1.0e9 / points.size() << " ns/query; " <<
+			"polyline error " << polylineError << " m, closed form error " <<
+			exactError << " m\n";
+	}
+}
+
+void bench_track_batch()
+{
+	auto tc = wiggle_track(256);
+	Track t(&tc);
+	const unsigned int total = 1 << 18;
+	auto points = query_points(t, total);
+	auto lap = lap_points(t, 0.5f);
+
+	for(unsigned int batch : {1, 4, 64, 4096}) {
+		std::vector<uint8_t> single(total);
+		BenchTimer timer;
+		for(unsigned int i = 0; i < total; i++)
+			single[i] = t.onTrack(points[i]);
+		double singleTime = timer.elapsed();
+
+		std::vector<uint8_t> batched(total);
+		timer.reset();
+		for(unsigned int i = 0; i < total; i += batch)
+			t.onTrackBatch(&points[i], batch, &batched[i]);
+		double batchTime = timer.elapsed();
+
+		unsigned int mismatches = 0;
+		for(unsigned int i = 0; i < total; i++)
+			if(single[i] != batched[i])
+				mismatches++;
+
+		// coherent points with hints: batch cars spread around the
+		// track, each moving along the lap
+		std::vector<TrackQueryHint> hints(batch);
+		std::vector<Vector2> cars(batch);
+		std::vector<uint8_t> out(batch);
+		unsigned int steps = 0;
+		timer.reset();
+		for(unsigned int step = 0; steps < total; step++) {
+			for(unsigned int j = 0; j < batch; j++)
+				cars[j] = lap[(step + j * (lap.size() / batch)) % lap.size()];
+			t.onTrackBatch(&cars[0], batch, &out[0], &hints[0]);
+			steps += batch;
+		}
+		double hintTime = timer.elapsed();
+
+		std::cout << "Batch of " << batch << ": onTrack " <<
+			singleTime * 1.0e9 / total << " ns/point, onTrackBatch " <<
+			batchTime * 1.0e9 / total << " ns/point, with hints " <<
+			hintTime * 1.0e9 / steps << " ns/point; mismatches " <<
+			mismatches << "\n";
+	}
+}
+
+void bench_track_position()
+{
+	for(int wiggles : {8, 256}) {
+		auto tc = wiggle_track(wiggles);
+		Track t(&tc);
+		auto lap = lap_points(t, 0.5f);
+
+		// two laps, incrementally
+		TrackPosition tp;
+		std::vector<TrackPosition> incremental;
+		BenchTimer timer;
+		for(int i = 0; i < 2; i++) {
+			for(const auto& p : lap) {
+				t.updatePosition(p, tp);
+				incremental.push_back(tp);
+			}
+		}
+		double incrementalTime = timer.elapsed();
+
+		timer.reset();
+		unsigned int scratchSteps = 0;
+		std::vector<TrackPosition> scratch;
+		for(const auto& p : lap) {
+			scratch.push_back(t.findPosition(p));
+			scratchSteps++;
+			if(timer.elapsed() > 2.0)
+				break;
+		}
+		double scratchTime = timer.elapsed();
+
+		unsigned int mismatches = 0;
+		unsigned int backwards = 0;
+		float prevS = -1.0f;
+		for(unsigned int i = 0; i < incremental.size(); i++) {
+			const auto& a = incremental[i];
+			float s = a.Lap * t.getLength() + a.S;
+			// the test points wobble a bit at the corners of the center line
+			if(s < prevS - 0.1f)
+				backwards++;
+			prevS = s;
+			if(i < scratchSteps) {
+				const auto& b = scratch[i];
+				if(fabs(a.S - b.S) > 0.01f || fabs(a.D - b.D) > 0.01f)
+					mismatches++;
+			}
+		}
+
+		std::cout << t.getTrackSegments().size() << " segments: incremental " <<
+			incrementalTime * 1.0e9 / incremental.size() << " ns/step, from scratch " <<
+			scratchTime * 1.0e9 / scratchSteps << " ns/step; laps " <<
+			incremental.back().Lap << ", backward steps " << backwards <<
+			", mismatches " << mismatches << "/" << scratchSteps << "\n";
+	}
+}
+
+void bench_track_load()
+{
+	const char* configfile = "/tmp/somecoolracing-bench.conf";
+	const char* imagefile = "/tmp/somecoolracing-bench.track";
+
+	for(int wiggles : {8, 256, 2048}) {
+		auto tc = wiggle_track(wiggles);
+		write_track_config(tc, configfile);
+
+		BenchTimer timer;
+		auto readConfig = Track::readTrackConfig(configfile);
+		Track built(&readConfig);
+		double buildTime = timer.elapsed();
+
+		timer.reset();
+		TrackImage::write(built, imagefile);
+		double writeTime = timer.elapsed();
+
+		timer.reset();
+		Track loaded(new TrackImage(imagefile));
+		double loadTime = timer.elapsed();
+
+		unsigned int mismatches = 0;
+		for(const auto& p : query_points(built, 10000)) {
+			if(built.onTrack(p) != loaded.onTrack(p))
+				mismatches++;
+			TrackPosition a = built.findPosition(p);
+			TrackPosition b = loaded.findPosition(p);
+			if(a.Segment != b.Segment || a.S != b.S || a.D != b.D)
+				mismatches++;
+		}
+		for(unsigned int i = 0; i < built.getTrackSegments().size(); i++) {
+			unsigned int n1, n2;
+			built.getTriangleStrip(i, n1);
+			loaded.getTriangleStrip(i, n2);
+			if(n1 != n2)
+				mismatches++;
+		}
+
+		std::ifstream image(imagefile, std::ifstream::binary | std::ifstream::ate);
+		std::cout << built.getTrackSegments().size() << " segments: config " <<
+			buildTime * 1000.0 << " ms, image " << loadTime * 1000.0 <<
+			" ms (" << image.tellg() / 1024 << " kB, written in " <<
+			writeTime * 1000.0 << " ms); mismatches " << mismatches << "\n";
+	}
+
+	remove(configfile);
+	remove(imagefile);
+}
+
+// Max distance of the exact curve edges from the triangle strip edges.
+static float max_edge_error(const Track& t)
+{
+	float maxErr = 0.0f;
+	const auto& segs = t.getTrackSegments();
+	for(unsigned int i = 0; i < segs.size(); i++) {
+		auto c = dynamic_cast<const CurveSegment*>(segs[i]);
+		if(!c)
+			continue;
+		unsigned int num;
+		const Vector2* strip = t.getTriangleStrip(i, num);
+		for(int j = 0; j <= 64; j++) {
+			float u = j / 64.0f;
+			Vector2 pc = c->pointOnCurve(u);
+			Vector2 n = Math::rotate2D(c->directionOnCurve(u), HALF_PI) * c->getWidth() * 0.5f;
+			for(int side = 0; side < 2; side++) {
+				Vector2 edge = side ? pc - n : pc + n;
+				float best = -1.0f;
+				for(unsigned int k = side; k + 2 < num; k += 2) {
+					float d = Math::pointToSegmentDistance(strip[k], strip[k + 2], edge);
+					if(best < 0.0f || d < best)
+						best = d;
+				}
+				maxErr = std::max(maxErr, best);
+			}
+		}
+	}
+	return maxErr;
+}
+
+void bench_track_tessellation()
+{
+	for(float tolerance : {0.2f, 0.05f, 0.01f}) {
+		auto tc = wiggle_track(256);
+		tc.Tolerance = tolerance;
+		Track t(&tc);
+
+		// the previous fixed count of 5 + sqrt(length) vertices per curve
+		unsigned int vertices = 0;
+		unsigned int fixedVertices = 0;
+		for(auto s : t.getTrackSegments()) {
+			vertices += s->getCenterLine().size();
+			fixedVertices += 5 + sqrt(s->getLength());
+		}
+
+		auto pts = query_points(t, 200000);
+		unsigned int hits = 0;
+		BenchTimer timer;
+		for(const auto& p : pts)
+			hits += t.onTrack(p);
+		double queryTime = timer.elapsed();
+
+		std::cout << "Tolerance " << tolerance << " m: " << vertices <<
+			" vertices (fixed count " << fixedVertices << "), max edge error " <<
+			max_edge_error(t) << " m, onTrack " << queryTime * 1.0e9 / pts.size() <<
+			" ns/query (" << hits << " on track)\n";
+	}
+}
+
+void bench_track_stress()
+{
+	for(unsigned int size : {1000, 10000, 100000}) {
+		BenchTimer timer;
+		TrackGenerator gen(size);
+		auto tc = gen.generate(size);
+		double generateTime = timer.elapsed();
+
+		timer.reset();
+		Track t(&tc);
+		double buildTime = timer.elapsed();
+		size_t memory = t.getMemoryUsage() / 1024;
+
+		auto pts = query_points(t, 200000);
+		unsigned int hits = 0;
+		timer.reset();
+		for(const auto& p : pts)
+			hits += t.onTrack(p);
+		double queryTime = timer.elapsed();
+
+		std::vector<uint8_t> out(pts.size());
+		timer.reset();
+		t.onTrackBatch(&pts[0], pts.size(), &out[0]);
+		double batchTime = timer.elapsed();
+
+		timer.reset();
+		TrackMesh mesh(&t);
+		double meshTime = timer.elapsed();
+
+		std::cout << t.getTrackSegments().size() << " segments, " << t.getLength() / 1000.0 <<
+			" km: generated in " << generateTime * 1000.0 << " ms, built in " <<
+			buildTime * 1000.0 << " ms using " << memory << " kB; onTrack " <<
+			pts.size() / queryTime * 1.0e-6 << " M/s, onTrackBatch " <<
+			pts.size() / batchTime * 1.0e-6 << " M/s (" << hits << " on track); mesh of " <<
+			mesh.StripStart.back() << " vertices in " << meshTime * 1000.0 << " ms\n";
+	}
+}
@@ -0,0 +1,80 @@
+#include <iostream>
+#include <cstring>
+
+#include "Bench.h"
+
+struct Benchmark {
+	const char* Name;
+	void (*Function)();
+};
+
+static const Benchmark benchmarks[] = {
+	{"track-queries", bench_track_queries},
+	{"track-distance-field", bench_track_distance_field},
+	{"track-hints", bench_track_hints},
+	{"curve-distance", bench_curve_distance},
+	{"track-batch", bench_track_batch},
+	{"track-position", bench_track_position},
+	{"track-load", bench_track_load},
+	{"track-tessellation", bench_track_tessellation},
+	{"track-stress", bench_track_stress},
+	{"physics-step", bench_physics_step},
+	{"physics-integrate", bench_physics_integrate},
+	{"physics-threads", bench_physics_threads},
+	{"physics-forces", bench_physics_forces},
+	{"physics-adaptive", bench_physics_adaptive},
+	{"physics-sleep", bench_physics_sleep},
+	{"physics-churn", bench_physics_churn},
+	{"physics-broadphase", bench_physics_broadphase},
+	{"physics-contacts", bench_physics_contacts},
+	{"physics-barriers", bench_physics_barriers},
+	{"physics-ccd", bench_physics_ccd},
+	{"physics-particles", bench_physics_particles},
+};
+
+BenchTimer::BenchTimer()
+{
+	reset();
+}
+
+void BenchTimer::reset()
+{
+	mStart = std::chrono::steady_clock::now();
+}
+
+double BenchTimer::elapsed() const
+{
+	std::chrono::duration<double> d = std::chrono::steady_clock::now() - mStart;
+	return d.count();
+}
+
+int main(int argc, char** argv)
+{
+	if(argc < 2) {
+		for(const auto& b : benchmarks) {
+			std::cout << "=== " << b.Name << "\n";
+			b.Function();
+		}
+		return 0;
+	}
+
+	for(int i = 1; i < argc; i++) {
+		bool found = false;
+		for(const auto& b : benchmarks) {
+			if(!strcmp(argv[i], b.Name)) {
+				std::cout << "=== " << b.Name << "\n";
+				b.Function();
+				found = true;
+			}
+		}
+		if(!found) {
+			std::cerr << "Unknown benchmark " << argv[i] << ". Available benchmarks:\n";
+			for(const auto& b : benchmarks)
+				std::cerr << "\t" << b.Name << "\n";
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
@@ -12,6 +12,11 @@
 
 using namespace Common;
 
+// the vector rotated by 90 degrees counterclockwise
+static Vector2 perpendicular(const Vector2& v)
+{
+	return Vector2(-v.y, v.x);
+}
 
 TyreForce::TyreForce(const Vector2& attachpos)
 	: mAttachPos(attachpos)
@@ -21,19 +26,21 @@ TyreForce::TyreForce(const Vector2& attachpos)
 void TyreForce::updateForce(Abyss::RigidBody* body, Abyss::Real duration)
 {
 	Vector2 force;
-	Vector2 spinDir = body->orientation;
-	Vector2 tyreDir = Math::rotate2D(spinDir, mAngle);
-	Vector2 velDir = body->velocity.normalized();
-	float speed = body->velocity.length();
+	Vector2 spinDir = body->getOrientation();
+	Vector2 tyreDir(spinDir.x * mAngleCos - spinDir.y * mAngleSin,
+			spinDir.x * mAngleSin + spinDir.y * mAngleCos);
+	Vector2 velocity = body->getVelocity();
+	Vector2 velDir = velocity.normalized();
+	float speed = velocity.length();
 	mLateralAcceleration = 0.0f;
 	if(speed) {
 		// cornering force - lateral
 		auto slipAngle = velDir.cross2d(tyreDir);
 		Vector2 latForce, rollingFriction;
 
-		latForce = Math::rotate2D(tyreDir, HALF_PI);
+		latForce = perpendicular(tyreDir);
 		latForce = latForce * slipAngle * mTyreConfig.mCorneringForceCoefficient;
-		mLateralAcceleration = latForce.length() * body->inverseMass;
+		mLateralAcceleration = latForce.length() * body->getInverseMass();
 
 		// self aligning torque - force in the direction of the tyre
 		Vector2 selfAlign = tyreDir * speed * mTyreConfig.mSelfAligningTorqueCoefficient;
@@ -58,7 +65,7 @@ void TyreForce::updateForce(Abyss::RigidBody* body, Abyss::Real duration)
 	if(!force.null()) {
 		Vector2 lws = body->getPointInWorldSpace(mAttachPos);
 		body->addForceAtPoint(force, lws);
-		mLateralAcceleration = (force.dot(Math::rotate2D(velDir, HALF_PI))) * body->inverseMass;
+		mLateralAcceleration = (force.dot(perpendicular(velDir))) * body->getInverseMass();
 	}
 }
 
@@ -66,7 +73,8 @@ void TyreForce::setAngle(float f)
 {
 	// 0.8f rad = 45 degrees
 	assert(f >= -0.7f && f <= 0.7f);
-	mAngle = f;
+	mAngleCos = cos(f);
+	mAngleSin = sin(f);
 }
 
 void TyreForce::setThrottle(float f)
@@ -103,7 +111,7 @@ DragForce::DragForce(float k1, float k2)
 
 void DragForce::updateForce(Abyss::RigidBody* body, Abyss::Real duration)
 {
-	Vector2 force = body->velocity;
+	Vector2 force = body->getVelocity();
 	Abyss::Real dragCoeff = force.length();
 	dragCoeff = mK1 * dragCoeff + mK2 * dragCoeff * dragCoeff;
 
@@ -116,6 +124,7 @@ Car::Car(const CarConfig* carconf, Abyss::World* world, const Track* track)
 	: mCarConfig(*carconf),
 	mWidth(carconf->Width),
 	mLength(carconf->Length),
+	mRigidBody(world),
 	mPhysicsWorld(world),
 	mLBTyreForce(TyreForce(Vector2(-mWidth * 0.5f, -carconf->Wheelbase * 0.5f))),
 	mRBTyreForce(TyreForce(Vector2(mWidth * 0.5f, -carconf->Wheelbase * 0.5f))),
@@ -126,14 +135,12 @@ Car::Car(const CarConfig* carconf, Abyss::World* world, const Track* track)
 {
 	mRigidBody.setMass(mCarConfig.Mass);
 	mRigidBody.setInertiaTensor(mCarConfig.Mass * (1.0 / 12.0) * ((mWidth * mWidth) + (mLength * mLength)));
-	mRigidBody.angularDamping = mCarConfig.AngularDamping;
+	mRigidBody.setAngularDamping(mCarConfig.AngularDamping);
 
-	mPhysicsWorld->addBody(&mRigidBody);
-	mPhysicsWorld->getForceRegistry()->add(&mRigidBody, &mLBTyreForce);
-	mPhysicsWorld->getForceRegistry()->add(&mRigidBody, &mRBTyreForce);
-	mPhysicsWorld->getForceRegistry()->add(&mRigidBody, &mLFTyreForce);
-	mPhysicsWorld->getForceRegistry()->add(&mRigidBody, &mRFTyreForce);
-	mPhysicsWorld->getForceRegistry()->add(&mRigidBody, &mDragForce);
+	Abyss::ForceGenerator* forces[5] = {&mLBTyreForce, &mRBTyreForce, &mLFTyreForce,
+		&mRFTyreForce, &mDragForce};
+	for(int i = 0; i < 5; i++)
+		mForceRegistrations[i] = mPhysicsWorld->getForceRegistry()->add(&mRigidBody, forces[i]);
 
 	mLBTyreForce.setTyreConfig(mCarConfig.AsphaltTyres);
 	mRBTyreForce.setTyreConfig(mCarConfig.AsphaltTyres);
@@ -143,47 +150,44 @@ Car::Car(const CarConfig* carconf, Abyss::World* world, const Track* track)
 
 Car::~Car()
 {
-	mPhysicsWorld->getForceRegistry()->remove(&mRigidBody, &mLBTyreForce);
-	mPhysicsWorld->getForceRegistry()->remove(&mRigidBody, &mRBTyreForce);
-	mPhysicsWorld->getForceRegistry()->remove(&mRigidBody, &mLFTyreForce);
-	mPhysicsWorld->getForceRegistry()->remove(&mRigidBody, &mRFTyreForce);
-	mPhysicsWorld->getForceRegistry()->remove(&mRigidBody, &mDragForce);
-	mPhysicsWorld->removeBody(&mRigidBody);
+	for(const auto& reg : mForceRegistrations)
+		mPhysicsWorld->getForceRegistry()->remove(reg);
 }
 
-const Common::Vector2& Car::getPosition() const
+Common::Vector2 Car::getPosition() const
 {
-	return mRigidBody.position;
+	return mRigidBody.getPosition();
 }
 
 void Car::setPosition(const Common::Vector2& pos)
 {
-	mRigidBody.position = pos;
+	mRigidBody.setPosition(pos);
 }
 
 void Car::setVelocity(const Common::Vector2& vel)
 {
-	mRigidBody.velocity = vel;
+	mRigidBody.setVelocity(vel);
 }
 
 void Car::setOrientation(float o)
 {
-	mRigidBody.orientation = Common::Math::rotate2D(Vector2(1.0f, 0.0f), o);
+	mRigidBody.setOrientation(Common::Math::rotate2D(Vector2(1.0f, 0.0f), o));
 }
 
 void Car::setAngularVelocity(float o)
 {
-	mRigidBody.rotation = o;
+	mRigidBody.setRotation(o);
 }
 
 float Car::getOrientation() const
 {
-	return atan2(mRigidBody.orientation.x, mRigidBody.orientation.y);
+	Vector2 orientation = mRigidBody.getOrientation();
+	return atan2(orientation.x, orientation.y);
 }
 
 float Car::getSpeed() const
 {
-	return mRigidBody.velocity.length();
+	return mRigidBody.getVelocity().length();
 }
 
 void Car::setThrottle(float value)
@@ -198,6 +202,10 @@ void Car::setThrottle(float value)
 		mLFTyreForce.setThrottle(value * mCarConfig.ThrottleCoefficient);
 		mRFTyreForce.setThrottle(value * mCarConfig.ThrottleCoefficient);
 	}
+
+	// the tyre forces are skipped while the body sleeps
+	if(value > 0.0f)
+		mRigidBody.wake();
 }
 
 Abyss::RigidBody* Car::getBody()
@@ -227,35 +235,32 @@ void Car::setSteering(float value)
 
 void Car::moved()
 {
+	TyreForce* tyres[4] = {&mLBTyreForce, &mRBTyreForce, &mLFTyreForce, &mRFTyreForce};
+	Vector2 wheels[4];
+	for(int i = 0; i < 4; i++)
+		wheels[i] = mRigidBody.getPointInWorldSpace(tyres[i]->getAttachPosition());
+
+	uint8_t onTrack[4];
+	mTrack->onTrackBatch(wheels, 4, onTrack, mWheelTrackHints);
+
 	int offroad = 0;
-	const auto& pos = mRigidBody.position;
-	auto o = -getOrientation();
-	if(mTrack->onTrack(pos + Math::rotate2D(mLBTyreForce.getAttachPosition(), o))) {
-		mLBTyreForce.setTyreConfig(mCarConfig.AsphaltTyres);
-	} else {
-		mLBTyreForce.setTyreConfig(mCarConfig.GrassTyres);
-		offroad++;
-	}
-	if(mTrack->onTrack(pos + Math::rotate2D(mRBTyreForce.getAttachPosition(), o))) {
-		mRBTyreForce.setTyreConfig(mCarConfig.AsphaltTyres);
-	} else {
-		mRBTyreForce.setTyreConfig(mCarConfig.GrassTyres);
-		offroad++;
-	}
-	if(mTrack->onTrack(pos + Math::rotate2D(mLFTyreForce.getAttachPosition(), o))) {
-		mLFTyreForce.setTyreConfig(mCarConfig.AsphaltTyres);
-	} else {
-		mLFTyreForce.setTyreConfig(mCarConfig.GrassTyres);
-		offroad++;
-	}
-	if(mTrack->onTrack(pos + Math::rotate2D(mRFTyreForce.getAttachPosition(), o))) {
-		mRFTyreForce.setTyreConfig(mCarConfig.AsphaltTyres);
-	} else {
-		mRFTyreForce.setTyreConfig(mCarConfig.GrassTyres);
-		offroad++;
+	for(int i = 0; i < 4; i++) {
+		if(onTrack[i]) {
+			tyres[i]->setTyreConfig(mCarConfig.AsphaltTyres);
+		} else {
+			tyres[i]->setTyreConfig(mCarConfig.GrassTyres);
+			offroad++;
+		}
 	}
 
 	mOffroad = offroad == 4;
+
+	mTrack->updatePosition(mRigidBody.getPosition(), mTrackPosition);
+}
+
+const TrackPosition& Car::getTrackPosition() const
+{
+	return mTrackPosition;
 }
 
 bool Car::isOffroad() const
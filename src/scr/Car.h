@@ -14,7 +14,7 @@ struct TyreConfig {
 	float mBrakeCoefficient = 10.0f;
 };
 
-class TyreForce : public Abyss::ForceGenerator {
+class TyreForce : public Abyss::BatchedForceGenerator<TyreForce> {
 	public:
 		TyreForce(const Common::Vector2& attachpos);
 		virtual void updateForce(Abyss::RigidBody* body, Abyss::Real duration) override;
@@ -28,13 +28,14 @@ class TyreForce : public Abyss::ForceGenerator {
 	private:
 		Common::Vector2 mAttachPos;
 		float mThrottle = 0.0f;
-		float mAngle = 0.0f;
+		float mAngleCos = 1.0f; // of the steering angle
+		float mAngleSin = 0.0f;
 		float mBrake = 0.0f;
 		TyreConfig mTyreConfig;
 		float mLateralAcceleration = 0.0f;
 };
 
-class DragForce : public Abyss::ForceGenerator {
+class DragForce : public Abyss::BatchedForceGenerator<DragForce> {
 	public:
 		DragForce(float k1, float k2);
 		virtual void updateForce(Abyss::RigidBody* body, Abyss::Real duration) override;
@@ -67,7 +68,7 @@ class Car {
 		~Car();
 		Car(const Car&) = delete;
 		Car& operator=(const Car&) = delete;
-		const Common::Vector2& getPosition() const;
+		Common::Vector2 getPosition() const;
 		void setPosition(const Common::Vector2& pos);
 		void setVelocity(const Common::Vector2& vel);
 		void setOrientation(float o);
@@ -85,6 +86,7 @@ class Car {
 		float getLength() const;
 		float getWheelbase() const;
 		float getLateralAcceleration() const; // in m/s2
+		const TrackPosition& getTrackPosition() const;
 
 		static CarConfig readCarConfig(const char* filename);
 
@@ -100,7 +102,10 @@ class Car {
 		TyreForce mLFTyreForce;
 		TyreForce mRFTyreForce;
 		DragForce mDragForce;
+		Abyss::ForceRegistration mForceRegistrations[5];
 		const Track* mTrack;
+		TrackQueryHint mWheelTrackHints[4]; // LB, RB, LF, RF
+		TrackPosition mTrackPosition;
 		bool mOffroad = false;
 };
 
@@ -1,9 +1,11 @@
 #include "Game.h"
 #include "GameDriver.h"
 
-bool Game::run(const char* carname, const char* trackname)
+bool Game::run(const char* carname, const char* trackname, const char* recordfile,
+		float timestep, unsigned int maxSubsteps, float barrierRunoff)
 {
-	GameDriver driver(800, 600, "Some Cool Racing", carname, trackname);
+	GameDriver driver(800, 600, "Some Cool Racing", carname, trackname, recordfile,
+			timestep, maxSubsteps, barrierRunoff);
 	driver.run();
 	return true;
 }
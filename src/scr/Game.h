@@ -3,7 +3,9 @@
 
 class Game {
 	public:
-		bool run(const char* carname, const char* trackname);
+		bool run(const char* carname, const char* trackname, const char* recordfile = nullptr,
+				float timestep = 0.01f, unsigned int maxSubsteps = 10,
+				float barrierRunoff = -1.0f);
 };
 
 #endif
@@ -1,14 +1,34 @@
+#include <stdexcept>
+
 #include "GameDriver.h"
 
 #include "common/Math.h"
 
 GameDriver::GameDriver(unsigned int screenWidth, unsigned int screenHeight,
-		const char* caption, const char* carname, const char* trackname)
+		const char* caption, const char* carname, const char* trackname,
+		const char* recordfile, float timestep, unsigned int maxSubsteps,
+		float barrierRunoff)
 	: Driver(screenWidth, screenHeight, caption),
 	mWorld(carname, trackname),
 	mRenderer(screenWidth, screenHeight),
-	mDebugDisplay(0.2f)
+	mDebugDisplay(0.2f),
+	mRecordFile(recordfile)
 {
+	mWorld.setTimestep(timestep);
+	mWorld.setMaxSubsteps(maxSubsteps);
+	if(barrierRunoff >= 0.0f)
+		mWorld.setBarriers(true, barrierRunoff);
+}
+
+GameDriver::~GameDriver()
+{
+	if(mRecordFile) {
+		try {
+			mRecording.save(mRecordFile);
+		} catch(const std::runtime_error& e) {
+			std::cerr << e.what() << "\n";
+		}
+	}
 }
 
 bool GameDriver::init()
@@ -48,7 +68,17 @@ bool GameDriver::prerenderUpdate(float frameTime)
 	}
 
 	car->setSteering(mSteering);
-	mWorld.updatePhysics(frameTime);
+	if(mRecordFile) {
+		DriverInput in;
+		in.Time = mTime;
+		in.Throttle = mThrottle;
+		in.Brake = mBrake;
+		in.Steering = mSteering;
+		mRecording.add(in);
+		mTime += frameTime;
+	}
+	// the physics runs at a fixed rate regardless of the frame rate
+	mWorld.advance(frameTime);
 	mZoom += mZoomSpeed * frameTime;
 	mZoom = mRenderer.setZoom(mZoom);
 	mRenderer.setSteering(mThrottle, mBrake, mSteering);
@@ -8,11 +8,16 @@
 #include "common/Vector2.h"
 
 #include "GameWorld.h"
+#include "InputRecording.h"
 
 class GameDriver : public Common::Driver {
 	public:
 		GameDriver(unsigned int screenWidth, unsigned int screenHeight,
-				const char* caption, const char* carname, const char* trackname);
+				const char* caption, const char* carname, const char* trackname,
+				const char* recordfile = nullptr,
+				float timestep = 0.01f, unsigned int maxSubsteps = 10,
+				float barrierRunoff = -1.0f); // no barriers if negative
+		~GameDriver();
 		bool init() override;
 		bool prerenderUpdate(float frameTime) override;
 		void drawFrame() override;
@@ -36,6 +41,10 @@ class GameDriver : public Common::Driver {
 		Common::SteadyTimer mDebugDisplay;
 
 		bool mSteeringWithMouse = false;
+
+		const char* mRecordFile;
+		InputRecording mRecording;
+		float mTime = 0.0f;
 };
 
 #endif
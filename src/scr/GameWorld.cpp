@@ -1,26 +1,72 @@
+#include <cassert>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
 #include "GameWorld.h"
+#include "TrackImage.h"
+#include "TrackBarriers.h"
 
 GameWorld::GameWorld(const char* carname, const char* trackname)
+	: mContactResolver(10)
 {
+	// prefer the compiled track image unless it was compiled from a
+	// different version of the track config, fall back to the config
+	std::string trackimage = "share/tracks/" + std::string(trackname) + ".track";
 	std::string trackconfig = "share/tracks/" + std::string(trackname) + ".conf";
-	auto trackConfig = Track::readTrackConfig(trackconfig.c_str());
-	mTrack = new Track(&trackConfig);
+	if(std::ifstream(trackimage).good()) {
+		try {
+			auto image = new TrackImage(trackimage.c_str());
+			if(std::ifstream(trackconfig).good() &&
+					image->getHeader().ConfigHash != TrackImage::hashConfig(trackconfig.c_str())) {
+				std::cerr << trackimage << " is out of date, loading " << trackconfig << ".\n";
+				delete image;
+			} else {
+				mTrack = new Track(image);
+			}
+		} catch(const std::runtime_error& e) {
+			std::cerr << "Could not load " << trackimage << ": " << e.what() << "\n";
+		}
+	}
+
+	if(!mTrack) {
+		auto trackConfig = Track::readTrackConfig(trackconfig.c_str());
+		mTrack = new Track(&trackConfig);
+	}
 
 	std::string carconfig = "share/cars/" + std::string(carname) + ".conf";
 	auto carConfig = Car::readCarConfig(carconfig.c_str());
 	mCar = new Car(&carConfig, &mPhysicsWorld, mTrack);
+	snapCarState();
 }
 
 GameWorld::~GameWorld()
 {
 	delete mTrack;
 	delete mCar;
+	delete mBarriers;
 }
 
 void GameWorld::updatePhysics(float time)
 {
+	snapCarState();
 	mPhysicsWorld.startFrame();
 	mPhysicsWorld.runPhysics(time);
+	if(mBarriers) {
+		// a fast car stops where it first touches a barrier
+		// instead of passing through it
+		Common::Vector2 halfSize = Common::Vector2(mCar->getWidth(), mCar->getLength()) * 0.5f;
+		Abyss::SweptBox sweep = Abyss::getBodySweep(mCar->getBody(), halfSize,
+				mPrevCarPosition, mPrevCarOrientation);
+		Abyss::Real toi;
+		if(mBarriers->timeOfImpact(sweep, toi))
+			Abyss::moveBodyAlongSweep(mCar->getBody(), sweep, toi);
+
+		mContacts.clear();
+		mBarriers->generateContacts(mCar->getBody(), halfSize, mContacts, 0.3, 0.2);
+		if(!mContacts.empty())
+			mContactResolver.resolveContacts(&mContacts[0], mContacts.size(), time);
+	}
 	mCar->moved();
 
 	{
@@ -30,9 +76,68 @@ void GameWorld::updatePhysics(float time)
 		if(carpos.x < bl.x || carpos.y < bl.y ||
 				carpos.x > tr.x || carpos.y > tr.y) {
 			mCar->setPosition(Common::Vector2());
+			snapCarState();
+		}
+	}
+
+}
+
+unsigned int GameWorld::advance(float frameTime)
+{
+	mAccumulator += frameTime;
+	unsigned int steps = 0;
+	while(mAccumulator >= mTimestep) {
+		if(steps == mMaxSubsteps) {
+			// can't keep up - slow down instead of falling further behind
+			mAccumulator = 0.0f;
+			break;
 		}
+		updatePhysics(mTimestep);
+		mAccumulator -= mTimestep;
+		steps++;
 	}
+	return steps;
+}
+
+void GameWorld::setTimestep(float timestep)
+{
+	assert(timestep > 0.0f);
+	mTimestep = timestep;
+}
+
+float GameWorld::getTimestep() const
+{
+	return mTimestep;
+}
+
+void GameWorld::setMaxSubsteps(unsigned int maxSubsteps)
+{
+	assert(maxSubsteps > 0);
+	mMaxSubsteps = maxSubsteps;
+}
+
+Common::Vector2 GameWorld::getCarRenderPosition() const
+{
+	float alpha = mAccumulator / mTimestep;
+	return mPrevCarPosition * (1.0f - alpha) + mCar->getPosition() * alpha;
+}
+
+Common::Vector2 GameWorld::getCarRenderOrientation() const
+{
+	float alpha = mAccumulator / mTimestep;
+	Common::Vector2 o = mCar->getBody()->getOrientation();
+	Common::Vector2 ret = mPrevCarOrientation * (1.0f - alpha) + o * alpha;
+	if(ret.null())
+		return o;
+	return ret.normalized();
+}
 
+// The car is where it was at the last step, e.g. after it was
+// teleported, so that there is nothing to interpolate.
+void GameWorld::snapCarState()
+{
+	mPrevCarPosition = mCar->getPosition();
+	mPrevCarOrientation = mCar->getBody()->getOrientation();
 }
 
 Car* GameWorld::getCar()
@@ -50,11 +155,25 @@ const Track* GameWorld::getTrack() const
 	return mTrack;
 }
 
+Abyss::World* GameWorld::getPhysicsWorld()
+{
+	return &mPhysicsWorld;
+}
+
+void GameWorld::setBarriers(bool enabled, float runoff)
+{
+	delete mBarriers;
+	mBarriers = nullptr;
+	if(enabled)
+		mBarriers = new Abyss::BarrierTree(TrackBarriers(mTrack, runoff).Barriers);
+}
+
 void GameWorld::resetCar()
 {
 	mCar->setPosition(Common::Vector2());
 	mCar->setVelocity(Common::Vector2());
 	mCar->setOrientation(0.0f);
 	mCar->setAngularVelocity(0.0f);
+	snapCarState();
 }
 
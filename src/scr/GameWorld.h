@@ -4,21 +4,54 @@
 #include "Car.h"
 
 #include "abyss/RigidBody.h"
+#include "abyss/Collision.h"
 
 class GameWorld {
 	public:
 		GameWorld(const char* carname, const char* trackname);
 		~GameWorld();
 		void updatePhysics(float time);
+
+		// Runs the physics in fixed steps for the time that has passed,
+		// carrying the remainder over to the next call. At most
+		// maxSubsteps steps are run, the rest of the time is dropped.
+		// Returns the number of steps run.
+		unsigned int advance(float frameTime);
+		void setTimestep(float timestep);
+		float getTimestep() const;
+		void setMaxSubsteps(unsigned int maxSubsteps);
+
+		// The car interpolated between the last two physics steps by
+		// the time carried over by advance().
+		Common::Vector2 getCarRenderPosition() const;
+		Common::Vector2 getCarRenderOrientation() const;
+
 		const Car* getCar() const;
 		Car* getCar();
 		const Track* getTrack() const;
+		Abyss::World* getPhysicsWorld();
 		void resetCar();
 
+		// Puts barriers along the track edges, runoff metres out,
+		// that the car bounces off. Off by default.
+		void setBarriers(bool enabled, float runoff = 0.0f);
+
 	private:
 		Abyss::World mPhysicsWorld;
 		Track* mTrack = nullptr;
 		Car* mCar = nullptr;
+
+		float mTimestep = 0.01f;
+		unsigned int mMaxSubsteps = 10;
+		float mAccumulator = 0.0f;
+		Common::Vector2 mPrevCarPosition;
+		Common::Vector2 mPrevCarOrientation;
+
+		Abyss::BarrierTree* mBarriers = nullptr;
+		Abyss::ContactResolver mContactResolver;
+		std::vector<Abyss::ContactManifold> mContacts;
+
+		void snapCarState();
 };
 
 #endif
@@ -0,0 +1,88 @@
+#include <cassert>
+
+#include <stdexcept>
+#include <fstream>
+#include <sstream>
+
+#include "InputRecording.h"
+
+void InputRecording::add(const DriverInput& input)
+{
+	if(!mInputs.empty()) {
+		const auto& prev = mInputs.back();
+		assert(input.Time >= prev.Time);
+		if(input.Throttle == prev.Throttle && input.Brake == prev.Brake &&
+				input.Steering == prev.Steering)
+			return;
+	}
+	mInputs.push_back(input);
+}
+
+const DriverInput& InputRecording::get(float time) const
+{
+	static const DriverInput none;
+	if(mInputs.empty() || time < mInputs[0].Time)
+		return none;
+
+	if(mCursor >= mInputs.size() || mInputs[mCursor].Time > time)
+		mCursor = 0;
+	while(mCursor + 1 < mInputs.size() && mInputs[mCursor + 1].Time <= time)
+		mCursor++;
+	return mInputs[mCursor];
+}
+
+float InputRecording::getLength() const
+{
+	return mInputs.empty() ? 0.0f : mInputs.back().Time;
+}
+
+bool InputRecording::empty() const
+{
+	return mInputs.empty();
+}
+
+void InputRecording::save(const char* filename) const
+{
+	std::ofstream out(filename);
+	out << "# time throttle brake steering\n";
+	for(const auto& in : mInputs) {
+		out << in.Time << " " << in.Throttle << " " << in.Brake << " " << in.Steering << "\n";
+	}
+	if(!out) {
+		std::stringstream err;
+		err << "Could not write input recording " << filename << ".";
+		throw std::runtime_error(err.str());
+	}
+}
+
+InputRecording InputRecording::load(const char* filename)
+{
+	std::ifstream input(filename);
+	if(!input) {
+		std::stringstream err;
+		err << "Could not open input recording " << filename << ".";
+		throw std::runtime_error(err.str());
+	}
+
+	InputRecording rec;
+	std::string line;
+	int lineNum = 0;
+	while(std::getline(input, line)) {
+		lineNum++;
+		if(line.empty() || line[0] == '#')
+			continue;
+
+		DriverInput in;
+		std::stringstream ss(line);
+		ss >> in.Time >> in.Throttle >> in.Brake >> in.Steering;
+		if(!ss || (!rec.mInputs.empty() && in.Time < rec.mInputs.back().Time)) {
+			std::stringstream err;
+			err << filename << ":" << lineNum << ": invalid input.";
+			throw std::runtime_error(err.str());
+		}
+		rec.add(in);
+	}
+
+	return rec;
+}
+
@@ -0,0 +1,35 @@
+#ifndef SCR_INPUTRECORDING_H
+#define SCR_INPUTRECORDING_H
+
+#include <vector>
+
+struct DriverInput {
+	float Time = 0.0f; // when the input takes effect, in seconds
+	float Throttle = 0.0f;
+	float Brake = 0.0f;
+	float Steering = 0.0f;
+};
+
+// Driver inputs over a drive, recorded in the game or written by hand,
+// for replaying the drive without a player. The file format is a line
+// "time throttle brake steering" for each change of the inputs, lines
+// starting with '#' are comments.
+class InputRecording {
+	public:
+		// Records input unless it's the same as the previous one.
+		void add(const DriverInput& input);
+		// The input in effect at time. Fastest when time doesn't go backwards.
+		const DriverInput& get(float time) const;
+		float getLength() const;
+		bool empty() const;
+
+		void save(const char* filename) const;
+		static InputRecording load(const char* filename);
+
+	private:
+		std::vector<DriverInput> mInputs;
+		mutable size_t mCursor = 0;
+};
+
+#endif
+
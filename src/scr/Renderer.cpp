@@ -1,4 +1,5 @@
 #include "Renderer.h"
+#include "TrackMesh.h"
 
 #include "common/Math.h"
 
@@ -259,32 +260,21 @@ void Renderer::loadGrassVBO(const Track* t)
 
 void Renderer::loadTrackVBO(const Track* t)
 {
-	auto segments = t->getTrackSegments();
+	TrackMesh mesh(t);
 
-	for(const auto& seg : segments) {
+	for(unsigned int i = 0; i < mesh.StripStart.size() - 1; i++) {
 		TSRender r;
 
 		glGenBuffers(2, r.VBO);
 
-		auto triStrip = seg->getTriangleStrip();
-
-		std::vector<GLfloat> vertexdata;
-		std::vector<GLfloat> texcoorddata;
-		for(const auto& t : triStrip) {
-			vertexdata.push_back(t.x);
-			vertexdata.push_back(-0.1f);
-			vertexdata.push_back(t.y);
-			texcoorddata.push_back(t.x * 0.08f);
-			texcoorddata.push_back(t.y * 0.08f);
-		}
+		unsigned int first = mesh.StripStart[i];
+		r.ElemCount = mesh.StripStart[i + 1] - first;
 
 		glBindBuffer(GL_ARRAY_BUFFER, r.VBO[0]);
-		glBufferData(GL_ARRAY_BUFFER, vertexdata.size() * sizeof(GLfloat), &vertexdata[0], GL_STATIC_DRAW);
+		glBufferData(GL_ARRAY_BUFFER, r.ElemCount * 3 * sizeof(GLfloat), &mesh.Vertices[first * 3], GL_STATIC_DRAW);
 
 		glBindBuffer(GL_ARRAY_BUFFER, r.VBO[1]);
-		glBufferData(GL_ARRAY_BUFFER, texcoorddata.size() * sizeof(GLfloat), &texcoorddata[0], GL_STATIC_DRAW);
-
-		r.ElemCount = triStrip.size();
+		glBufferData(GL_ARRAY_BUFFER, r.ElemCount * 2 * sizeof(GLfloat), &mesh.TexCoords[first * 2], GL_STATIC_DRAW);
 
 		mTrackSegments.push_back(r);
 	}
@@ -317,9 +307,10 @@ void Renderer::cleanup()
 Matrix44 Renderer::rotationVectorToMatrix(const Vector2& rot)
 {
 	Matrix44 ret;
-	float theta = atan2(rot.y, rot.x);
-	float ct = cos(theta);
-	float st = sin(theta);
+	// the components of the direction are the cosine and sine of the angle
+	float len = rot.length();
+	float ct = rot.x / len;
+	float st = rot.y / len;
 	// rotation around Y
 	ret.m[0] = ct;
 	ret.m[2] = -st;
@@ -418,13 +409,16 @@ void Renderer::drawFrame(const GameWorld* w)
 	setSceneDrawMode();
 
 	auto car = w->getCar();
-	updateFrameMatrices(mCamPos, car->getBody()->orientation);
+	// the car between the last two physics steps
+	auto carpos = w->getCarRenderPosition();
+	auto carorient = w->getCarRenderOrientation();
+	updateFrameMatrices(mCamPos, carorient);
 
 	glUniform3f(glGetUniformLocation(mCarProgram, "uAmbientLight"), 1.0f, 1.0f, 1.0f);
 
 	auto track = w->getTrack();
 
-	mScreenOrientation = mCamOrientation ? car->getOrientation() : 0.0f;
+	mScreenOrientation = mCamOrientation ? atan2(carorient.x, carorient.y) : 0.0f;
 
 	if(mTrackSegments.empty()) {
 		loadCarVBO(car);
@@ -432,7 +426,6 @@ void Renderer::drawFrame(const GameWorld* w)
 		loadGrassVBO(track);
 	}
 
-	auto carpos = car->getPosition();
 	if(mAutoZoomEnabled) {
 		auto s = std::max<float>(5, car->getSpeed());
 		mAutoZoom = 0.5f + 0.0001f * s * s;
@@ -467,17 +460,16 @@ void Renderer::updateDebug(const GameWorld* w)
 		return;
 
 	auto car = w->getCar();
-	auto pos = car->getPosition();
+	auto body = car->getBody();
 	std::vector<Vector2> spots;
 
 	float width = car->getWidth() * 0.5f;
 	float length = car->getWheelbase() * 0.5f;
-	float o = -car->getOrientation();
 
-	spots.push_back(pos + Math::rotate2D(Vector2(width, length), o));
-	spots.push_back(pos + Math::rotate2D(Vector2(-width, length), o));
-	spots.push_back(pos + Math::rotate2D(Vector2(width, -length), o));
-	spots.push_back(pos + Math::rotate2D(Vector2(-width, -length), o));
+	spots.push_back(body->getPointInWorldSpace(Vector2(width, length)));
+	spots.push_back(body->getPointInWorldSpace(Vector2(-width, length)));
+	spots.push_back(body->getPointInWorldSpace(Vector2(width, -length)));
+	spots.push_back(body->getPointInWorldSpace(Vector2(-width, -length)));
 
 	for(const auto& p : spots) {
 		if(!w->getTrack()->onTrack(p)) {
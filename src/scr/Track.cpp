@@ -2,6 +2,10 @@
 #include <cmath>
 
 #include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
 #include <fstream>
 #include <sstream>
 
@@ -10,9 +14,12 @@
 #include "common/Math.h"
 
 #include "Track.h"
+#include "TrackImage.h"
 
 using namespace Common;
 
+constexpr float Track::MaxEdgeDistance;
+
 StraightTrackSegment::StraightTrackSegment(const Common::Vector2& startpos,
 		const Common::Vector2& dir,
 		float len, float width)
@@ -29,12 +36,15 @@ StraightTrackSegment::StraightTrackSegment(const Common::Vector2& startpos,
 bool StraightTrackSegment::onTrack(const Common::Vector2& pos) const
 {
 	// actually extends the segment at ends by up to half mWidth
-	bool ret = Math::pointToSegmentDistance(mStartPos,
-			mEndPos,
-			pos) < mWidth * 0.5;
+	bool ret = distance(pos) < mWidth * 0.5;
 	return ret;
 }
 
+float StraightTrackSegment::distance(const Common::Vector2& pos) const
+{
+	return Math::pointToSegmentDistance(mStartPos, mEndPos, pos);
+}
+
 std::vector<Common::Vector2> StraightTrackSegment::getTriangleStrip() const
 {
 	Vector2 v1 = mStartPos + Math::rotate2D(mDir, HALF_PI) * mWidth * 0.5f;
@@ -54,12 +64,49 @@ float StraightTrackSegment::getLength() const
 	return mLength;
 }
 
+int StraightTrackSegment::project(const Common::Vector2& pos, float& along, float& lateral) const
+{
+	Vector2 rel = pos - mStartPos;
+	along = rel.dot(mDir);
+	lateral = mDir.cross2d(rel);
+	if(along < 0.0f) {
+		along = 0.0f;
+		return -1;
+	}
+	if(along > mLength) {
+		along = mLength;
+		return 1;
+	}
+	return 0;
+}
+
+std::vector<Common::Vector2> StraightTrackSegment::getCenterLine() const
+{
+	return {mStartPos, mEndPos};
+}
+
+float StraightTrackSegment::getCenterLineError() const
+{
+	return 0.0f;
+}
+
+float StraightTrackSegment::getWidth() const
+{
+	return mWidth;
+}
+
+size_t StraightTrackSegment::getMemoryUsage() const
+{
+	return sizeof(*this);
+}
+
 
 CurveSegment::CurveSegment(const Common::Vector2& startpos,
 		const Common::Vector2& dir,
 		const Common::Vector2& endpos,
 		const Common::Vector2& enddir,
-		float width)
+		float width,
+		float tolerance)
 	: mStartPos(startpos),
 	mEndPos(endpos),
 	mDir(dir),
@@ -85,42 +132,168 @@ CurveSegment::CurveSegment(const Common::Vector2& startpos,
 		throw std::runtime_error("Cannot construct a curve!");
 	}
 
-	// Calculate an estimation of the curve length
-	float len = 0.0f;
-	for(int i = 0; i < 10; i++) {
-		auto p1 = pointOnCurve(i / 10.0);
-		auto p2 = pointOnCurve((i + 1) / 10.0);
-		len += p1.distance(p2);
+	// Create lines that estimate the curve for the spatial index and graphics.
+	std::vector<float> params;
+	params.push_back(0.0f);
+	tessellate(0.0f, 1.0f, tolerance, 0, params);
+	std::vector<Vector2> approximations;
+	for(auto t : params)
+		approximations.push_back(pointOnCurve(t));
+
+	// A parabola arc is furthest away from its chord at the
+	// parameter midpoint.
+	mApproximationError = 0.0f;
+	for(size_t i = 0; i < approximations.size() - 1; i++) {
+		auto mid = pointOnCurve((params[i] + params[i + 1]) * 0.5f);
+		float err = Math::pointToSegmentDistance(approximations[i],
+				approximations[i + 1], mid);
+		mApproximationError = std::max(mApproximationError, err);
 	}
-	mNumApproxSegments = 5 + pow(len, 0.5f);
+	// allow for rounding errors
+	mApproximationError += 0.001f;
+	mApproximations.assign(std::move(approximations));
 
-	// Create lines that estimate the curve for onTrack() query.
-	for(size_t i = 0; i < mNumApproxSegments; i++) {
-		auto pt = pointOnCurve(i / (float)(mNumApproxSegments - 1));
-		mApproximations.push_back(pt);
+	const int lengthSamples = 32;
+	std::vector<float> lengthTable;
+	lengthTable.push_back(0.0f);
+	for(int i = 1; i <= lengthSamples; i++) {
+		lengthTable.push_back(lengthTable.back() +
+				pointOnCurve((i - 1) / (float)lengthSamples).distance(
+					pointOnCurve(i / (float)lengthSamples)));
 	}
+	mLengthTable.assign(std::move(lengthTable));
+}
+
+CurveSegment::CurveSegment(const Common::Vector2& startpos,
+		const Common::Vector2& dir,
+		const Common::Vector2& endpos,
+		const Common::Vector2& enddir,
+		const Common::Vector2& p1,
+		float width,
+		float approximationError,
+		const Common::Vector2* approximations, unsigned int numApproximations,
+		const float* lengthTable, unsigned int lengthTableSize)
+	: mStartPos(startpos),
+	mEndPos(endpos),
+	mDir(dir),
+	mEndDir(enddir),
+	mP1(p1),
+	mWidth(width),
+	mApproximationError(approximationError)
+{
+	assert(numApproximations >= 2);
+	assert(lengthTableSize >= 2);
+	mApproximations.refer(approximations, numApproximations);
+	mLengthTable.refer(lengthTable, lengthTableSize);
 }
 
 bool CurveSegment::onTrack(const Common::Vector2& pos) const
 {
-	for(size_t i = 0; i < mApproximations.size() - 1; i++) {
-		float this_dist = Math::pointToSegmentDistance(
-				mApproximations[i],
-				mApproximations[i + 1],
-				pos);
-		if(this_dist < mWidth * 0.5f)
-			return true;
+	return distance(pos) < mWidth * 0.5f;
+}
+
+float CurveSegment::distance(const Common::Vector2& pos) const
+{
+	return closestPoint(pos, nullptr).distance(pos);
+}
+
+// Real roots of a t^3 + b t^2 + c t + d = 0, returns the number of roots.
+static int solveCubic(double a, double b, double c, double d, double* roots)
+{
+	double scale = fabs(b) + fabs(c) + fabs(d);
+	if(fabs(a) <= 1.0e-9 * scale) {
+		if(fabs(b) <= 1.0e-9 * scale) {
+			if(c == 0.0)
+				return 0;
+			roots[0] = -d / c;
+			return 1;
+		}
+
+		double disc = c * c - 4.0 * b * d;
+		if(disc < 0.0)
+			return 0;
+		disc = sqrt(disc);
+		roots[0] = (-c + disc) / (2.0 * b);
+		roots[1] = (-c - disc) / (2.0 * b);
+		return 2;
 	}
 
-	return false;
+	b /= a;
+	c /= a;
+	d /= a;
+
+	// depressed cubic x^3 + px + q = 0 where t = x - b / 3
+	double p = c - b * b / 3.0;
+	double q = 2.0 * b * b * b / 27.0 - b * c / 3.0 + d;
+	double offset = -b / 3.0;
+	double disc = q * q / 4.0 + p * p * p / 27.0;
+
+	if(disc > 0.0) {
+		double sd = sqrt(disc);
+		roots[0] = cbrt(-q / 2.0 + sd) + cbrt(-q / 2.0 - sd) + offset;
+		return 1;
+	}
+
+	if(p == 0.0) {
+		roots[0] = offset;
+		return 1;
+	}
+
+	double r = sqrt(-p / 3.0);
+	double phi = acos(clamp(-1.0, -q / (2.0 * r * r * r), 1.0));
+	for(int i = 0; i < 3; i++)
+		roots[i] = 2.0 * r * cos((phi - 2.0 * M_PI * i) / 3.0) + offset;
+	return 3;
+}
+
+Common::Vector2 CurveSegment::closestPoint(const Common::Vector2& pos, float* t) const
+{
+	// With A = p1 - p0 and B = p2 - 2 p1 + p0 the curve is
+	// C(t) = p0 + 2tA + t^2 B. At the closest point (C(t) - pos) . C'(t) = 0
+	// which is a cubic in t. The closest point is at one of its roots or
+	// at either end of the curve.
+	double ax = mP1.x - mStartPos.x;
+	double ay = mP1.y - mStartPos.y;
+	double bx = mEndPos.x - 2.0 * mP1.x + mStartPos.x;
+	double by = mEndPos.y - 2.0 * mP1.y + mStartPos.y;
+	double mx = mStartPos.x - pos.x;
+	double my = mStartPos.y - pos.y;
+
+	double roots[5];
+	int num = solveCubic(bx * bx + by * by,
+			3.0 * (ax * bx + ay * by),
+			2.0 * (ax * ax + ay * ay) + mx * bx + my * by,
+			mx * ax + my * ay,
+			roots);
+	roots[num++] = 0.0;
+	roots[num++] = 1.0;
+
+	double bestT = 0.0;
+	double bestDist = -1.0;
+	for(int i = 0; i < num; i++) {
+		double r = clamp(0.0, roots[i], 1.0);
+		double px = mx + 2.0 * r * ax + r * r * bx;
+		double py = my + 2.0 * r * ay + r * r * by;
+		double dist = px * px + py * py;
+		if(bestDist < 0.0 || dist < bestDist) {
+			bestDist = dist;
+			bestT = r;
+		}
+	}
+
+	if(t)
+		*t = bestT;
+	return pointOnCurve(bestT);
 }
 
 std::vector<Common::Vector2> CurveSegment::getTriangleStrip() const
 {
 	std::vector<Common::Vector2> ret;
 	for(size_t i = 0; i < mApproximations.size(); i++) {
-		float t = i / (float)(mNumApproxSegments - 1);
-		auto pc = pointOnCurve(t);
+		// the center line vertices lie on the curve, so this
+		// gives back the parameter they were created at
+		float t;
+		auto pc = closestPoint(mApproximations[i], &t);
 
 		// Calculate normal of the curve from the
 		// direction (tangent, derivative) of the curve.
@@ -140,11 +313,84 @@ Common::Vector2 CurveSegment::getEndPosition() const
 
 float CurveSegment::getLength() const
 {
-	float len = 0.0f;
-	for(size_t i = 0; i < mApproximations.size() - 1; i++) {
-		len += mApproximations[i].distance(mApproximations[i + 1]);
+	return mLengthTable.back();
+}
+
+float CurveSegment::arcLength(float t) const
+{
+	float f = clamp(0.0f, t, 1.0f) * (mLengthTable.size() - 1);
+	unsigned int i = std::min<unsigned int>(f, mLengthTable.size() - 2);
+	return mLengthTable[i] + (mLengthTable[i + 1] - mLengthTable[i]) * (f - i);
+}
+
+int CurveSegment::project(const Common::Vector2& pos, float& along, float& lateral) const
+{
+	float t;
+	Vector2 pt = closestPoint(pos, &t);
+	Vector2 rel = pos - pt;
+	along = arcLength(t);
+	if(t <= 0.0f && rel.dot(mDir) < 0.0f) {
+		lateral = mDir.cross2d(rel);
+		return -1;
+	}
+	if(t >= 1.0f && rel.dot(mEndDir) > 0.0f) {
+		lateral = mEndDir.cross2d(rel);
+		return 1;
+	}
+
+	float dist = rel.length();
+	lateral = directionOnCurve(t).cross2d(rel) < 0.0f ? -dist : dist;
+	return 0;
+}
+
+std::vector<Common::Vector2> CurveSegment::getCenterLine() const
+{
+	return std::vector<Common::Vector2>(mApproximations.begin(), mApproximations.end());
+}
+
+float CurveSegment::getCenterLineError() const
+{
+	return mApproximationError;
+}
+
+float CurveSegment::getWidth() const
+{
+	return mWidth;
+}
+
+size_t CurveSegment::getMemoryUsage() const
+{
+	return sizeof(*this) + mApproximations.getMemoryUsage() +
+		mLengthTable.getMemoryUsage();
+}
+
+// Appends the curve parameters at the ends of the center line pieces
+// between t0 and t1, splitting until the center line and both edges stay
+// within tolerance of the curve at the middle of each piece. Since the
+// error of a chord grows with the square of its angle, tight corners get
+// more pieces than gentle ones of the same length.
+void CurveSegment::tessellate(float t0, float t1, float tolerance, int depth,
+		std::vector<float>& params) const
+{
+	const int maxDepth = 10;
+	float tm = (t0 + t1) * 0.5f;
+	Vector2 p0 = pointOnCurve(t0);
+	Vector2 p1 = pointOnCurve(t1);
+	Vector2 pm = pointOnCurve(tm);
+	Vector2 n0 = Math::rotate2D(directionOnCurve(t0), HALF_PI) * mWidth * 0.5f;
+	Vector2 n1 = Math::rotate2D(directionOnCurve(t1), HALF_PI) * mWidth * 0.5f;
+	Vector2 nm = Math::rotate2D(directionOnCurve(tm), HALF_PI) * mWidth * 0.5f;
+
+	float err = Math::pointToSegmentDistance(p0, p1, pm);
+	err = std::max(err, Math::pointToSegmentDistance(p0 + n0, p1 + n1, pm + nm));
+	err = std::max(err, Math::pointToSegmentDistance(p0 - n0, p1 - n1, pm - nm));
+
+	if(depth < maxDepth && err > tolerance) {
+		tessellate(t0, tm, tolerance, depth + 1, params);
+		tessellate(tm, t1, tolerance, depth + 1, params);
+	} else {
+		params.push_back(t1);
 	}
-	return len;
 }
 
 Common::Vector2 CurveSegment::pointOnCurve(float t) const
@@ -206,7 +452,8 @@ Track::Track(const TrackConfig* tc)
 							dir,
 							endpos,
 							enddir,
-							width);
+							width,
+							tc->Tolerance);
 					pos = seg->getEndPosition();
 					dir = enddir;
 					mSegments.push_back(seg);
@@ -231,7 +478,8 @@ Track::Track(const TrackConfig* tc)
 					dir,
 					startpos,
 					startdir,
-					width);
+					width,
+					tc->Tolerance);
 			mSegments.push_back(seg);
 		} else {
 			std::stringstream err;
@@ -240,18 +488,29 @@ Track::Track(const TrackConfig* tc)
 		}
 	}
 
-	{
-		float len = 0.0f;
-		for(const auto& s : mSegments)
-			len += s->getLength();
-		std::cout << "Track length: " << len << " m\n";
+	std::vector<float> segmentStart;
+	for(const auto& s : mSegments) {
+		segmentStart.push_back(mLength);
+		mLength += s->getLength();
 	}
+	mSegmentStart.assign(std::move(segmentStart));
+	std::cout << "Track length: " << mLength << " m\n";
+
+	unsigned int numVertices = 0;
+	for(const auto& s : mSegments)
+		numVertices += s->getCenterLine().size();
+	std::cout << "Track tessellation: " << numVertices << " center line vertices in " <<
+		mSegments.size() << " segments (tolerance " << tc->Tolerance << " m)\n";
+
+	buildIndex();
+	buildTriangleStrips();
 }
 
 Track::~Track()
 {
 	for(auto s : mSegments)
 		delete s;
+	delete mImage;
 }
 
 const std::vector<TrackSegment*>& Track::getTrackSegments() const
@@ -261,14 +520,177 @@ const std::vector<TrackSegment*>& Track::getTrackSegments() const
 
 bool Track::onTrack(const Common::Vector2& pos) const
 {
-	// TODO: use quad tree
-	for(auto s : mSegments)
-		if(s->onTrack(pos))
+	if(!mDistanceField.empty())
+		return distanceToEdge(pos) > 0.0f;
+
+	return findPiece(pos) >= 0;
+}
+
+bool Track::onTrack(const Common::Vector2& pos, TrackQueryHint& hint) const
+{
+	if(!mDistanceField.empty())
+		return distanceToEdge(pos) > 0.0f;
+
+	if(tryHint(pos, hint))
+		return true;
+
+	int piece = findPiece(pos);
+	if(piece < 0) {
+		// Off track; keep the old hint as the point will likely
+		// return to the track near it.
+		return false;
+	}
+
+	hint.Piece = piece;
+	hint.Segment = mPieces[piece].Segment;
+	return true;
+}
+
+// Whether pos is on the hinted piece or one of its neighbours, moving
+// the hint to the neighbour. Otherwise the caller needs to fall back to
+// an index query. Either way the outcome is counted in the hint. The
+// pieces of consecutive segments are stored consecutively, so the
+// neighbours of the hinted piece may belong to the next or previous
+// segment.
+bool Track::tryHint(const Common::Vector2& pos, TrackQueryHint& hint) const
+{
+	if(hint.Piece >= 0 && hint.Piece < (int)mPieces.size()) {
+		int num = mPieces.size();
+		if(onPiece(pos, hint.Piece)) {
+			hint.Stats.Hits++;
 			return true;
+		}
+
+		for(int i : {hint.Piece + 1, hint.Piece - 1}) {
+			i = (i + num) % num;
+			if(onPiece(pos, i)) {
+				hint.Piece = i;
+				hint.Segment = mPieces[i].Segment;
+				hint.Stats.NeighbourHits++;
+				return true;
+			}
+		}
+	}
 
+	hint.Stats.Fallbacks++;
 	return false;
 }
 
+bool Track::onPiece(const Common::Vector2& pos, unsigned int piece) const
+{
+	const auto& p = mPieces[piece];
+	float d = Math::pointToSegmentDistance(p.Start, p.End, pos);
+	if(d < p.HalfWidth - p.Error)
+		return true;
+	if(d >= p.HalfWidth + p.Error)
+		return false;
+
+	// Near the edge of a curve the piece isn't accurate enough.
+	return mSegments[p.Segment]->onTrack(pos);
+}
+
+int Track::findPiece(const Common::Vector2& pos) const
+{
+	int cell = getIndexCell(pos);
+	if(cell < 0)
+		return -1;
+
+	for(unsigned int i = mCellStart[cell]; i < mCellStart[cell + 1]; i++) {
+		if(onPiece(pos, mCellPieces[i]))
+			return mCellPieces[i];
+	}
+
+	return -1;
+}
+
+float Track::getLength() const
+{
+	return mLength;
+}
+
+size_t Track::getMemoryUsage() const
+{
+	size_t total = sizeof(*this) + mSegments.capacity() * sizeof(TrackSegment*);
+	for(auto s : mSegments)
+		total += s->getMemoryUsage();
+	const auto& bi = mBatchIndex;
+	total += mSegmentStart.getMemoryUsage() + mPieces.getMemoryUsage() +
+		mCellStart.getMemoryUsage() + mCellPieces.getMemoryUsage() +
+		bi.StartX.getMemoryUsage() + bi.StartY.getMemoryUsage() +
+		bi.DirX.getMemoryUsage() + bi.DirY.getMemoryUsage() +
+		bi.InvLength2.getMemoryUsage() + bi.Inner2.getMemoryUsage() +
+		bi.Outer2.getMemoryUsage() + bi.Piece.getMemoryUsage() +
+		bi.CellStart.getMemoryUsage() +
+		mDistanceField.capacity() * sizeof(float) +
+		mStrips.getMemoryUsage() + mStripStart.getMemoryUsage();
+	return total;
+}
+
+TrackPosition Track::findPosition(const Common::Vector2& pos) const
+{
+	TrackPosition tp;
+	float bestDist = -1.0f;
+	for(unsigned int i = 0; i < mSegments.size(); i++) {
+		float dist = mSegments[i]->distance(pos);
+		if(bestDist < 0.0f || dist < bestDist) {
+			bestDist = dist;
+			tp.Segment = i;
+		}
+	}
+
+	if(tp.Segment < 0)
+		return tp;
+
+	float along;
+	mSegments[tp.Segment]->project(pos, along, tp.D);
+	tp.S = mSegmentStart[tp.Segment] + along;
+	return tp;
+}
+
+void Track::updatePosition(const Common::Vector2& pos, TrackPosition& tp) const
+{
+	if(tp.Segment < 0 || tp.Segment >= (int)mSegments.size()) {
+		tp = findPosition(pos);
+		return;
+	}
+
+	// Walk from the previous segment towards pos. A point on the
+	// outside of a kink between two segments can be past the end of
+	// one and before the start of the next one; it is then projected
+	// on the joint of the two.
+	const int num = mSegments.size();
+	int seg = tp.Segment;
+	int lap = tp.Lap;
+	int prevDir = 0;
+	float along, lateral;
+	int steps;
+	for(steps = 0; steps < 8; steps++) {
+		int dir = mSegments[seg]->project(pos, along, lateral);
+		if(dir == 0 || dir == -prevDir)
+			break;
+
+		if(dir > 0 && seg == num - 1)
+			lap++;
+		else if(dir < 0 && seg == 0)
+			lap--;
+		seg = (seg + dir + num) % num;
+		prevDir = dir;
+	}
+
+	if(steps == 8 || fabs(lateral) > MaxEdgeDistance) {
+		// moved too far, e.g. the car was reset
+		int oldLap = tp.Lap;
+		tp = findPosition(pos);
+		tp.Lap = oldLap;
+		return;
+	}
+
+	tp.Segment = seg;
+	tp.Lap = lap;
+	tp.S = mSegmentStart[seg] + along;
+	tp.D = lateral;
+}
+
 void Track::getLimits(Common::Vector2& bl, Common::Vector2& tr) const
 {
 	bl = mBottomLeft;
@@ -283,6 +705,320 @@ void Track::stretchLimits(const Common::Vector2& trackpos)
 	mTopRight.y   = std::max<float>(mTopRight.y,   trackpos.y + 200.0f);
 }
 
+void Track::buildTriangleStrips()
+{
+	std::vector<Vector2> strips;
+	std::vector<unsigned int> stripStart;
+	for(auto s : mSegments) {
+		stripStart.push_back(strips.size());
+		auto strip = s->getTriangleStrip();
+		strips.insert(strips.end(), strip.begin(), strip.end());
+	}
+	stripStart.push_back(strips.size());
+	mStrips.assign(std::move(strips));
+	mStripStart.assign(std::move(stripStart));
+}
+
+const Common::Vector2* Track::getTriangleStrip(unsigned int segment, unsigned int& num) const
+{
+	assert(segment + 1 < mStripStart.size());
+	num = mStripStart[segment + 1] - mStripStart[segment];
+	return mStrips.data() + mStripStart[segment];
+}
+
+void Track::buildIndex()
+{
+	std::vector<TrackPiece> pieces;
+	for(unsigned int j = 0; j < mSegments.size(); j++) {
+		auto s = mSegments[j];
+		auto line = s->getCenterLine();
+		for(size_t i = 0; i < line.size() - 1; i++) {
+			TrackPiece p;
+			p.Start = line[i];
+			p.End = line[i + 1];
+			p.HalfWidth = s->getWidth() * 0.5f;
+			p.Error = s->getCenterLineError();
+			p.Segment = j;
+			pieces.push_back(p);
+		}
+	}
+
+	mPieces.assign(std::move(pieces));
+	if(mPieces.empty())
+		return;
+
+	// The grid covers all pieces, including the segment that was
+	// possibly added to close the track.
+	Vector2 bl = mPieces[0].Start;
+	Vector2 tr = mPieces[0].Start;
+	float maxReach = 0.0f;
+	for(const auto& p : mPieces) {
+		bl.x = std::min(bl.x, std::min(p.Start.x, p.End.x));
+		bl.y = std::min(bl.y, std::min(p.Start.y, p.End.y));
+		tr.x = std::max(tr.x, std::max(p.Start.x, p.End.x));
+		tr.y = std::max(tr.y, std::max(p.Start.y, p.End.y));
+		maxReach = std::max(maxReach, p.HalfWidth + p.Error);
+	}
+
+	mMaxPieceReach = maxReach;
+	mIndexOrigin = bl - Vector2(maxReach, maxReach);
+	mIndexWidth  = (tr.x - bl.x + 2.0f * maxReach) / mCellSize + 1;
+	mIndexHeight = (tr.y - bl.y + 2.0f * maxReach) / mCellSize + 1;
+
+	// A piece is added to every cell whose center is close enough
+	// to the piece that some point in the cell may be on the track.
+	const float cellRadius = mCellSize * 0.7072f;
+	std::vector<std::vector<unsigned int>> cells(mIndexWidth * mIndexHeight);
+	for(unsigned int i = 0; i < mPieces.size(); i++) {
+		const auto& p = mPieces[i];
+		float reach = p.HalfWidth + p.Error;
+		int x0 = (std::min(p.Start.x, p.End.x) - reach - mIndexOrigin.x) / mCellSize;
+		int y0 = (std::min(p.Start.y, p.End.y) - reach - mIndexOrigin.y) / mCellSize;
+		int x1 = (std::max(p.Start.x, p.End.x) + reach - mIndexOrigin.x) / mCellSize;
+		int y1 = (std::max(p.Start.y, p.End.y) + reach - mIndexOrigin.y) / mCellSize;
+		x0 = clamp(0, x0, mIndexWidth - 1);
+		y0 = clamp(0, y0, mIndexHeight - 1);
+		x1 = clamp(0, x1, mIndexWidth - 1);
+		y1 = clamp(0, y1, mIndexHeight - 1);
+		for(int y = y0; y <= y1; y++) {
+			for(int x = x0; x <= x1; x++) {
+				Vector2 center = mIndexOrigin + Vector2((x + 0.5f) * mCellSize,
+						(y + 0.5f) * mCellSize);
+				if(Math::pointToSegmentDistance(p.Start, p.End, center) <
+						reach + cellRadius)
+					cells[y * mIndexWidth + x].push_back(i);
+			}
+		}
+	}
+
+	std::vector<unsigned int> cellStart;
+	std::vector<unsigned int> cellPieces;
+	cellStart.reserve(cells.size() + 1);
+	for(const auto& c : cells) {
+		cellStart.push_back(cellPieces.size());
+		cellPieces.insert(cellPieces.end(), c.begin(), c.end());
+	}
+	cellStart.push_back(cellPieces.size());
+	mCellStart.assign(std::move(cellStart));
+	mCellPieces.assign(std::move(cellPieces));
+
+	buildBatchIndex();
+
+	std::cout << "Track index: " << mPieces.size() << " pieces in " <<
+		mIndexWidth << "x" << mIndexHeight << " cells.\n";
+}
+
+int Track::getIndexCell(const Common::Vector2& pos) const
+{
+	float fx = (pos.x - mIndexOrigin.x) / mCellSize;
+	float fy = (pos.y - mIndexOrigin.y) / mCellSize;
+	// compared as floats, so that far off positions and NaN are
+	// rejected before the conversion to int
+	if(!(fx >= 0.0f && fx < mIndexWidth && fy >= 0.0f && fy < mIndexHeight))
+		return -1;
+
+	int x = fx;
+	int y = fy;
+	return y * mIndexWidth + x;
+}
+
+float Track::exactDistanceToEdge(const Common::Vector2& pos) const
+{
+	// Search the index in growing rings of cells around pos. Every
+	// cell that a piece passes through refers to it, so once the best
+	// distance found beats anything a piece outside the searched rings
+	// could give, the search is done.
+	float best = -MaxEdgeDistance;
+	int lastExact = -1;
+	float fx = floor((pos.x - mIndexOrigin.x) / mCellSize);
+	float fy = floor((pos.y - mIndexOrigin.y) / mCellSize);
+	int maxRing = MaxEdgeDistance / mCellSize + 2;
+	// no ring reaches the index from farther off, and far off
+	// positions and NaN must not be converted to int
+	if(!(fx >= -maxRing && fx < mIndexWidth + maxRing &&
+				fy >= -maxRing && fy < mIndexHeight + maxRing))
+		return best;
+
+	int cx = fx;
+	int cy = fy;
+	for(int ring = 0; ring <= maxRing; ring++) {
+		for(int y = cy - ring; y <= cy + ring; y++) {
+			if(y < 0 || y >= mIndexHeight)
+				continue;
+			for(int x = cx - ring; x <= cx + ring; x++) {
+				if(x < 0 || x >= mIndexWidth)
+					continue;
+				if(abs(x - cx) != ring && abs(y - cy) != ring)
+					continue;
+				int cell = y * mIndexWidth + x;
+				for(unsigned int i = mCellStart[cell]; i < mCellStart[cell + 1]; i++) {
+					const auto& p = mPieces[mCellPieces[i]];
+					float d = p.HalfWidth - Math::pointToSegmentDistance(p.Start, p.End, pos);
+					if(p.Error > 0.0f && d + p.Error > best &&
+							lastExact != (int)p.Segment) {
+						// pieces of a segment are next to each other in a cell
+						lastExact = p.Segment;
+						d = p.HalfWidth - mSegments[p.Segment]->distance(pos);
+					} else if(p.Error > 0.0f) {
+						continue;
+					}
+					best = std::max(best, d);
+				}
+			}
+		}
+
+		if(best >= mMaxPieceReach - ring * mCellSize)
+			break;
+	}
+
+	return best;
+}
+
+float Track::distanceToEdge(const Common::Vector2& pos) const
+{
+	if(mDistanceField.empty())
+		return exactDistanceToEdge(pos);
+
+	float fx = (pos.x - mFieldOrigin.x) / mFieldCellSize;
+	float fy = (pos.y - mFieldOrigin.y) / mFieldCellSize;
+	// compared as floats, so that far off positions and NaN are
+	// rejected before the conversion to int
+	if(!(fx >= 0.0f && fx < mFieldWidth - 1 && fy >= 0.0f && fy < mFieldHeight - 1))
+		return -MaxEdgeDistance;
+
+	int x = fx;
+	int y = fy;
+
+	float tx = fx - x;
+	float ty = fy - y;
+	const float* row0 = &mDistanceField[y * mFieldWidth + x];
+	const float* row1 = row0 + mFieldWidth;
+	float d0 = row0[0] + (row0[1] - row0[0]) * tx;
+	float d1 = row1[0] + (row1[1] - row1[0]) * tx;
+	return d0 + (d1 - d0) * ty;
+}
+
+void Track::bakeDistanceField(float cellsize)
+{
+	assert(cellsize > 0.0f);
+	mDistanceField.clear();
+	mFieldOrigin = mBottomLeft;
+	mFieldCellSize = cellsize;
+	mFieldWidth  = ceil((mTopRight.x - mBottomLeft.x) / cellsize) + 1;
+	mFieldHeight = ceil((mTopRight.y - mBottomLeft.y) / cellsize) + 1;
+
+	std::vector<float> field;
+	field.reserve(mFieldWidth * mFieldHeight);
+	for(int y = 0; y < mFieldHeight; y++) {
+		for(int x = 0; x < mFieldWidth; x++) {
+			field.push_back(exactDistanceToEdge(mFieldOrigin +
+						Vector2(x * cellsize, y * cellsize)));
+		}
+	}
+	mDistanceField.swap(field);
+
+	std::cout << "Baked a " << mFieldWidth << "x" << mFieldHeight <<
+		" track distance field.\n";
+}
+
+bool Track::hasDistanceField() const
+{
+	return !mDistanceField.empty();
+}
+
+unsigned int Track::getGeometryHash() const
+{
+	// FNV-1a over the center line pieces
+	unsigned int hash = 2166136261u;
+	auto add = [&](float f) {
+		unsigned char bytes[sizeof(float)];
+		memcpy(bytes, &f, sizeof(float));
+		for(auto b : bytes) {
+			hash ^= b;
+			hash *= 16777619u;
+		}
+	};
+
+	for(const auto& p : mPieces) {
+		add(p.Start.x);
+		add(p.Start.y);
+		add(p.End.x);
+		add(p.End.y);
+		add(p.HalfWidth);
+	}
+	return hash;
+}
+
+// Distance field file layout, native endianness:
+// magic, version, geometry hash, width, height (uint32),
+// origin x, origin y, cell size (float), width * height samples (float).
+static const char DistanceFieldMagic[4] = {'S', 'C', 'R', 'D'};
+static const uint32_t DistanceFieldVersion = 1;
+// samples per side of a distance field file
+static const uint32_t MinDistanceFieldSide = 2;
+static const uint32_t MaxDistanceFieldSide = 1 << 20;
+
+void Track::saveDistanceField(const char* filename) const
+{
+	if(mDistanceField.empty())
+		throw std::runtime_error("No distance field to save");
+
+	std::ofstream out(filename, std::ofstream::binary);
+	uint32_t header[4] = {DistanceFieldVersion, getGeometryHash(),
+		(uint32_t)mFieldWidth, (uint32_t)mFieldHeight};
+	float params[3] = {mFieldOrigin.x, mFieldOrigin.y, mFieldCellSize};
+	out.write(DistanceFieldMagic, sizeof(DistanceFieldMagic));
+	out.write((const char*)header, sizeof(header));
+	out.write((const char*)params, sizeof(params));
+	out.write((const char*)&mDistanceField[0], mDistanceField.size() * sizeof(float));
+	if(!out) {
+		std::stringstream err;
+		err << "Could not write distance field to " << filename << ".\n";
+		throw std::runtime_error(err.str());
+	}
+}
+
+bool Track::loadDistanceField(const char* filename)
+{
+	std::ifstream in(filename, std::ifstream::binary);
+	char magic[4];
+	uint32_t header[4];
+	float params[3];
+	in.read(magic, sizeof(magic));
+	in.read((char*)header, sizeof(header));
+	in.read((char*)params, sizeof(params));
+	if(!in || memcmp(magic, DistanceFieldMagic, sizeof(magic)) ||
+			header[0] != DistanceFieldVersion ||
+			header[1] != getGeometryHash() ||
+			header[2] < MinDistanceFieldSide || header[2] > MaxDistanceFieldSide ||
+			header[3] < MinDistanceFieldSide || header[3] > MaxDistanceFieldSide ||
+			!std::isfinite(params[0]) || !std::isfinite(params[1]) ||
+			!(params[2] > 0.0f) || !std::isfinite(params[2])) {
+		return false;
+	}
+
+	// the samples must be all that is left of the file
+	uint64_t size = (uint64_t)header[2] * header[3] * sizeof(float);
+	std::streampos start = in.tellg();
+	in.seekg(0, std::ifstream::end);
+	std::streampos end = in.tellg();
+	if(!in || start < 0 || end < start || (uint64_t)(end - start) != size)
+		return false;
+	in.seekg(start);
+
+	std::vector<float> field(header[2] * (size_t)header[3]);
+	in.read((char*)&field[0], size);
+	if(!in)
+		return false;
+
+	mDistanceField.swap(field);
+	mFieldWidth = header[2];
+	mFieldHeight = header[3];
+	mFieldOrigin = Vector2(params[0], params[1]);
+	mFieldCellSize = params[2];
+	return true;
+}
+
 TrackConfig Track::readTrackConfig(const char* filename)
 {
 	Json::Reader reader;
@@ -296,6 +1032,10 @@ TrackConfig Track::readTrackConfig(const char* filename)
 
 	TrackConfig tc;
 	tc.Width = root["width"].asDouble();
+	if(root.isMember("tolerance"))
+		tc.Tolerance = root["tolerance"].asDouble();
+	if(tc.Tolerance <= 0.0f)
+		throw std::runtime_error("Track tolerance must be positive");
 	for(const auto& seg : root["segments"]) {
 		TrackConfig::TSInfo info;
 		std::string type = seg["type"].asString();
@@ -3,15 +3,60 @@
 
 #include <vector>
 #include <array>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
 
 #include "common/Vector2.h"
 
+class TrackImage;
+
+// A read-only array that either owns its elements or refers to
+// elements owned by someone else, e.g. a mapped track image.
+template<typename T>
+class TrackArray {
+	public:
+		TrackArray() { }
+		TrackArray(const TrackArray&) = delete;
+		TrackArray& operator=(const TrackArray&) = delete;
+
+		void assign(std::vector<T>&& v)
+		{
+			mOwned = std::move(v);
+			mData = mOwned.data();
+			mSize = mOwned.size();
+		}
+
+		void refer(const T* data, size_t size)
+		{
+			mOwned.clear();
+			mData = data;
+			mSize = size;
+		}
+
+		const T& operator[](size_t i) const { return mData[i]; }
+		const T* data() const { return mData; }
+		size_t size() const { return mSize; }
+		bool empty() const { return mSize == 0; }
+		const T* begin() const { return mData; }
+		const T* end() const { return mData + mSize; }
+		const T& back() const { return mData[mSize - 1]; }
+		// heap memory of the owned elements
+		size_t getMemoryUsage() const { return mOwned.capacity() * sizeof(T); }
+
+	private:
+		std::vector<T> mOwned;
+		const T* mData = nullptr;
+		size_t mSize = 0;
+};
+
 class TrackSegment {
 	public:
 		virtual ~TrackSegment() { }
 
 		// functions needed by the game engine
 		virtual bool onTrack(const Common::Vector2& pos) const = 0;
+		virtual float distance(const Common::Vector2& pos) const = 0; // to the center line
 
 		// functions needed by graphics
 		virtual std::vector<Common::Vector2> getTriangleStrip() const = 0;
@@ -19,6 +64,20 @@ class TrackSegment {
 		// functions needed by track creation
 		virtual Common::Vector2 getEndPosition() const = 0;
 		virtual float getLength() const = 0;
+
+		// functions needed by track coordinates
+		// Projects pos on the center line. along is the arc length from the
+		// segment start, lateral the signed offset, positive to the left.
+		// Returns -1 if pos is before the segment, 1 if after it, else 0.
+		virtual int project(const Common::Vector2& pos, float& along, float& lateral) const = 0;
+
+		// functions needed by the track spatial index
+		virtual std::vector<Common::Vector2> getCenterLine() const = 0;
+		virtual float getCenterLineError() const = 0; // max distance from getCenterLine()
+		virtual float getWidth() const = 0;
+
+		// in bytes, including the segment itself
+		virtual size_t getMemoryUsage() const = 0;
 };
 
 class StraightTrackSegment : public TrackSegment {
@@ -27,11 +86,19 @@ class StraightTrackSegment : public TrackSegment {
 				const Common::Vector2& dir,
 				float len, float width);
 		virtual bool onTrack(const Common::Vector2& pos) const override;
+		virtual float distance(const Common::Vector2& pos) const override;
 		virtual std::vector<Common::Vector2> getTriangleStrip() const override;
 		virtual Common::Vector2 getEndPosition() const override;
 		virtual float getLength() const override;
+		virtual int project(const Common::Vector2& pos, float& along, float& lateral) const override;
+		virtual std::vector<Common::Vector2> getCenterLine() const override;
+		virtual float getCenterLineError() const override;
+		virtual float getWidth() const override;
+		virtual size_t getMemoryUsage() const override;
 
 	private:
+		friend class TrackImage;
+
 		Common::Vector2 mStartPos;
 		Common::Vector2 mEndPos;
 		Common::Vector2 mDir;
@@ -45,17 +112,44 @@ class CurveSegment : public TrackSegment {
 				const Common::Vector2& dir,
 				const Common::Vector2& endpos,
 				const Common::Vector2& enddir,
-				float width);
+				float width,
+				float tolerance);
+		// For track images: the curve has been created before, and its
+		// center line and length table are used in place.
+		CurveSegment(const Common::Vector2& startpos,
+				const Common::Vector2& dir,
+				const Common::Vector2& endpos,
+				const Common::Vector2& enddir,
+				const Common::Vector2& p1,
+				float width,
+				float approximationError,
+				const Common::Vector2* approximations, unsigned int numApproximations,
+				const float* lengthTable, unsigned int lengthTableSize);
 		virtual bool onTrack(const Common::Vector2& pos) const override;
+		virtual float distance(const Common::Vector2& pos) const override;
 		virtual std::vector<Common::Vector2> getTriangleStrip() const override;
 		virtual Common::Vector2 getEndPosition() const override;
 		virtual float getLength() const override;
+		virtual int project(const Common::Vector2& pos, float& along, float& lateral) const override;
+		virtual std::vector<Common::Vector2> getCenterLine() const override;
+		virtual float getCenterLineError() const override;
+		virtual float getWidth() const override;
+		virtual size_t getMemoryUsage() const override;
 
 		// 0 <= t <= 1
 		Common::Vector2 pointOnCurve(float t) const;
 		Common::Vector2 directionOnCurve(float t) const;
 
+		// exact closest point on the curve, t may be nullptr
+		Common::Vector2 closestPoint(const Common::Vector2& pos, float* t) const;
+		float arcLength(float t) const;
+
 	private:
+		friend class TrackImage;
+
+		void tessellate(float t0, float t1, float tolerance, int depth,
+				std::vector<float>& params) const;
+
 		Common::Vector2 mStartPos;
 		Common::Vector2 mEndPos;
 		Common::Vector2 mDir;
@@ -63,8 +157,11 @@ class CurveSegment : public TrackSegment {
 		Common::Vector2 mP1;
 		float mWidth;
 
-		std::vector<Common::Vector2> mApproximations;
-		int mNumApproxSegments;
+		TrackArray<Common::Vector2> mApproximations;
+		float mApproximationError;
+
+		// arc length at t = i / (mLengthTable.size() - 1)
+		TrackArray<float> mLengthTable;
 };
 
 struct TrackConfig {
@@ -91,25 +188,150 @@ struct TrackConfig {
 	};
 
 	float Width;
+	float Tolerance = 0.05f; // max distance of the tessellated edges from the curves
 	std::vector<TSInfo> Segments;
 };
 
+struct TrackQueryStats {
+	unsigned long Hits = 0;          // on the hinted piece
+	unsigned long NeighbourHits = 0; // on a piece next to the hinted one
+	unsigned long Fallbacks = 0;     // needed a full index query
+};
+
+// Remembers where the last onTrack() query of a continuously moving
+// point such as a wheel hit the track: the segment and the piece of
+// the segment center line. Each caller has its own hints, so the
+// statistics are kept in them rather than in the shared track.
+struct TrackQueryHint {
+	int Segment = -1;
+	int Piece = -1;
+	TrackQueryStats Stats; // of the queries with this hint
+};
+
+// Position of a point relative to the track, kept up to date
+// incrementally with Track::updatePosition().
+struct TrackPosition {
+	int Segment = -1;
+	int Lap = 0;      // increases every time the start line is crossed forwards
+	float S = 0.0f;   // arc length along the center line from the start
+	float D = 0.0f;   // signed offset from the center line, positive to the left
+};
+
 class Track {
 	public:
 		Track(const TrackConfig* tc);
+		Track(TrackImage* image); // takes ownership of image
 		~Track();
+		Track(const Track&) = delete;
+		Track& operator=(const Track&) = delete;
 		const std::vector<TrackSegment*>& getTrackSegments() const;
+		// same as getTrackSegments()[segment]->getTriangleStrip()
+		const Common::Vector2* getTriangleStrip(unsigned int segment, unsigned int& num) const;
 		bool onTrack(const Common::Vector2& pos) const;
+		bool onTrack(const Common::Vector2& pos, TrackQueryHint& hint) const;
+		// Sets out[i] to 1 if pts[i] is on the track, 0 otherwise.
+		// hints may be nullptr, otherwise it holds a hint for each point.
+		void onTrackBatch(const Common::Vector2* pts, size_t n, uint8_t* out,
+				TrackQueryHint* hints = nullptr) const;
 		void getLimits(Common::Vector2& bl, Common::Vector2& tr) const;
+		float getLength() const;
+		// Heap memory held by the track and its segments in bytes.
+		// The data of a mapped track image isn't included.
+		size_t getMemoryUsage() const;
+
+		// Updates tp to the position of pos, starting the search from
+		// the previous position.
+		void updatePosition(const Common::Vector2& pos, TrackPosition& tp) const;
+		TrackPosition findPosition(const Common::Vector2& pos) const;
+
+		// Signed distance from pos to the nearest track edge, positive
+		// on the track. Off track the value is clamped to -MaxEdgeDistance.
+		// Uses the baked distance field if there is one.
+		float distanceToEdge(const Common::Vector2& pos) const;
+		float exactDistanceToEdge(const Common::Vector2& pos) const;
+
+		// Distance field mode: after baking (or loading) the field,
+		// onTrack() and distanceToEdge() are bilinear lookups.
+		void bakeDistanceField(float cellsize);
+		void saveDistanceField(const char* filename) const;
+		bool loadDistanceField(const char* filename);
+		bool hasDistanceField() const;
 
 		static TrackConfig readTrackConfig(const char* filename);
 
+		static constexpr float MaxEdgeDistance = 50.0f;
+
 	private:
+		friend class TrackImage;
+
+		struct TrackPiece {
+			Common::Vector2 Start;
+			Common::Vector2 End;
+			float HalfWidth;
+			float Error; // max distance of the segment center line from the piece
+			unsigned int Segment;
+		};
+
 		void stretchLimits(const Common::Vector2& trackpos);
+		void buildIndex();
+		void buildTriangleStrips();
+		int getIndexCell(const Common::Vector2& pos) const;
+		int findPiece(const Common::Vector2& pos) const;
+		int findPieceBatch(const Common::Vector2& pos) const;
+		bool tryHint(const Common::Vector2& pos, TrackQueryHint& hint) const;
+		void buildBatchIndex();
+		bool onPiece(const Common::Vector2& pos, unsigned int piece) const;
+		unsigned int getGeometryHash() const;
 
 		std::vector<TrackSegment*> mSegments;
+		TrackArray<float> mSegmentStart; // arc length at the start of each segment
+		float mLength = 0.0f;
 		Common::Vector2 mBottomLeft;
 		Common::Vector2 mTopRight;
+
+		// Spatial index for onTrack(): a uniform grid over the center line
+		// pieces of all segments. Cell i refers to the pieces
+		// mCellPieces[mCellStart[i]] .. mCellPieces[mCellStart[i + 1] - 1].
+		TrackArray<TrackPiece> mPieces;
+		TrackArray<unsigned int> mCellStart;
+		TrackArray<unsigned int> mCellPieces;
+		Common::Vector2 mIndexOrigin;
+		float mCellSize = 16.0f;
+		int mIndexWidth = 0;
+		int mIndexHeight = 0;
+		float mMaxPieceReach = 0.0f; // max HalfWidth + Error
+
+		// The index again for onTrackBatch(): the pieces of every cell
+		// are copied as structure of arrays, padded to a multiple of
+		// BatchWidth entries, so they can be tested with SIMD.
+		struct BatchIndex {
+			TrackArray<float> StartX;
+			TrackArray<float> StartY;
+			TrackArray<float> DirX;
+			TrackArray<float> DirY;
+			TrackArray<float> InvLength2;
+			TrackArray<float> Inner2; // squared distance that is surely on the track
+			TrackArray<float> Outer2; // squared distance that may be on the track
+			TrackArray<int> Piece;
+			TrackArray<unsigned int> CellStart;
+		};
+		static const unsigned int BatchWidth = 8;
+		BatchIndex mBatchIndex;
+
+		// Distance field samples at the corners of the field cells,
+		// row by row, covering getLimits().
+		std::vector<float> mDistanceField;
+		Common::Vector2 mFieldOrigin;
+		float mFieldCellSize = 0.0f;
+		int mFieldWidth = 0;
+		int mFieldHeight = 0;
+
+		// triangle strips of all segments; the strip of segment i is
+		// mStrips[mStripStart[i]] .. mStrips[mStripStart[i + 1] - 1]
+		TrackArray<Common::Vector2> mStrips;
+		TrackArray<unsigned int> mStripStart;
+
+		TrackImage* mImage = nullptr;
 };
 
 #endif
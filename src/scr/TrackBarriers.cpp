@@ -0,0 +1,39 @@
+#include "TrackBarriers.h"
+#include "Track.h"
+
+using namespace Common;
+
+TrackBarriers::TrackBarriers(const Track* t, float runoff)
+{
+	auto numSegments = t->getTrackSegments().size();
+	for(unsigned int i = 0; i < numSegments; i++) {
+		unsigned int numVertices;
+		auto triStrip = t->getTriangleStrip(i, numVertices);
+
+		// the strip alternates between the two edges
+		std::vector<Vector2> edges[2];
+		for(unsigned int j = 0; j + 1 < numVertices; j += 2) {
+			Vector2 across = (triStrip[j + 1] - triStrip[j]).normalized();
+			edges[0].push_back(triStrip[j] - across * runoff);
+			edges[1].push_back(triStrip[j + 1] + across * runoff);
+		}
+
+		for(int side = 0; side < 2; side++) {
+			const auto& edge = edges[side];
+			const auto& other = edges[1 - side];
+			for(unsigned int j = 0; j + 1 < edge.size(); j++) {
+				Abyss::Barrier b;
+				b.Start = edge[j];
+				b.End = edge[j + 1];
+				if((b.End - b.Start).null())
+					continue;
+				Vector2 dir = (b.End - b.Start).normalized();
+				b.Normal = Vector2(-dir.y, dir.x);
+				if(b.Normal.dot(other[j] - edge[j]) < 0.0f)
+					b.Normal = b.Normal * -1.0f;
+				Barriers.push_back(b);
+			}
+		}
+	}
+}
+
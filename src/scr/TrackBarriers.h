@@ -0,0 +1,19 @@
+#ifndef SCR_TRACKBARRIERS_H
+#define SCR_TRACKBARRIERS_H
+
+#include <vector>
+
+#include "abyss/Collision.h"
+
+class Track;
+
+// Barriers along the left and right edges of the triangle strip of
+// each segment, runoff metres out from the edge, facing the track.
+// Kept apart from the track so that it doesn't need the physics engine.
+struct TrackBarriers {
+	TrackBarriers(const Track* t, float runoff);
+	std::vector<Abyss::Barrier> Barriers;
+};
+
+#endif
+
@@ -0,0 +1,216 @@
+#include <cassert>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "common/Math.h"
+
+#include "Track.h"
+
+using namespace Common;
+
+void Track::buildBatchIndex()
+{
+	std::vector<float> startX, startY, dirX, dirY, invLength2, inner2, outer2;
+	std::vector<int> pieces;
+	std::vector<unsigned int> cellStart;
+	for(size_t cell = 0; cell + 1 < mCellStart.size(); cell++) {
+		cellStart.push_back(pieces.size());
+		for(unsigned int i = mCellStart[cell]; i < mCellStart[cell + 1]; i++) {
+			const auto& p = mPieces[mCellPieces[i]];
+			Vector2 dir = p.End - p.Start;
+			float len2 = dir.dot(dir);
+			float inner = p.HalfWidth - p.Error;
+			float outer = p.HalfWidth + p.Error;
+			startX.push_back(p.Start.x);
+			startY.push_back(p.Start.y);
+			dirX.push_back(dir.x);
+			dirY.push_back(dir.y);
+			invLength2.push_back(len2 > 0.0f ? 1.0f / len2 : 0.0f);
+			inner2.push_back(inner > 0.0f ? inner * inner : -1.0f);
+			outer2.push_back(outer * outer);
+			pieces.push_back(mCellPieces[i]);
+		}
+
+		// padding that never matches
+		while(pieces.size() % BatchWidth) {
+			startX.push_back(0.0f);
+			startY.push_back(0.0f);
+			dirX.push_back(0.0f);
+			dirY.push_back(0.0f);
+			invLength2.push_back(0.0f);
+			inner2.push_back(-1.0f);
+			outer2.push_back(-1.0f);
+			pieces.push_back(-1);
+		}
+	}
+	cellStart.push_back(pieces.size());
+
+	auto& bi = mBatchIndex;
+	bi.StartX.assign(std::move(startX));
+	bi.StartY.assign(std::move(startY));
+	bi.DirX.assign(std::move(dirX));
+	bi.DirY.assign(std::move(dirY));
+	bi.InvLength2.assign(std::move(invLength2));
+	bi.Inner2.assign(std::move(inner2));
+	bi.Outer2.assign(std::move(outer2));
+	bi.Piece.assign(std::move(pieces));
+	bi.CellStart.assign(std::move(cellStart));
+}
+
+// The kernels test a point against the batch index entries
+// [start, end) and return the first entry the point is surely on,
+// or -1. ambiguous is set if the point is near the edge of a curve
+// and needs the exact test.
+
+#if !defined(__SSE2__)
+static int findEntryScalar(const float* sx, const float* sy,
+		const float* dx, const float* dy, const float* il2,
+		const float* in2, const float* out2,
+		unsigned int start, unsigned int end,
+		float px, float py, bool& ambiguous)
+{
+	for(unsigned int i = start; i < end; i++) {
+		float rx = px - sx[i];
+		float ry = py - sy[i];
+		float t = (rx * dx[i] + ry * dy[i]) * il2[i];
+		t = clamp(0.0f, t, 1.0f);
+		float qx = rx - t * dx[i];
+		float qy = ry - t * dy[i];
+		float d2 = qx * qx + qy * qy;
+		if(d2 < in2[i])
+			return i;
+		if(d2 < out2[i])
+			ambiguous = true;
+	}
+	return -1;
+}
+#else
+static int findEntrySSE2(const float* sx, const float* sy,
+		const float* dx, const float* dy, const float* il2,
+		const float* in2, const float* out2,
+		unsigned int start, unsigned int end,
+		float px, float py, bool& ambiguous)
+{
+	const __m128 vpx = _mm_set1_ps(px);
+	const __m128 vpy = _mm_set1_ps(py);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	for(unsigned int i = start; i < end; i += 4) {
+		__m128 rx = _mm_sub_ps(vpx, _mm_loadu_ps(sx + i));
+		__m128 ry = _mm_sub_ps(vpy, _mm_loadu_ps(sy + i));
+		__m128 ex = _mm_loadu_ps(dx + i);
+		__m128 ey = _mm_loadu_ps(dy + i);
+		__m128 t = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(rx, ex), _mm_mul_ps(ry, ey)),
+				_mm_loadu_ps(il2 + i));
+		t = _mm_min_ps(_mm_max_ps(t, zero), one);
+		__m128 qx = _mm_sub_ps(rx, _mm_mul_ps(t, ex));
+		__m128 qy = _mm_sub_ps(ry, _mm_mul_ps(t, ey));
+		__m128 d2 = _mm_add_ps(_mm_mul_ps(qx, qx), _mm_mul_ps(qy, qy));
+		int hit = _mm_movemask_ps(_mm_cmplt_ps(d2, _mm_loadu_ps(in2 + i)));
+		if(hit)
+			return i + __builtin_ctz(hit);
+		if(_mm_movemask_ps(_mm_cmplt_ps(d2, _mm_loadu_ps(out2 + i))))
+			ambiguous = true;
+	}
+	return -1;
+}
+
+__attribute__((target("avx")))
+static int findEntryAVX(const float* sx, const float* sy,
+		const float* dx, const float* dy, const float* il2,
+		const float* in2, const float* out2,
+		unsigned int start, unsigned int end,
+		float px, float py, bool& ambiguous)
+{
+	const __m256 vpx = _mm256_set1_ps(px);
+	const __m256 vpy = _mm256_set1_ps(py);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps(1.0f);
+	for(unsigned int i = start; i < end; i += 8) {
+		__m256 rx = _mm256_sub_ps(vpx, _mm256_loadu_ps(sx + i));
+		__m256 ry = _mm256_sub_ps(vpy, _mm256_loadu_ps(sy + i));
+		__m256 ex = _mm256_loadu_ps(dx + i);
+		__m256 ey = _mm256_loadu_ps(dy + i);
+		__m256 t = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(rx, ex), _mm256_mul_ps(ry, ey)),
+				_mm256_loadu_ps(il2 + i));
+		t = _mm256_min_ps(_mm256_max_ps(t, zero), one);
+		__m256 qx = _mm256_sub_ps(rx, _mm256_mul_ps(t, ex));
+		__m256 qy = _mm256_sub_ps(ry, _mm256_mul_ps(t, ey));
+		__m256 d2 = _mm256_add_ps(_mm256_mul_ps(qx, qx), _mm256_mul_ps(qy, qy));
+		int hit = _mm256_movemask_ps(_mm256_cmp_ps(d2, _mm256_loadu_ps(in2 + i), _CMP_LT_OQ));
+		if(hit)
+			return i + __builtin_ctz(hit);
+		if(_mm256_movemask_ps(_mm256_cmp_ps(d2, _mm256_loadu_ps(out2 + i), _CMP_LT_OQ)))
+			ambiguous = true;
+	}
+	return -1;
+}
+#endif
+
+typedef int (*FindEntryFunc)(const float*, const float*,
+		const float*, const float*, const float*,
+		const float*, const float*,
+		unsigned int, unsigned int,
+		float, float, bool&);
+
+static FindEntryFunc selectFindEntry()
+{
+#if defined(__SSE2__)
+	if(__builtin_cpu_supports("avx"))
+		return findEntryAVX;
+	return findEntrySSE2;
+#else
+	return findEntryScalar;
+#endif
+}
+
+int Track::findPieceBatch(const Common::Vector2& pos) const
+{
+	static const FindEntryFunc findEntry = selectFindEntry();
+
+	int cell = getIndexCell(pos);
+	if(cell < 0)
+		return -1;
+
+	const auto& bi = mBatchIndex;
+	bool ambiguous = false;
+	int entry = findEntry(bi.StartX.data(), bi.StartY.data(),
+			bi.DirX.data(), bi.DirY.data(), bi.InvLength2.data(),
+			bi.Inner2.data(), bi.Outer2.data(),
+			bi.CellStart[cell], bi.CellStart[cell + 1],
+			pos.x, pos.y, ambiguous);
+	if(entry >= 0)
+		return bi.Piece[entry];
+
+	if(ambiguous)
+		return findPiece(pos);
+
+	return -1;
+}
+
+void Track::onTrackBatch(const Common::Vector2* pts, size_t n, uint8_t* out,
+		TrackQueryHint* hints) const
+{
+	if(!mDistanceField.empty()) {
+		for(size_t i = 0; i < n; i++)
+			out[i] = distanceToEdge(pts[i]) > 0.0f;
+		return;
+	}
+
+	for(size_t i = 0; i < n; i++) {
+		if(hints && tryHint(pts[i], hints[i])) {
+			out[i] = 1;
+			continue;
+		}
+
+		int piece = findPieceBatch(pts[i]);
+		out[i] = piece >= 0;
+		if(hints && piece >= 0) {
+			hints[i].Piece = piece;
+			hints[i].Segment = mPieces[piece].Segment;
+		}
+	}
+}
+
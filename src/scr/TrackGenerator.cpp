@@ -0,0 +1,128 @@
+#include <cmath>
+#include <algorithm>
+
+#include "TrackGenerator.h"
+
+static const float HairpinRadius = 25.0f;
+static const float MaxLateral = 6.0f;
+static const float MaxWiggle = 3.0f;
+static const float AverageSegmentLength = 26.0f;
+
+TrackGenerator::TrackGenerator(unsigned int seed)
+	: mRandom(seed)
+{
+}
+
+// std::uniform_real_distribution is implementation defined, this
+// gives the same numbers everywhere.
+float TrackGenerator::uniform(float lo, float hi)
+{
+	return lo + (hi - lo) * (mRandom() / 4294967296.0);
+}
+
+TrackConfig TrackGenerator::generate(unsigned int numSegments, float width)
+{
+	mConfig = TrackConfig();
+	mConfig.Width = width;
+	mX = mY = mMinX = 0.0;
+	mDirX = 1.0;
+	mDirY = 0.0;
+
+	const float r = HairpinRadius;
+	// roughly as many rows as the rows are long
+	double rowLength = std::max(200.0, sqrt(numSegments * AverageSegmentLength * 2.0 * r));
+
+	// the rows, starting to the right from the origin
+	for(int row = 0; ; row++) {
+		float sx = row % 2 ? -1.0f : 1.0f;
+		mLateral = 0.0;
+		while(row % 2 ? mX > 0.0 : mX < rowLength) {
+			// leave room for the hairpin, the last row and the way back
+			bool finish = mConfig.Segments.size() + 12 >= numSegments;
+			if(finish && row % 2 == 0)
+				break;
+			addFeature(sx, finish);
+		}
+
+		if(row % 2 && mConfig.Segments.size() + 12 >= numSegments)
+			break;
+
+		// hairpin up to the next row
+		addCurve(sx, r, sx * r, 0.0f, sx);
+		addCurve(sx, -r, sx * r, -1.0f, 0.0f);
+	}
+
+	// back to the start along the left of all the rows
+	double returnX = mMinX - 30.0 - r;
+	addStraight(mX - returnX - r);
+	addCurve(-1.0f, r, r, 0.0f, 1.0f);
+	if(mY - 2.0 * r > 0.01)
+		addStraight(mY - 2.0 * r);
+	addCurve(-1.0f, -r, r, -1.0f, 0.0f);
+	// the track closes itself with a straight back to the origin
+	return mConfig;
+}
+
+void TrackGenerator::addFeature(float sx, bool finish)
+{
+	float p = uniform(0.0f, 1.0f);
+	if(finish || p < 0.3f) {
+		// on the last row, just head for the end
+		addStraight(finish ? std::max(mX, 0.0) + uniform(10.0f, 60.0f) : uniform(10.0f, 60.0f));
+		return;
+	}
+
+	float l = uniform(10.0f, 40.0f);
+	float k = uniform(0.1f, 0.5f);
+	// the control point of each curve must lie between its ends
+	float h = std::min(k * l * uniform(0.2f, 0.8f), MaxWiggle);
+	float side = uniform(0.0f, 1.0f) < 0.5f ? -1.0f : 1.0f;
+
+	if(p < 0.7f) {
+		// wiggle
+		addCurve(sx, l, side * h, 1.0f, side * k);
+		addCurve(sx, l, side * h, 1.0f, 0.0f);
+		addCurve(sx, l, -side * h, 1.0f, -side * k);
+		addCurve(sx, l, -side * h, 1.0f, 0.0f);
+	} else {
+		// kink to the side, back towards the row if it's too far off
+		if(fabs(mLateral + 2.0f * side * h) > MaxLateral)
+			side = -side;
+		addCurve(sx, l, side * h, 1.0f, side * k);
+		addCurve(sx, l, side * h, 1.0f, 0.0f);
+		mLateral += 2.0f * side * h;
+	}
+}
+
+void TrackGenerator::addStraight(float length)
+{
+	TrackConfig::TSInfo info;
+	info.Type = TrackConfig::TSType::Straight;
+	info.Info.StraightInfo.Length = length;
+	mConfig.Segments.push_back(info);
+
+	mX += mDirX * length;
+	mY += mDirY * length;
+	mMinX = std::min(mMinX, mX);
+}
+
+void TrackGenerator::addCurve(float sx, float offx, float offy, float dirx, float diry)
+{
+	TrackConfig::TSInfo info;
+	info.Type = TrackConfig::TSType::Curve;
+	info.Info.CurveInfo.endOffset_x = sx * offx;
+	info.Info.CurveInfo.endOffset_y = sx * offy;
+	info.Info.CurveInfo.endPosition_x = 0.0f;
+	info.Info.CurveInfo.endPosition_y = 0.0f;
+	info.Info.CurveInfo.endDirection_x = sx * dirx;
+	info.Info.CurveInfo.endDirection_y = sx * diry;
+	mConfig.Segments.push_back(info);
+
+	mX += sx * offx;
+	mY += sx * offy;
+	double len = sqrt(dirx * dirx + diry * diry);
+	mDirX = sx * dirx / len;
+	mDirY = sx * diry / len;
+	mMinX = std::min(mMinX, mX);
+}
+
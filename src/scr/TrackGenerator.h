@@ -0,0 +1,37 @@
+#ifndef SCR_TRACKGENERATOR_H
+#define SCR_TRACKGENERATOR_H
+
+#include <random>
+
+#include "Track.h"
+
+// Generates random closed tracks of any size for testing and
+// benchmarking. The track snakes back and forth in rows of straights,
+// wiggles and kinks joined by hairpins, and returns to the start along
+// the left side, so it never crosses itself. The same seed always
+// gives the same track.
+class TrackGenerator {
+	public:
+		TrackGenerator(unsigned int seed);
+		// The track has numSegments segments, give or take a few.
+		TrackConfig generate(unsigned int numSegments, float width = 8.0f);
+
+	private:
+		float uniform(float lo, float hi);
+		void addFeature(float sx, bool finish);
+		void addStraight(float length);
+		// offset and end direction relative to the row direction sx
+		void addCurve(float sx, float offx, float offy, float dirx, float diry);
+
+		std::mt19937 mRandom;
+		TrackConfig mConfig;
+		double mX = 0.0;
+		double mY = 0.0;
+		double mDirX = 1.0;
+		double mDirY = 0.0;
+		double mMinX = 0.0;
+		double mLateral = 0.0; // offset from the start of the row
+};
+
+#endif
+
@@ -0,0 +1,383 @@
+#include <cassert>
+#include <cstring>
+
+#include <stdexcept>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "TrackImage.h"
+#include "Track.h"
+
+using namespace Common;
+
+static_assert(sizeof(Vector2) == 2 * sizeof(float), "Vector2 must be plain data for track images");
+
+static const char TrackImageMagic[4] = {'S', 'C', 'R', 'T'};
+static const uint32_t TrackImageByteOrder = 0x01020304;
+
+TrackImage::TrackImage(const char* filename)
+{
+	int fd = open(filename, O_RDONLY);
+	if(fd == -1) {
+		std::stringstream err;
+		err << "Could not open track image " << filename << ": " << strerror(errno);
+		throw std::runtime_error(err.str());
+	}
+
+	struct stat st;
+	if(fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(TrackImageHeader)) {
+		close(fd);
+		throw std::runtime_error("Track image is too small");
+	}
+
+	void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(data == MAP_FAILED) {
+		std::stringstream err;
+		err << "Could not map track image " << filename << ": " << strerror(errno);
+		throw std::runtime_error(err.str());
+	}
+
+	mData = (const char*)data;
+	mSize = st.st_size;
+
+	const auto& h = getHeader();
+	const char* err = nullptr;
+	if(memcmp(h.Magic, TrackImageMagic, sizeof(h.Magic)))
+		err = "Not a track image";
+	else if(h.Version != Version)
+		err = "Unsupported track image version";
+	else if(h.ByteOrder != TrackImageByteOrder)
+		err = "Track image has the wrong byte order";
+	else if(h.NumSections != (uint32_t)TrackImageSection::NumSections ||
+			h.FileSize != mSize)
+		err = "Track image is corrupt";
+
+	for(int i = 0; !err && i < (int)TrackImageSection::NumSections; i++) {
+		const auto& s = h.Sections[i];
+		if(s.Offset % 8 || s.Offset > mSize || s.Size > mSize - s.Offset)
+			err = "Track image is corrupt";
+	}
+
+	if(err) {
+		munmap((void*)mData, mSize);
+		throw std::runtime_error(err);
+	}
+}
+
+TrackImage::~TrackImage()
+{
+	munmap((void*)mData, mSize);
+}
+
+const TrackImageHeader& TrackImage::getHeader() const
+{
+	return *reinterpret_cast<const TrackImageHeader*>(mData);
+}
+
+class TrackImageWriter {
+	public:
+		TrackImageWriter()
+			: mData(sizeof(TrackImageHeader))
+		{
+			memset(&mData[0], 0, mData.size());
+		}
+
+		template<typename T>
+		void add(TrackImageSection s, const T* data, size_t count)
+		{
+			while(mData.size() % 8)
+				mData.push_back(0);
+			auto& info = getHeader().Sections[(int)s];
+			info.Offset = mData.size();
+			info.Size = count * sizeof(T);
+			const char* bytes = reinterpret_cast<const char*>(data);
+			mData.insert(mData.end(), bytes, bytes + info.Size);
+		}
+
+		template<typename T>
+		void add(TrackImageSection s, const T& arr)
+		{
+			add(s, arr.data(), arr.size());
+		}
+
+		TrackImageHeader& getHeader()
+		{
+			return *reinterpret_cast<TrackImageHeader*>(&mData[0]);
+		}
+
+		const std::vector<char>& getData() const
+		{
+			return mData;
+		}
+
+	private:
+		std::vector<char> mData;
+};
+
+void TrackImage::write(const Track& track, const char* filename,
+		uint32_t configHash)
+{
+	TrackImageWriter w;
+
+	std::vector<TrackImageSegment> segments;
+	std::vector<Vector2> curvePoints;
+	std::vector<float> curveLengths;
+	for(auto seg : track.mSegments) {
+		TrackImageSegment is;
+		memset(&is, 0, sizeof(is));
+		if(auto s = dynamic_cast<const StraightTrackSegment*>(seg)) {
+			is.Type = TrackImageSegment::Straight;
+			is.Width = s->mWidth;
+			is.Start[0] = s->mStartPos.x;
+			is.Start[1] = s->mStartPos.y;
+			is.Dir[0] = s->mDir.x;
+			is.Dir[1] = s->mDir.y;
+			is.End[0] = s->mEndPos.x;
+			is.End[1] = s->mEndPos.y;
+			is.EndDir[0] = s->mDir.x;
+			is.EndDir[1] = s->mDir.y;
+			is.Length = s->mLength;
+		} else if(auto c = dynamic_cast<const CurveSegment*>(seg)) {
+			is.Type = TrackImageSegment::Curve;
+			is.Width = c->mWidth;
+			is.Start[0] = c->mStartPos.x;
+			is.Start[1] = c->mStartPos.y;
+			is.Dir[0] = c->mDir.x;
+			is.Dir[1] = c->mDir.y;
+			is.End[0] = c->mEndPos.x;
+			is.End[1] = c->mEndPos.y;
+			is.EndDir[0] = c->mEndDir.x;
+			is.EndDir[1] = c->mEndDir.y;
+			is.Control[0] = c->mP1.x;
+			is.Control[1] = c->mP1.y;
+			is.ApproximationError = c->mApproximationError;
+			is.FirstPoint = curvePoints.size();
+			is.NumPoints = c->mApproximations.size();
+			curvePoints.insert(curvePoints.end(), c->mApproximations.begin(),
+					c->mApproximations.end());
+			is.FirstLength = curveLengths.size();
+			is.NumLengths = c->mLengthTable.size();
+			curveLengths.insert(curveLengths.end(), c->mLengthTable.begin(),
+					c->mLengthTable.end());
+		} else {
+			throw std::runtime_error("Unknown track segment type");
+		}
+		segments.push_back(is);
+	}
+
+	w.add(TrackImageSection::Segments, segments);
+	w.add(TrackImageSection::SegmentStart, track.mSegmentStart);
+	w.add(TrackImageSection::CurvePoints, curvePoints);
+	w.add(TrackImageSection::CurveLengths, curveLengths);
+	w.add(TrackImageSection::Strips, track.mStrips);
+	w.add(TrackImageSection::StripStart, track.mStripStart);
+	w.add(TrackImageSection::Pieces, track.mPieces);
+	w.add(TrackImageSection::CellStart, track.mCellStart);
+	w.add(TrackImageSection::CellPieces, track.mCellPieces);
+	const auto& bi = track.mBatchIndex;
+	w.add(TrackImageSection::BatchStartX, bi.StartX);
+	w.add(TrackImageSection::BatchStartY, bi.StartY);
+	w.add(TrackImageSection::BatchDirX, bi.DirX);
+	w.add(TrackImageSection::BatchDirY, bi.DirY);
+	w.add(TrackImageSection::BatchInvLength2, bi.InvLength2);
+	w.add(TrackImageSection::BatchInner2, bi.Inner2);
+	w.add(TrackImageSection::BatchOuter2, bi.Outer2);
+	w.add(TrackImageSection::BatchPiece, bi.Piece);
+	w.add(TrackImageSection::BatchCellStart, bi.CellStart);
+
+	auto& h = w.getHeader();
+	memcpy(h.Magic, TrackImageMagic, sizeof(h.Magic));
+	h.Version = Version;
+	h.ByteOrder = TrackImageByteOrder;
+	h.NumSections = (uint32_t)TrackImageSection::NumSections;
+	h.FileSize = w.getData().size();
+	h.BottomLeft[0] = track.mBottomLeft.x;
+	h.BottomLeft[1] = track.mBottomLeft.y;
+	h.TopRight[0] = track.mTopRight.x;
+	h.TopRight[1] = track.mTopRight.y;
+	h.Length = track.mLength;
+	h.IndexOrigin[0] = track.mIndexOrigin.x;
+	h.IndexOrigin[1] = track.mIndexOrigin.y;
+	h.CellSize = track.mCellSize;
+	h.IndexWidth = track.mIndexWidth;
+	h.IndexHeight = track.mIndexHeight;
+	h.MaxPieceReach = track.mMaxPieceReach;
+	h.ConfigHash = configHash;
+
+	std::ofstream out(filename, std::ofstream::binary);
+	out.write(&w.getData()[0], w.getData().size());
+	if(!out) {
+		std::stringstream err;
+		err << "Could not write track image " << filename << ".";
+		throw std::runtime_error(err.str());
+	}
+}
+
+uint32_t TrackImage::hashConfig(const char* filename)
+{
+	std::ifstream in(filename, std::ifstream::binary);
+	if(!in) {
+		std::stringstream err;
+		err << "Could not read track config " << filename << ".";
+		throw std::runtime_error(err.str());
+	}
+
+	// FNV-1a
+	uint32_t hash = 2166136261u;
+	char c;
+	while(in.get(c)) {
+		hash ^= (unsigned char)c;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+// Whether the starts of the ranges in an array of the given size never
+// decrease and the last one is within the array.
+template<typename T>
+static bool validStarts(const T& starts, size_t size)
+{
+	if(starts.size() == 0)
+		return false;
+	for(size_t i = 0; i + 1 < starts.size(); i++) {
+		if(starts[i] > starts[i + 1])
+			return false;
+	}
+	return starts.back() <= size;
+}
+
+// Whether all indices are at least min and less than count.
+template<typename T>
+static bool validIndices(const T& indices, long long min, size_t count)
+{
+	for(size_t i = 0; i < indices.size(); i++) {
+		if((long long)indices[i] < min || (long long)indices[i] >= (long long)count)
+			return false;
+	}
+	return true;
+}
+
+Track::Track(TrackImage* image)
+	: mImage(image)
+{
+	try {
+		const auto& h = image->getHeader();
+		mBottomLeft = Vector2(h.BottomLeft[0], h.BottomLeft[1]);
+		mTopRight = Vector2(h.TopRight[0], h.TopRight[1]);
+		mLength = h.Length;
+		mIndexOrigin = Vector2(h.IndexOrigin[0], h.IndexOrigin[1]);
+		mCellSize = h.CellSize;
+		mIndexWidth = h.IndexWidth;
+		mIndexHeight = h.IndexHeight;
+		mMaxPieceReach = h.MaxPieceReach;
+
+		size_t numSegments, numPoints, numLengths;
+		auto segments = image->getSection<TrackImageSegment>(TrackImageSection::Segments, numSegments);
+		auto points = image->getSection<Vector2>(TrackImageSection::CurvePoints, numPoints);
+		auto lengths = image->getSection<float>(TrackImageSection::CurveLengths, numLengths);
+		mSegments.reserve(numSegments);
+		for(size_t i = 0; i < numSegments; i++) {
+			const auto& is = segments[i];
+			Vector2 start(is.Start[0], is.Start[1]);
+			Vector2 dir(is.Dir[0], is.Dir[1]);
+			if(is.Type == TrackImageSegment::Straight) {
+				mSegments.push_back(new StraightTrackSegment(start, dir, is.Length, is.Width));
+			} else if(is.Type == TrackImageSegment::Curve) {
+				if(is.NumPoints < 2 || is.NumLengths < 2 ||
+						(uint64_t)is.FirstPoint + is.NumPoints > numPoints ||
+						(uint64_t)is.FirstLength + is.NumLengths > numLengths)
+					throw std::runtime_error("Track image is corrupt");
+				mSegments.push_back(new CurveSegment(start, dir,
+							Vector2(is.End[0], is.End[1]),
+							Vector2(is.EndDir[0], is.EndDir[1]),
+							Vector2(is.Control[0], is.Control[1]),
+							is.Width, is.ApproximationError,
+							points + is.FirstPoint, is.NumPoints,
+							lengths + is.FirstLength, is.NumLengths));
+			} else {
+				throw std::runtime_error("Track image is corrupt");
+			}
+		}
+
+		size_t n;
+		const float* segmentStart = image->getSection<float>(TrackImageSection::SegmentStart, n);
+		mSegmentStart.refer(segmentStart, n);
+		const Vector2* strips = image->getSection<Vector2>(TrackImageSection::Strips, n);
+		mStrips.refer(strips, n);
+		const uint32_t* stripStart = image->getSection<uint32_t>(TrackImageSection::StripStart, n);
+		mStripStart.refer(stripStart, n);
+		const TrackPiece* pieces = image->getSection<TrackPiece>(TrackImageSection::Pieces, n);
+		mPieces.refer(pieces, n);
+		const uint32_t* cellStart = image->getSection<uint32_t>(TrackImageSection::CellStart, n);
+		mCellStart.refer(cellStart, n);
+		const uint32_t* cellPieces = image->getSection<uint32_t>(TrackImageSection::CellPieces, n);
+		mCellPieces.refer(cellPieces, n);
+
+		auto& bi = mBatchIndex;
+		const float* f;
+		f = image->getSection<float>(TrackImageSection::BatchStartX, n);
+		bi.StartX.refer(f, n);
+		f = image->getSection<float>(TrackImageSection::BatchStartY, n);
+		bi.StartY.refer(f, n);
+		f = image->getSection<float>(TrackImageSection::BatchDirX, n);
+		bi.DirX.refer(f, n);
+		f = image->getSection<float>(TrackImageSection::BatchDirY, n);
+		bi.DirY.refer(f, n);
+		f = image->getSection<float>(TrackImageSection::BatchInvLength2, n);
+		bi.InvLength2.refer(f, n);
+		f = image->getSection<float>(TrackImageSection::BatchInner2, n);
+		bi.Inner2.refer(f, n);
+		f = image->getSection<float>(TrackImageSection::BatchOuter2, n);
+		bi.Outer2.refer(f, n);
+		const int32_t* batchPiece = image->getSection<int32_t>(TrackImageSection::BatchPiece, n);
+		bi.Piece.refer(batchPiece, n);
+		const uint32_t* batchCellStart = image->getSection<uint32_t>(TrackImageSection::BatchCellStart, n);
+		bi.CellStart.refer(batchCellStart, n);
+
+		if(!(mCellSize > 0.0f) || mIndexWidth <= 0 || mIndexHeight <= 0)
+			throw std::runtime_error("Track image is corrupt");
+		size_t numCells = (size_t)mIndexWidth * mIndexHeight + 1;
+		if(mSegmentStart.size() != numSegments ||
+				mStripStart.size() != numSegments + 1 ||
+				!validStarts(mStripStart, mStrips.size()) ||
+				mCellStart.size() != numCells ||
+				!validStarts(mCellStart, mCellPieces.size()) ||
+				bi.CellStart.size() != numCells ||
+				!validStarts(bi.CellStart, bi.Piece.size()) ||
+				bi.StartX.size() != bi.Piece.size() ||
+				bi.StartY.size() != bi.Piece.size() ||
+				bi.DirX.size() != bi.Piece.size() ||
+				bi.DirY.size() != bi.Piece.size() ||
+				bi.InvLength2.size() != bi.Piece.size() ||
+				bi.Inner2.size() != bi.Piece.size() ||
+				bi.Outer2.size() != bi.Piece.size())
+			throw std::runtime_error("Track image is corrupt");
+
+		// the indices must be within what they index, and the
+		// batches are searched BatchWidth entries at a time
+		if(!validIndices(mCellPieces, 0, mPieces.size()) ||
+				!validIndices(bi.Piece, -1, mPieces.size()))
+			throw std::runtime_error("Track image is corrupt");
+		for(size_t i = 0; i < mPieces.size(); i++) {
+			if(mPieces[i].Segment >= numSegments)
+				throw std::runtime_error("Track image is corrupt");
+		}
+		for(size_t i = 0; i < bi.CellStart.size(); i++) {
+			if(bi.CellStart[i] % BatchWidth)
+				throw std::runtime_error("Track image is corrupt");
+		}
+	} catch(...) {
+		for(auto s : mSegments)
+			delete s;
+		delete mImage;
+		throw;
+	}
+}
+
@@ -0,0 +1,119 @@
+#ifndef SCR_TRACKIMAGE_H
+#define SCR_TRACKIMAGE_H
+
+#include <cstdint>
+#include <cstddef>
+
+class Track;
+
+// A track image holds everything Track builds from a TrackConfig:
+// segments, center lines, length tables, triangle strips and the
+// spatial indices. It is written by the track compiler and mapped
+// in memory by the game, which then uses the data in place.
+//
+// The file starts with a TrackImageHeader. Sections are 8 byte
+// aligned arrays of plain data in native byte order. The header
+// records a hash of the track config the image was compiled from,
+// so a stale image can be told apart from an edited config.
+
+enum class TrackImageSection : uint32_t {
+	Segments,       // TrackImageSegment
+	SegmentStart,   // float
+	CurvePoints,    // Common::Vector2
+	CurveLengths,   // float
+	Strips,         // Common::Vector2
+	StripStart,     // uint32_t
+	Pieces,         // Track::TrackPiece
+	CellStart,      // uint32_t
+	CellPieces,     // uint32_t
+	BatchStartX,    // float
+	BatchStartY,    // float
+	BatchDirX,      // float
+	BatchDirY,      // float
+	BatchInvLength2, // float
+	BatchInner2,    // float
+	BatchOuter2,    // float
+	BatchPiece,     // int32_t
+	BatchCellStart, // uint32_t
+	NumSections
+};
+
+struct TrackImageSectionInfo {
+	uint64_t Offset; // in bytes from the start of the file
+	uint64_t Size;   // in bytes
+};
+
+struct TrackImageHeader {
+	char Magic[4];       // "SCRT"
+	uint32_t Version;
+	uint32_t ByteOrder;  // 0x01020304 when written
+	uint32_t NumSections;
+	uint64_t FileSize;
+	float BottomLeft[2];
+	float TopRight[2];
+	float Length;
+	float IndexOrigin[2];
+	float CellSize;
+	int32_t IndexWidth;
+	int32_t IndexHeight;
+	float MaxPieceReach;
+	uint32_t ConfigHash; // hashConfig() of the source config, 0 if none
+	TrackImageSectionInfo Sections[(int)TrackImageSection::NumSections];
+};
+
+struct TrackImageSegment {
+	enum Type : uint32_t {
+		Straight,
+		Curve
+	};
+
+	uint32_t Type;
+	float Width;
+	float Start[2];
+	float Dir[2];
+	float End[2];
+	float EndDir[2];
+	float Control[2];     // curves: the middle Bezier control point
+	float Length;         // straights
+	float ApproximationError;
+	uint32_t FirstPoint;  // curves: center line in CurvePoints
+	uint32_t NumPoints;
+	uint32_t FirstLength; // curves: length table in CurveLengths
+	uint32_t NumLengths;
+};
+
+class TrackImage {
+	public:
+		// Maps the image file; throws std::runtime_error if the file
+		// can't be mapped or isn't a valid image of this version.
+		TrackImage(const char* filename);
+		~TrackImage();
+		TrackImage(const TrackImage&) = delete;
+		TrackImage& operator=(const TrackImage&) = delete;
+
+		const TrackImageHeader& getHeader() const;
+
+		template<typename T>
+		const T* getSection(TrackImageSection s, size_t& count) const
+		{
+			const auto& info = getHeader().Sections[(int)s];
+			count = info.Size / sizeof(T);
+			return reinterpret_cast<const T*>(mData + info.Offset);
+		}
+
+		static void write(const Track& track, const char* filename,
+				uint32_t configHash = 0);
+
+		// Hash of the contents of a track config file; throws
+		// std::runtime_error if the file can't be read.
+		static uint32_t hashConfig(const char* filename);
+
+		static const uint32_t Version = 2;
+
+	private:
+		const char* mData = nullptr;
+		size_t mSize = 0;
+};
+
+#endif
+
@@ -0,0 +1,24 @@
+#include "TrackMesh.h"
+#include "Track.h"
+
+TrackMesh::TrackMesh(const Track* t)
+{
+	auto numSegments = t->getTrackSegments().size();
+
+	StripStart.push_back(0);
+	for(unsigned int i = 0; i < numSegments; i++) {
+		unsigned int numVertices;
+		auto triStrip = t->getTriangleStrip(i, numVertices);
+
+		for(unsigned int j = 0; j < numVertices; j++) {
+			const auto& v = triStrip[j];
+			Vertices.push_back(v.x);
+			Vertices.push_back(-0.1f);
+			Vertices.push_back(v.y);
+			TexCoords.push_back(v.x * 0.08f);
+			TexCoords.push_back(v.y * 0.08f);
+		}
+		StripStart.push_back(StripStart.back() + numVertices);
+	}
+}
+
@@ -0,0 +1,18 @@
+#ifndef SCR_TRACKMESH_H
+#define SCR_TRACKMESH_H
+
+#include <vector>
+
+class Track;
+
+// Vertex data for drawing the track, one triangle strip per segment.
+// Kept apart from the renderer so that it can be built without GL.
+struct TrackMesh {
+	TrackMesh(const Track* t);
+	std::vector<float> Vertices;          // x, y, z for each vertex
+	std::vector<float> TexCoords;         // u, v for each vertex
+	std::vector<unsigned int> StripStart; // first vertex of each segment, and the total
+};
+
+#endif
+
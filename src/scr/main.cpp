@@ -3,6 +3,10 @@
 #include <cassert>
 #include <algorithm>
 #include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <cerrno>
+#include <climits>
 
 #include "common/Vector2.h"
 
@@ -21,14 +25,13 @@ void test_abyss_rigid_bodies()
 	Real boatDepth = 2.0;
 	Real boatDensity = 100.0;
 
-	RigidBody boat;
+	RigidBody boat(&world);
 	boat.setMass(boatMass);
 
 	Gravity gravity(Vector2(0.0, -9.8));
 	Buoyancy buoyancy(Vector2(0.0, 0.0), boatDepth, boatMass / boatDensity, 0.0, 1000.0);
 	Drag drag(10.0, 0.0);
 
-	world.addBody(&boat);
 	world.getForceRegistry()->add(&boat, &gravity);
 	world.getForceRegistry()->add(&boat, &buoyancy);
 	world.getForceRegistry()->add(&boat, &drag);
@@ -36,11 +39,11 @@ void test_abyss_rigid_bodies()
 	for(int i = 0; i < 5000; i++) {
 		world.startFrame();
 		if(i < 50 || i % 100 == 0) {
-			std::cout << i << " Boat position: " << boat.position << "; velocity: " << boat.velocity << "\n";
-			if(boat.position.y < -boatDepth) {
+			std::cout << i << " Boat position: " << boat.getPosition() << "; velocity: " << boat.getVelocity() << "\n";
+			if(boat.getPosition().y < -boatDepth) {
 				std::cout << "Boat sank!\n";
 				break;
-			} else if(boat.position.y > boatDepth * 2.0) {
+			} else if(boat.getPosition().y > boatDepth * 2.0) {
 				std::cout << "Boat floats in the air!\n";
 				break;
 			}
@@ -50,10 +53,31 @@ void test_abyss_rigid_bodies()
 	}
 }
 
-int run_game(const char* carname, const char* trackname)
+// Parses all of str as a finite number.
+static bool parse_float(const char* str, float& value)
+{
+	char* end;
+	value = strtof(str, &end);
+	return end != str && !*end && std::isfinite(value);
+}
+
+// Parses all of str as a positive number that fits an unsigned int.
+static bool parse_positive(const char* str, unsigned int& value)
+{
+	char* end;
+	errno = 0;
+	long l = strtol(str, &end, 10);
+	if(end == str || *end || errno || l <= 0 || (unsigned long)l > UINT_MAX)
+		return false;
+	value = l;
+	return true;
+}
+
+int run_game(const char* carname, const char* trackname, const char* recordfile,
+		float timestep, unsigned int maxSubsteps, float barrierRunoff)
 {
 	Game g;
-	g.run(carname, trackname);
+	g.run(carname, trackname, recordfile, timestep, maxSubsteps, barrierRunoff);
 	return 0;
 }
 
@@ -61,6 +85,10 @@ int main(int argc, char** argv)
 {
 	const char* carname = "stock_car";
 	const char* trackname = "simple";
+	const char* recordfile = nullptr;
+	float timestep = 0.01f;
+	unsigned int maxSubsteps = 10;
+	float barrierRunoff = -1.0f;
 	for(int i = 0; i < argc; i++) {
 		if(!strcmp(argv[i], "-t")) {
 			test_abyss_rigid_bodies();
@@ -79,10 +107,47 @@ int main(int argc, char** argv)
 				return 1;
 			}
 			trackname = argv[i];
+		} else if(!strcmp(argv[i], "--record")) {
+			i++;
+			if(i == argc) {
+				std::cerr << "--record requires an argument.\n";
+				return 1;
+			}
+			recordfile = argv[i];
+		} else if(!strcmp(argv[i], "--step")) {
+			i++;
+			if(i == argc) {
+				std::cerr << "--step requires an argument.\n";
+				return 1;
+			}
+			if(!parse_float(argv[i], timestep) || timestep <= 0.0f) {
+				std::cerr << "--step must be a positive number.\n";
+				return 1;
+			}
+		} else if(!strcmp(argv[i], "--max-substeps")) {
+			i++;
+			if(i == argc) {
+				std::cerr << "--max-substeps requires an argument.\n";
+				return 1;
+			}
+			if(!parse_positive(argv[i], maxSubsteps)) {
+				std::cerr << "--max-substeps must be a positive integer.\n";
+				return 1;
+			}
+		} else if(!strcmp(argv[i], "--barriers")) {
+			i++;
+			if(i == argc) {
+				std::cerr << "--barriers requires an argument.\n";
+				return 1;
+			}
+			if(!parse_float(argv[i], barrierRunoff) || barrierRunoff < 0.0f) {
+				std::cerr << "--barriers must be a number that is not negative.\n";
+				return 1;
+			}
 		}
 	}
 
-	run_game(carname, trackname);
+	run_game(carname, trackname, recordfile, timestep, maxSubsteps, barrierRunoff);
 
 	return 0;
 }
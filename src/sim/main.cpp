@@ -0,0 +1,243 @@
+#include <iostream>
+#include <algorithm>
+#include <fstream>
+#include <vector>
+#include <stdexcept>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+#include "common/Math.h"
+
+#include "scr/GameWorld.h"
+#include "scr/InputRecording.h"
+
+// Runs the game physics without graphics as fast as possible, driven
+// by recorded inputs (see InputRecording and the game's --record option)
+// or by an autopilot.
+
+// Keeps the car near the center line by steering on its offset from
+// the line and how fast that changes, holding the speed at about
+// speed m/s. Deterministic, so runs are comparable.
+class Autopilot {
+	public:
+		Autopilot(float speed)
+			: mSpeed(speed)
+		{
+		}
+
+		DriverInput drive(const Car* car, float timestep)
+		{
+			DriverInput in;
+			float d = car->getTrackPosition().D;
+			float dd = mPrevD == INFINITY ? 0.0f : (d - mPrevD) / timestep;
+			mPrevD = d;
+			in.Steering = Common::clamp(-1.0f, 0.2f * d + 0.5f * dd, 1.0f);
+			float speed = car->getSpeed();
+			in.Throttle = speed < mSpeed ? 1.0f : 0.0f;
+			in.Brake = speed > mSpeed * 1.2f ? 1.0f : 0.0f;
+			return in;
+		}
+
+	private:
+		float mSpeed;
+		float mPrevD = INFINITY;
+};
+
+struct TrajectoryPoint {
+	float Time;
+	float X;
+	float Y;
+};
+
+// The car position once per simulated second, for comparing runs of
+// different builds, e.g. single and double precision physics.
+static void save_trajectory(const std::vector<TrajectoryPoint>& trajectory, const char* filename)
+{
+	std::ofstream out(filename);
+	if(!out)
+		throw std::runtime_error(std::string("Could not open ") + filename);
+	out.precision(9);
+	out << "# time x y\n";
+	for(const auto& p : trajectory)
+		out << p.Time << " " << p.X << " " << p.Y << "\n";
+	if(!out)
+		throw std::runtime_error(std::string("Could not write ") + filename);
+}
+
+static std::vector<TrajectoryPoint> load_trajectory(const char* filename)
+{
+	std::ifstream in(filename);
+	if(!in)
+		throw std::runtime_error(std::string("Could not open ") + filename);
+	std::vector<TrajectoryPoint> trajectory;
+	std::string line;
+	while(std::getline(in, line)) {
+		if(line.empty() || line[0] == '#')
+			continue;
+		std::istringstream ss(line);
+		TrajectoryPoint p;
+		if(!(ss >> p.Time >> p.X >> p.Y))
+			throw std::runtime_error(std::string("Invalid line in ") + filename + ": " + line);
+		trajectory.push_back(p);
+	}
+	return trajectory;
+}
+
+static void compare_trajectories(const std::vector<TrajectoryPoint>& trajectory,
+		const std::vector<TrajectoryPoint>& reference)
+{
+	if(trajectory.size() != reference.size())
+		throw std::runtime_error("The reference trajectory has a different length");
+	float maxDist = 0.0f;
+	float maxTime = 0.0f;
+	double sumDist = 0.0;
+	for(size_t i = 0; i < trajectory.size(); i++) {
+		// the times are sums of float steps
+		if(fabs(trajectory[i].Time - reference[i].Time) > 0.001f)
+			throw std::runtime_error("The reference trajectory has different time steps");
+		float dx = trajectory[i].X - reference[i].X;
+		float dy = trajectory[i].Y - reference[i].Y;
+		float dist = sqrt(dx * dx + dy * dy);
+		sumDist += dist;
+		if(dist > maxDist) {
+			maxDist = dist;
+			maxTime = trajectory[i].Time;
+		}
+	}
+	std::cout << "Deviation from the reference trajectory: max " << maxDist << " m at " <<
+		maxTime << " s, mean " << sumDist / std::max<size_t>(1, trajectory.size()) << " m\n";
+}
+
+// Parses all of str as a finite number.
+static bool parse_float(const char* str, float& value)
+{
+	char* end;
+	value = strtof(str, &end);
+	return end != str && !*end && std::isfinite(value);
+}
+
+static void usage(const char* prog)
+{
+	std::cerr << "Usage: " << prog << " [--car <car>] [--track <track>] [--inputs <file>]\n"
+		"\t[--time <simulated seconds>] [--step <timestep>] [--tolerance <substep error>]\n"
+		"\t[--barriers <runoff>]\n"
+		"\t[--trajectory <file to save>] [--compare <reference trajectory>]\n";
+}
+
+int main(int argc, char** argv)
+{
+	const char* carname = "stock_car";
+	const char* trackname = "simple";
+	const char* inputfile = nullptr;
+	const char* trajectoryfile = nullptr;
+	const char* comparefile = nullptr;
+	float simTime = 600.0f;
+	float timestep = 0.01f;
+	float tolerance = 0.0f;
+	float barrierRunoff = -1.0f;
+
+	for(int i = 1; i < argc; i++) {
+		if(i + 1 == argc) {
+			usage(argv[0]);
+			return 1;
+		}
+		if(!strcmp(argv[i], "--car")) {
+			carname = argv[++i];
+		} else if(!strcmp(argv[i], "--track")) {
+			trackname = argv[++i];
+		} else if(!strcmp(argv[i], "--inputs")) {
+			inputfile = argv[++i];
+		} else if(!strcmp(argv[i], "--time")) {
+			if(!parse_float(argv[++i], simTime) || simTime <= 0.0f) {
+				usage(argv[0]);
+				return 1;
+			}
+		} else if(!strcmp(argv[i], "--step")) {
+			if(!parse_float(argv[++i], timestep) || timestep <= 0.0f) {
+				usage(argv[0]);
+				return 1;
+			}
+		} else if(!strcmp(argv[i], "--tolerance")) {
+			if(!parse_float(argv[++i], tolerance) || tolerance < 0.0f) {
+				usage(argv[0]);
+				return 1;
+			}
+		} else if(!strcmp(argv[i], "--barriers")) {
+			if(!parse_float(argv[++i], barrierRunoff) || barrierRunoff < 0.0f) {
+				usage(argv[0]);
+				return 1;
+			}
+		} else if(!strcmp(argv[i], "--trajectory")) {
+			trajectoryfile = argv[++i];
+		} else if(!strcmp(argv[i], "--compare")) {
+			comparefile = argv[++i];
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	try {
+		InputRecording inputs;
+		if(inputfile)
+			inputs = InputRecording::load(inputfile);
+		Autopilot autopilot(20.0f);
+		GameWorld world(carname, trackname);
+		auto car = world.getCar();
+		world.getPhysicsWorld()->setAdaptiveStepping(tolerance);
+		if(barrierRunoff >= 0.0f)
+			world.setBarriers(true, barrierRunoff);
+
+		unsigned long steps = simTime / timestep;
+		unsigned long offroadSteps = 0;
+		unsigned long sampleSteps = std::max(1l, lround(1.0f / timestep));
+		std::vector<TrajectoryPoint> trajectory;
+		auto start = std::chrono::steady_clock::now();
+		for(unsigned long i = 0; i < steps; i++) {
+			if(i % sampleSteps == 0) {
+				auto pos = car->getPosition();
+				trajectory.push_back({i * timestep, pos.x, pos.y});
+			}
+
+			// same as GameDriver
+			DriverInput in = inputfile ? inputs.get(i * timestep) :
+				autopilot.drive(car, timestep);
+			if(!in.Brake)
+				car->setThrottle(Common::clamp(0.0f, in.Throttle, 1.0f));
+			if(!in.Throttle)
+				car->setBrake(Common::clamp(0.0f, in.Brake, 1.0f));
+			car->setSteering(in.Steering);
+			world.updatePhysics(timestep);
+			offroadSteps += car->isOffroad();
+		}
+		std::chrono::duration<double> wall = std::chrono::steady_clock::now() - start;
+
+		const auto& tp = car->getTrackPosition();
+		std::cout << "Simulated " << steps * timestep << " s in " << steps << " steps of " <<
+			timestep << " s in " << wall.count() << " s: " <<
+			steps * timestep / wall.count() << " simulated s per wall s, " <<
+			wall.count() * 1.0e6 / steps << " us per step\n";
+		std::cout << "Car at " << car->getPosition() << ", lap " << tp.Lap << " at " <<
+			tp.S << " m, off road " << 100.0 * offroadSteps / steps << " % of the time\n";
+		std::cout << "Physics in " << (sizeof(Abyss::Real) == sizeof(float) ? "single" : "double") <<
+			" precision\n";
+		if(tolerance) {
+			const auto& stats = world.getPhysicsWorld()->getSteppingStats();
+			std::cout << "Adaptive stepping: " << stats.Substeps / double(stats.Frames) <<
+				" substeps per step on average, " << stats.Rejected << " substeps rejected\n";
+		}
+		if(trajectoryfile)
+			save_trajectory(trajectory, trajectoryfile);
+		if(comparefile)
+			compare_trajectories(trajectory, load_trajectory(comparefile));
+	} catch(const std::runtime_error& e) {
+		std::cerr << e.what() << "\n";
+		return 1;
+	}
+
+	return 0;
+}
+
@@ -0,0 +1,48 @@
+#include <iostream>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstring>
+
+#include "scr/Track.h"
+#include "scr/TrackImage.h"
+#include "scr/TrackGenerator.h"
+
+// Compiles a track config to a track image that the game can map
+// directly instead of rebuilding the track at startup, or generates
+// a random track of the given size.
+
+int main(int argc, char** argv)
+{
+	bool generate = argc == 5 && !strcmp(argv[1], "--generate");
+	if(argc != 3 && !generate) {
+		std::cerr << "Usage: " << argv[0] << " <track config> <track image>\n";
+		std::cerr << "       " << argv[0] << " --generate <segments> <seed> <track image>\n";
+		return 1;
+	}
+
+	const char* imagefile = argv[argc - 1];
+	try {
+		TrackConfig trackConfig;
+		uint32_t configHash = 0;
+		if(generate) {
+			TrackGenerator gen(strtoul(argv[3], nullptr, 10));
+			trackConfig = gen.generate(strtoul(argv[2], nullptr, 10));
+		} else {
+			trackConfig = Track::readTrackConfig(argv[1]);
+			configHash = TrackImage::hashConfig(argv[1]);
+		}
+		Track track(&trackConfig);
+		TrackImage::write(track, imagefile, configHash);
+
+		// make sure the image loads back
+		Track loaded(new TrackImage(imagefile));
+		std::cout << imagefile << ": " << loaded.getTrackSegments().size() << " segments, "
+			<< loaded.getLength() << " m.\n";
+	} catch(const std::runtime_error& e) {
+		std::cerr << e.what() << "\n";
+		return 1;
+	}
+
+	return 0;
+}
+